@@ -215,7 +215,9 @@ test_lab5() {
 }
 
 test_lab6() {
-  local score_str="LAB6 SCORE"
+  # Compiler flags, such as -O, to build every testcase with
+  local flags=$1
+  local score_str="LAB6 SCORE${flags:+ ($flags)}"
   local testcase_dir=${WORKDIR}/testdata/lab5or6/testcases
   local ref_dir=${WORKDIR}/testdata/lab5or6/refs
   local mergecase_dir=$testcase_dir/merge
@@ -232,7 +234,7 @@ test_lab6() {
     local ref=${ref_dir}/${testcase_name}.out
     local assem=$testcase.s
 
-    ./tiger-compiler "$testcase" &>/dev/null
+    ./tiger-compiler $flags "$testcase" &>/dev/null
     gcc -Wl,--wrap,getchar -m64 "$assem" "$runtime_path" -o test.out &>/dev/null
     if [ ! -s test.out ]; then
       echo "Error: Link error [$testcase_name]"
@@ -278,7 +280,9 @@ test_lab6() {
 }
 
 test_lab7() {
-  local score_str="LAB7 SCORE"
+  # Compiler flags, such as -O, to build every testcase with
+  local flags=$1
+  local score_str="LAB7 SCORE${flags:+ ($flags)}"
   local testcase_dir=${WORKDIR}/testdata/lab7/testcases
   local ref_dir=${WORKDIR}/testdata/lab7/refs
   local runtime_path=${WORKDIR}/src/tiger/runtime/runtime.cc
@@ -286,6 +290,13 @@ test_lab7() {
   local score=0
   local full_score=1
   local testcase_name
+  # Runtime settings every testcase must also pass under, one run each
+  local settings=(
+    "TIGER_HEAP_SIZE=64K"
+    "TIGER_HEAP_SIZE=64K TIGER_GC_THREADS=4"
+    "TIGER_HEAP_SIZE=64K TIGER_ROPE_MIN=2"
+  )
+  local setting
 
   build tiger-compiler
   for testcase in "$testcase_dir"/*.tig; do
@@ -293,7 +304,7 @@ test_lab7() {
     local ref=${ref_dir}/${testcase_name}.out
     local assem=$testcase.s
 
-    ./tiger-compiler "$testcase" &>/dev/null
+    ./tiger-compiler $flags "$testcase" &>/dev/null
     g++ -Wl,--wrap,getchar -m64 "$assem" "$runtime_path" "$heap_path" -o test.out &>/dev/null
     if [ ! -s test.out ]; then
       echo "Error: Link error [$testcase_name]"
@@ -308,6 +319,32 @@ test_lab7() {
       full_score=0
       continue
     fi
+    for setting in "${settings[@]}"; do
+      env $setting ./test.out >&/tmp/output.txt
+      diff -w -B /tmp/output.txt "$ref"
+      if [[ $? != 0 ]]; then
+        echo "Error: Output mismatch [$testcase_name with $setting]"
+        full_score=0
+        continue 2
+      fi
+    done
+
+    # Statistics and the trace go elsewhere and must not change the output
+    rm -f /tmp/gc_trace.jsonl
+    TIGER_HEAP_SIZE=64K TIGER_GC_STATS=1 TIGER_GC_TRACE=/tmp/gc_trace.jsonl \
+      ./test.out >/tmp/output.txt 2>/tmp/gc_stats.txt
+    diff -w -B /tmp/output.txt "$ref"
+    if [[ $? != 0 ]]; then
+      echo "Error: Output mismatch [$testcase_name with GC statistics]"
+      full_score=0
+      continue
+    fi
+    if ! grep -q "^Tiger GC:" /tmp/gc_stats.txt ||
+      grep -qv '^{"gc": ' /tmp/gc_trace.jsonl; then
+      echo "Error: Bad GC statistics or trace [$testcase_name]"
+      full_score=0
+      continue
+    fi
     echo "Pass $testcase_name"
     if [[ $testcase_name == "bigger_tree" ]]; then
       score=$((score + 30))
@@ -325,6 +362,53 @@ test_lab7() {
   fi
 }
 
+test_opt() {
+  local score_str="OPT SCORE"
+  local testcase_dir=${WORKDIR}/testdata/opt/testcases
+  local ref_dir=${WORKDIR}/testdata/opt/refs
+  local runtime_path=${WORKDIR}/src/tiger/runtime/runtime.c
+  local full_score=1
+  local testcase_name
+  local flags
+
+  build tiger-compiler
+  for testcase in "$testcase_dir"/*.tig; do
+    testcase_name=$(basename "$testcase" | cut -f1 -d".")
+    local ref=${ref_dir}/${testcase_name}.out
+    local assem=$testcase.s
+
+    # The optimizer must not change what a program prints
+    for flags in "" "-O"; do
+      rm -f test.out
+      ./tiger-compiler $flags "$testcase" &>/dev/null
+      gcc -Wl,--wrap,getchar -m64 "$assem" "$runtime_path" -o test.out &>/dev/null
+      if [ ! -s test.out ]; then
+        echo "Error: Link error [$testcase_name${flags:+ $flags}]"
+        full_score=0
+        continue 2
+      fi
+
+      ./test.out >&/tmp/output.txt
+      diff -w -B /tmp/output.txt "$ref"
+      if [[ $? != 0 ]]; then
+        echo "Error: Output mismatch [$testcase_name${flags:+ $flags}]"
+        full_score=0
+        continue 2
+      fi
+    done
+    echo "Pass $testcase_name"
+  done
+  rm -f "$testcase_dir"/*.tig.s
+
+  if [[ $full_score == 0 ]]; then
+    echo "${score_str}: 0"
+    exit 1
+  else
+    echo "[^_^]: Pass"
+    echo "${score_str}: 100"
+  fi
+}
+
 main() {
   local scope=$1
 
@@ -362,6 +446,13 @@ main() {
   elif [[ $scope == "lab7" ]]; then
     echo "========== Lab7 Test =========="
     test_lab7
+  elif [[ $scope == "opt" ]]; then
+    echo "========== Lab6 Test with -O =========="
+    test_lab6 -O
+    echo "========== Lab7 Test with -O =========="
+    test_lab7 -O
+    echo "========== Optimizer Test =========="
+    test_opt
   elif [[ $scope == "all" ]]; then
     echo "========== Lab1 Test =========="
     test_lab1
@@ -379,11 +470,17 @@ main() {
     test_lab6
     echo "========== Lab7 Test =========="
     test_lab7
+    echo "========== Lab6 Test with -O =========="
+    test_lab6 -O
+    echo "========== Lab7 Test with -O =========="
+    test_lab7 -O
+    echo "========== Optimizer Test =========="
+    test_opt
   else
     echo "Wrong test scope: Please specify the part you want to test"
-    echo -e "\tscripts/grade.sh [lab1|lab2|lab3|lab4|lab5-part1|lab5|lab6|lab7|all]"
+    echo -e "\tscripts/grade.sh [lab1|lab2|lab3|lab4|lab5-part1|lab5|lab6|lab7|opt|all]"
     echo -e "or"
-    echo -e "\tmake [gradelab1|gradelab2|gradelab3|gradelab4|gradelab5|gradelab5-1|gradelab6|gradelab7|gradeall]"
+    echo -e "\tmake [gradelab1|gradelab2|gradelab3|gradelab4|gradelab5|gradelab5-1|gradelab6|gradelab7|gradeopt|gradeall]"
   fi
 }
 
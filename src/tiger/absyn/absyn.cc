@@ -28,12 +28,10 @@ AbsynTree::~AbsynTree() { delete root_; }
 
 void AbsynTree::Print(FILE *out) const { root_->Print(out, 0); }
 
-SimpleVar::~SimpleVar() { delete sym_; }
+// Symbols are interned and shared, so nodes never delete them
+SimpleVar::~SimpleVar() = default;
 
-FieldVar::~FieldVar() {
-  delete var_;
-  delete sym_;
-}
+FieldVar::~FieldVar() { delete var_; }
 
 SubscriptVar::~SubscriptVar() {
   delete var_;
@@ -48,20 +46,14 @@ IntExp::~IntExp() = default;
 
 StringExp::~StringExp() = default;
 
-CallExp::~CallExp() {
-  delete func_;
-  delete args_;
-}
+CallExp::~CallExp() { delete args_; }
 
 OpExp::~OpExp() {
   delete left_;
   delete right_;
 }
 
-RecordExp::~RecordExp() {
-  delete typ_;
-  delete fields_;
-}
+RecordExp::~RecordExp() { delete fields_; }
 
 SeqExp::~SeqExp() { delete seq_; }
 
@@ -91,33 +83,25 @@ LetExp::~LetExp() {
 }
 
 ArrayExp::~ArrayExp() {
-  delete typ_;
   delete size_;
   delete init_;
 }
 
 VoidExp::~VoidExp() = default;
 
-EField::~EField() {
-  delete name_;
-  delete exp_;
-}
+EField::~EField() { delete exp_; }
 
 FunctionDec::~FunctionDec() { delete functions_; }
 
-VarDec::~VarDec() {
-  delete var_;
-  delete typ_;
-  delete init_;
-}
+VarDec::~VarDec() { delete init_; }
 
 TypeDec::~TypeDec() { delete types_; }
 
-NameTy::~NameTy() { delete name_; }
+NameTy::~NameTy() = default;
 
 RecordTy::~RecordTy() { delete record_; }
 
-ArrayTy::~ArrayTy() { delete array_; }
+ArrayTy::~ArrayTy() = default;
 
 void SimpleVar::Print(FILE *out, int d) const {
   Indent(out, d);
@@ -11,6 +11,7 @@
 #include "tiger/frame/frame.h"
 #include "tiger/semant/types.h"
 #include "tiger/symbol/symbol.h"
+#include "tiger/util/arena.h"
 
 /**
  * Forward Declarations
@@ -80,7 +81,7 @@ private:
  * Variables
  */
 
-class Var {
+class Var : public arena::Object {
 public:
   int pos_;
   virtual ~Var() = default;
@@ -155,7 +156,7 @@ public:
  * Expressions
  */
 
-class Exp {
+class Exp : public arena::Object {
 public:
   int pos_;
   virtual ~Exp() = default;
@@ -447,7 +448,7 @@ public:
  * Declarations
  */
 
-class Dec {
+class Dec : public arena::Object {
 public:
   int pos_;
   virtual ~Dec() = default;
@@ -523,7 +524,7 @@ public:
  * Types
  */
 
-class Ty {
+class Ty : public arena::Object {
 public:
   int pos_;
   virtual ~Ty() = default;
@@ -586,7 +587,7 @@ public:
  * Linked lists and nodes of lists
  */
 
-class Field {
+class Field : public arena::Object {
 public:
   int pos_;
   sym::Symbol *name_, *typ_;
@@ -598,7 +599,7 @@ public:
   void Print(FILE *out, int d) const;
 };
 
-class FieldList {
+class FieldList : public arena::Object {
 public:
   FieldList() = default;
   explicit FieldList(Field *field) : field_list_({field}) { assert(field); }
@@ -611,7 +612,7 @@ public:
     field_list_.push_back(field);
     return this;
   }
-  [[nodiscard]] const std::list<Field *> &GetList() const {
+  [[nodiscard]] const arena::List<Field *> &GetList() const {
     return field_list_;
   }
   void Print(FILE *out, int d) const;
@@ -621,10 +622,10 @@ public:
                                  err::ErrorMsg *errormsg) const;
 
 private:
-  std::list<Field *> field_list_;
+  arena::List<Field *> field_list_;
 };
 
-class ExpList {
+class ExpList : public arena::Object {
 public:
   ExpList() = default;
   explicit ExpList(Exp *exp) : exp_list_({exp}) { assert(exp); }
@@ -637,14 +638,14 @@ public:
     exp_list_.push_back(exp);
     return this;
   }
-  [[nodiscard]] const std::list<Exp *> &GetList() const { return exp_list_; }
+  [[nodiscard]] const arena::List<Exp *> &GetList() const { return exp_list_; }
   void Print(FILE *out, int d) const;
 
 private:
-  std::list<Exp *> exp_list_;
+  arena::List<Exp *> exp_list_;
 };
 
-class FunDec {
+class FunDec : public arena::Object {
 public:
   int pos_;
   sym::Symbol *name_;
@@ -661,7 +662,7 @@ public:
   void Print(FILE *out, int d) const;
 };
 
-class FunDecList {
+class FunDecList : public arena::Object {
 public:
   explicit FunDecList(FunDec *fun_dec) : fun_dec_list_({fun_dec}) {
     assert(fun_dec);
@@ -675,16 +676,16 @@ public:
     fun_dec_list_.push_back(fun_dec);
     return this;
   }
-  [[nodiscard]] const std::list<FunDec *> &GetList() const {
+  [[nodiscard]] const arena::List<FunDec *> &GetList() const {
     return fun_dec_list_;
   }
   void Print(FILE *out, int d) const;
 
 private:
-  std::list<FunDec *> fun_dec_list_;
+  arena::List<FunDec *> fun_dec_list_;
 };
 
-class DecList {
+class DecList : public arena::Object {
 public:
   DecList() = default;
   explicit DecList(Dec *dec) : dec_list_({dec}) { assert(dec); }
@@ -697,14 +698,14 @@ public:
     dec_list_.push_back(dec);
     return this;
   }
-  [[nodiscard]] const std::list<Dec *> &GetList() const { return dec_list_; }
+  [[nodiscard]] const arena::List<Dec *> &GetList() const { return dec_list_; }
   void Print(FILE *out, int d) const;
 
 private:
-  std::list<Dec *> dec_list_;
+  arena::List<Dec *> dec_list_;
 };
 
-class NameAndTy {
+class NameAndTy : public arena::Object {
 public:
   sym::Symbol *name_;
   Ty *ty_;
@@ -714,7 +715,7 @@ public:
   void Print(FILE *out, int d) const;
 };
 
-class NameAndTyList {
+class NameAndTyList : public arena::Object {
 public:
   explicit NameAndTyList(NameAndTy *name_and_ty)
       : name_and_ty_list_({name_and_ty}) {}
@@ -723,16 +724,16 @@ public:
     name_and_ty_list_.push_front(name_and_ty);
     return this;
   }
-  [[nodiscard]] const std::list<NameAndTy *> &GetList() const {
+  [[nodiscard]] const arena::List<NameAndTy *> &GetList() const {
     return name_and_ty_list_;
   }
   void Print(FILE *out, int d) const;
 
 private:
-  std::list<NameAndTy *> name_and_ty_list_;
+  arena::List<NameAndTy *> name_and_ty_list_;
 };
 
-class EField {
+class EField : public arena::Object {
 public:
   sym::Symbol *name_;
   Exp *exp_;
@@ -747,7 +748,7 @@ public:
   void Print(FILE *out, int d) const;
 };
 
-class EFieldList {
+class EFieldList : public arena::Object {
 public:
   EFieldList() = default;
   explicit EFieldList(EField *efield) : efield_list_({efield}) {}
@@ -756,13 +757,13 @@ public:
     efield_list_.push_front(efield);
     return this;
   }
-  [[nodiscard]] const std::list<EField *> &GetList() const {
+  [[nodiscard]] const arena::List<EField *> &GetList() const {
     return efield_list_;
   }
   void Print(FILE *out, int d) const;
 
 private:
-  std::list<EField *> efield_list_;
+  arena::List<EField *> efield_list_;
 };
 
 }; // namespace absyn
@@ -43,6 +43,33 @@ bool Stm::Commute(tree::Stm *x, tree::Exp *y) {
 } // namespace tree
 namespace {
 
+/**
+ * Move the operands of "binop" that are not constants into fresh temps,
+ * recursing into nested arithmetic
+ * @return the moves, to run where "binop" used to be evaluated
+ */
+tree::Stm *SaveOperands(tree::BinopExp *binop) {
+  tree::Stm *save = new tree::ExpStm(new tree::ConstExp(0));
+  for (tree::Exp **operand : {&binop->left_, &binop->right_}) {
+    tree::Exp *exp = *operand;
+    if (typeid(*exp) == typeid(tree::ConstExp) ||
+        typeid(*exp) == typeid(tree::NameExp))
+      continue;
+    if (typeid(*exp) == typeid(tree::BinopExp)) {
+      save = tree::Stm::Seq(save,
+                            SaveOperands(static_cast<tree::BinopExp *>(exp)));
+      continue;
+    }
+    temp::Temp *t = temp::TempFactory::NewTemp();
+    if (tree::HoldsPointer(exp))
+      t->SetPointer();
+    save = tree::Stm::Seq(save,
+                          new tree::MoveStm(new tree::TempExp(t), exp));
+    *operand = new tree::TempExp(t);
+  }
+  return save;
+}
+
 struct ExpRefList {
   std::list<std::reference_wrapper<tree::Exp *>> refs;
 
@@ -54,8 +81,8 @@ struct ExpRefList {
     refs.push_back(exp1);
     refs.push_back(exp2);
   }
-  ExpRefList(tree::Exp *&head, std::list<tree::Exp *>::iterator begin,
-             std::list<tree::Exp *>::iterator end)
+  ExpRefList(tree::Exp *&head, arena::List<tree::Exp *>::iterator begin,
+             arena::List<tree::Exp *>::iterator end)
       : refs(begin, end) {
     refs.push_front(head);
   }
@@ -67,6 +94,8 @@ struct ExpRefList {
       tree::Exp *&ref = refs.front().get();
       if (typeid(*ref) == typeid(tree::CallExp)) {
         temp::Temp *t = temp::TempFactory::NewTemp();
+        if (tree::HoldsPointer(ref))
+          t->SetPointer();
         ref = new tree::EseqExp(new tree::MoveStm(new tree::TempExp(t), ref),
                                 new tree::TempExp(t));
         return Reorder();
@@ -77,8 +106,16 @@ struct ExpRefList {
         if (tree::Stm::Commute(s, hd.e_)) {
           ref = hd.e_;
           return tree::Stm::Seq(hd.s_, s);
+        } else if (tree::DerivesPointer(hd.e_)) {
+          // The collector may move the object while "s" runs, so keep the
+          // pointer itself and redo the arithmetic afterwards
+          tree::Stm *save = SaveOperands(static_cast<tree::BinopExp *>(hd.e_));
+          ref = hd.e_;
+          return tree::Stm::Seq(hd.s_, tree::Stm::Seq(save, s));
         } else {
           temp::Temp *t = temp::TempFactory::NewTemp();
+          if (tree::HoldsPointer(hd.e_))
+            t->SetPointer();
           ref = new tree::TempExp(t);
           return tree::Stm::Seq(
               hd.s_, tree::Stm::Seq(
@@ -102,7 +139,7 @@ ExpRefList *GetCallRlist(tree::Exp *exp) {
 
 namespace canon {
 
-void Canon::Trace(std::list<tree::Stm *> &stms) {
+void Canon::Trace(arena::List<tree::Stm *> &stms) {
   tree::Stm *last = stms.back();
 
   auto lab = dynamic_cast<tree::LabelStm *>(stms.front());
@@ -144,7 +181,7 @@ void Canon::Trace(std::list<tree::Stm *> &stms) {
     } else {
       temp::Label *falselabel = temp::LabelFactory::NewLabel();
       stms.pop_back();
-      std::list<tree::Stm *> tmp_stm_list = {
+      arena::List<tree::Stm *> tmp_stm_list = {
           new tree::CjumpStm(cjumpstm->op_, cjumpstm->left_, cjumpstm->right_,
                              cjumpstm->true_label_, falselabel),
           new tree::LabelStm(falselabel),
@@ -22,19 +22,19 @@ class ProcFrag;
 
 namespace canon {
 
-class StmListList {
+class StmListList : public arena::Object {
   friend class Canon;
 
 public:
   StmListList() = default;
 
   void Append(tree::StmList *stmlist) { stmlist_list_.push_back(stmlist); }
-  [[nodiscard]] const std::list<tree::StmList *> &GetList() const {
+  [[nodiscard]] const arena::List<tree::StmList *> &GetList() const {
     return stmlist_list_;
   }
 
 private:
-  std::list<tree::StmList *> stmlist_list_;
+  arena::List<tree::StmList *> stmlist_list_;
 };
 
 class Block {
@@ -149,7 +149,7 @@ private:
    */
   tree::StmList *GetNext();
 
-  void Trace(std::list<tree::Stm *> &stms);
+  void Trace(arena::List<tree::Stm *> &stms);
 };
 
 } // namespace canon
@@ -9,14 +9,14 @@
 
 namespace assem {
 
-class Targets {
+class Targets : public arena::Object {
 public:
   std::vector<temp::Label *> *labels_;
 
   explicit Targets(std::vector<temp::Label *> *labels) : labels_(labels) {}
 };
 
-class Instr {
+class Instr : public arena::Object {
 public:
   enum Kind { OPER, LABEL, MOVE };
   Kind kind_;
@@ -70,7 +70,7 @@ public:
   [[nodiscard]] temp::TempList *Use() const override;
 };
 
-class InstrList {
+class InstrList : public arena::Object {
 public:
   InstrList() = default;
   InstrList(std::initializer_list<Instr*> list_) : instr_list_(list_) {};
@@ -79,18 +79,18 @@ public:
   void Print(FILE *out, temp::Map *m) const;
   void Append(assem::Instr *instr) { instr_list_.push_back(instr); }
   void Remove(assem::Instr *instr) { instr_list_.remove(instr); }
-  void Insert(std::list<Instr *>::const_iterator pos, assem::Instr *instr) {
+  void Insert(arena::List<Instr *>::const_iterator pos, assem::Instr *instr) {
     instr_list_.insert(pos, instr);
   }
-  [[nodiscard]] const std::list<Instr *> &GetList() const {
+  [[nodiscard]] const arena::List<Instr *> &GetList() const {
     return instr_list_;
   }
 
 private:
-  std::list<Instr *> instr_list_;
+  arena::List<Instr *> instr_list_;
 };
 
-class Proc {
+class Proc : public arena::Object {
 public:
   std::string prolog_;
   InstrList *body_;
@@ -9,6 +9,351 @@ namespace {
 
 constexpr int maxlen = 1024;
 
+/**
+ * An x86-64 memory operand, symbol+offset(base, index, scale), where the
+ * symbol is a label addressed relative to %rip or the frame size label
+ */
+struct Address {
+  std::string symbol;
+  long offset = 0;
+  bool rip = false;
+  temp::Temp *base = nullptr;
+  temp::Temp *index = nullptr;
+  int scale = 1;
+
+  bool HasRegs() const { return base || index; }
+
+  // The operand, naming its registers `s<first> on in the order of Sources
+  std::string Format(int first) const {
+    std::string disp = symbol;
+    if (offset || symbol.empty())
+      disp += (offset >= 0 && !symbol.empty() ? "+" : "") +
+              std::to_string(offset);
+    if (rip)
+      return disp + "(%rip)";
+    if (!HasRegs())
+      return disp;
+    if (disp == "0")
+      disp = "";
+    std::string res = disp + "(";
+    if (base)
+      res += "`s" + std::to_string(first++);
+    if (index)
+      res += ",`s" + std::to_string(first) + "," + std::to_string(scale);
+    return res + ")";
+  }
+
+  void Sources(temp::TempList *srcs) const {
+    if (base)
+      srcs->Append(base);
+    if (index)
+      srcs->Append(index);
+  }
+};
+
+// The log2 of the scale of "exp" if it is an index times 1, 2, 4 or 8
+int ScaleOf(tree::Exp *exp) {
+  if (exp->kind_ != tree::Exp::BINOP)
+    return -1;
+  auto binop = static_cast<tree::BinopExp *>(exp);
+  if (binop->right_->kind_ != tree::Exp::CONST)
+    return -1;
+  int c = static_cast<tree::ConstExp *>(binop->right_)->consti_;
+  if (binop->op_ == tree::LSHIFT_OP && c >= 0 && c <= 3)
+    return c;
+  if (binop->op_ == tree::MUL_OP && (c == 1 || c == 2 || c == 4 || c == 8))
+    return c == 1 ? 0 : c == 2 ? 1 : c == 4 ? 2 : 3;
+  return -1;
+}
+
+// A %rip operand has no room for registers: move its label into the base
+void LeaveRip(Address &addr, assem::InstrList &instr_list) {
+  if (!addr.rip)
+    return;
+  temp::Temp *label = temp::TempFactory::NewTemp();
+  instr_list.Append(new assem::OperInstr(
+      "leaq " + addr.symbol + "(%rip), `d0", new temp::TempList(label),
+      nullptr, nullptr));
+  addr.rip = false;
+  addr.symbol.clear();
+  addr.base = label;
+}
+
+// Add the value of "term" to "addr"
+void AddRegister(Address &addr, temp::Temp *term,
+                 assem::InstrList &instr_list) {
+  LeaveRip(addr, instr_list);
+  if (!addr.base) {
+    addr.base = term;
+  } else if (!addr.index) {
+    addr.index = term;
+    addr.scale = 1;
+  } else {
+    // Out of registers in the operand: add this term into the base
+    temp::Temp *sum = temp::TempFactory::NewTemp();
+    instr_list.Append(new assem::OperInstr(
+        "leaq (`s0,`s1), `d0", new temp::TempList(sum),
+        new temp::TempList({addr.base, term}), nullptr));
+    addr.base = sum;
+  }
+}
+
+// Add "exp" to "addr", folding whatever the operand can express
+void AddTerm(Address &addr, tree::Exp *exp, assem::InstrList &instr_list,
+             std::string_view fs) {
+  // Displacements are 32 bits
+  auto fits = [&addr](long offset) {
+    offset += addr.offset;
+    return offset >= INT32_MIN && offset <= INT32_MAX;
+  };
+  if (exp->kind_ == tree::Exp::CONST &&
+      fits(static_cast<tree::ConstExp *>(exp)->consti_)) {
+    addr.offset += static_cast<tree::ConstExp *>(exp)->consti_;
+    return;
+  }
+  if (exp->kind_ == tree::Exp::BINOP) {
+    auto binop = static_cast<tree::BinopExp *>(exp);
+    if (binop->op_ == tree::PLUS_OP) {
+      AddTerm(addr, binop->left_, instr_list, fs);
+      AddTerm(addr, binop->right_, instr_list, fs);
+      return;
+    }
+    if (binop->op_ == tree::MINUS_OP &&
+        binop->right_->kind_ == tree::Exp::CONST) {
+      long c = static_cast<tree::ConstExp *>(binop->right_)->consti_;
+      // Only the whole displacement tells whether the constant fits
+      AddTerm(addr, binop->left_, instr_list, fs);
+      if (fits(-c)) {
+        addr.offset -= c;
+        return;
+      }
+      temp::Temp *negated = binop->right_->Munch(instr_list, fs);
+      instr_list.Append(new assem::OperInstr(
+          "negq `d0", new temp::TempList(negated),
+          new temp::TempList(negated), nullptr));
+      AddRegister(addr, negated, instr_list);
+      return;
+    }
+  }
+  // The frame pointer is %rsp plus the frame size
+  if (exp->kind_ == tree::Exp::TEMP &&
+      static_cast<tree::TempExp *>(exp)->temp_ ==
+          reg_manager->FramePointer() &&
+      !addr.base && addr.symbol.empty()) {
+    addr.base = reg_manager->StackPointer();
+    addr.symbol = std::string(fs) + "_framesize";
+    return;
+  }
+  if (exp->kind_ == tree::Exp::NAME && !addr.HasRegs() &&
+      addr.symbol.empty()) {
+    addr.rip = true;
+    addr.symbol = temp::LabelFactory::LabelString(
+        static_cast<tree::NameExp *>(exp)->name_);
+    return;
+  }
+
+  // Anything else takes a register
+  int scale = ScaleOf(exp);
+  if (scale >= 0 && !addr.index) {
+    LeaveRip(addr, instr_list);
+    addr.index = static_cast<tree::BinopExp *>(exp)->left_->Munch(instr_list, fs);
+    addr.scale = 1 << scale;
+  } else {
+    AddRegister(addr, exp->Munch(instr_list, fs), instr_list);
+  }
+}
+
+/**
+ * Munch the address "exp" into a memory operand, folding constant offsets,
+ * the frame pointer, labels and scaled indices into it
+ */
+Address MunchAddress(tree::Exp *exp, assem::InstrList &instr_list,
+                     std::string_view fs) {
+  Address addr;
+  AddTerm(addr, exp, instr_list, fs);
+  return addr;
+}
+
+std::string Imm(tree::Exp *exp) {
+  return "$" + std::to_string(static_cast<tree::ConstExp *>(exp)->consti_);
+}
+
+// The condition code of "op"
+std::string Condition(tree::RelOp op) {
+  switch (op) {
+  case tree::EQ_OP: return "e";
+  case tree::NE_OP: return "ne";
+  case tree::LT_OP: return "l";
+  case tree::GT_OP: return "g";
+  case tree::LE_OP: return "le";
+  case tree::GE_OP: return "ge";
+  case tree::ULT_OP: return "b";
+  case tree::ULE_OP: return "be";
+  case tree::UGT_OP: return "a";
+  case tree::UGE_OP: return "ae";
+  default: assert(0); return "";
+  }
+}
+
+void Emit(assem::InstrList &instr_list, std::string assem, temp::Temp *dst,
+          temp::TempList *srcs) {
+  instr_list.Append(new assem::OperInstr(std::move(assem),
+                                         new temp::TempList(dst), srcs,
+                                         nullptr));
+}
+
+// "dst" = "x", then "op dst" in place
+void Unary(assem::InstrList &instr_list, const std::string &op,
+           temp::Temp *x, temp::Temp *dst) {
+  if (x != dst)
+    instr_list.Append(new assem::MoveInstr("movq `s0, `d0",
+                                           new temp::TempList(dst),
+                                           new temp::TempList(x)));
+  Emit(instr_list, op + " `d0", dst, new temp::TempList(dst));
+}
+
+int Log2(uint64_t c) {
+  int k = 0;
+  while ((uint64_t(1) << k) < c)
+    k++;
+  return (uint64_t(1) << k) == c ? k : -1;
+}
+
+/**
+ * "dst" = "x" * "c" by shifts and leaq where at most two of them do, and by
+ * the three-operand imulq otherwise
+ */
+void MultiplyBy(assem::InstrList &instr_list, temp::Temp *x, long c,
+                temp::Temp *dst) {
+  uint64_t abs = c < 0 ? -uint64_t(c) : c;
+  int shift = Log2(abs);
+  // abs = 2^shift or abs = factor * 2^shift for a leaq factor 3, 5 or 9
+  int factor = 1;
+  for (int f : {3, 5, 9}) {
+    if (shift < 0 && abs % f == 0 && Log2(abs / f) >= 0) {
+      factor = f;
+      shift = Log2(abs / f);
+    }
+  }
+  if (c == 0 || shift < 0 || (c < 0 && factor > 1 && shift > 0)) {
+    Emit(instr_list, "imulq $" + std::to_string(c) + ", `s0, `d0", dst,
+         new temp::TempList(x));
+    return;
+  }
+  if (factor > 1) {
+    Emit(instr_list,
+         "leaq (`s0,`s0," + std::to_string(factor - 1) + "), `d0", dst,
+         new temp::TempList(x));
+    x = dst;
+  }
+  if (shift > 0)
+    Unary(instr_list, "shlq $" + std::to_string(shift) + ",", x, dst);
+  else if (x != dst)
+    instr_list.Append(new assem::MoveInstr("movq `s0, `d0",
+                                           new temp::TempList(dst),
+                                           new temp::TempList(x)));
+  if (c < 0)
+    Unary(instr_list, "negq", dst, dst);
+}
+
+/**
+ * The magic number and shift of signed 64-bit division by "d", which is
+ * neither 0 nor a power of two in absolute value (Hacker's Delight 10-1):
+ * x / d is the high word of x * magic, shifted right, plus one if negative
+ */
+void MagicOf(long d, long *magic, int *shift) {
+  const uint64_t two63 = uint64_t(1) << 63;
+  uint64_t ad = d < 0 ? -uint64_t(d) : d;
+  uint64_t t = two63 + (uint64_t(d) >> 63);
+  uint64_t anc = t - 1 - t % ad;
+  int p = 63;
+  uint64_t q1 = two63 / anc, r1 = two63 - q1 * anc;
+  uint64_t q2 = two63 / ad, r2 = two63 - q2 * ad;
+  uint64_t delta;
+  do {
+    p++;
+    q1 *= 2;
+    r1 *= 2;
+    if (r1 >= anc) {
+      q1++;
+      r1 -= anc;
+    }
+    q2 *= 2;
+    r2 *= 2;
+    if (r2 >= ad) {
+      q2++;
+      r2 -= ad;
+    }
+    delta = ad - r2;
+  } while (q1 < delta || (q1 == delta && r1 == 0));
+  *magic = d < 0 ? -(q2 + 1) : q2 + 1;
+  *shift = p - 64;
+}
+
+/**
+ * "dst" = "x" / "c", rounding toward zero like idivq, by shifts for powers
+ * of two and by a multiply with the magic number otherwise. Division by
+ * zero still goes to idivq to trap.
+ */
+bool DivideBy(assem::InstrList &instr_list, temp::Temp *x, long c,
+              temp::Temp *dst) {
+  if (c == 0)
+    return false;
+  if (c == 1 || c == -1) {
+    instr_list.Append(new assem::MoveInstr("movq `s0, `d0",
+                                           new temp::TempList(dst),
+                                           new temp::TempList(x)));
+    if (c == -1)
+      Unary(instr_list, "negq", dst, dst);
+    return true;
+  }
+
+  uint64_t abs = c < 0 ? -uint64_t(c) : c;
+  int k = Log2(abs);
+  if (k > 0) {
+    // Add 2^k - 1 to negative dividends before the arithmetic shift
+    temp::Temp *bias = temp::TempFactory::NewTemp();
+    Unary(instr_list, "sarq $63,", x, bias);
+    Emit(instr_list, "shrq $" + std::to_string(64 - k) + ", `d0", bias,
+         new temp::TempList(bias));
+    Emit(instr_list, "leaq (`s0,`s1), `d0", dst,
+         new temp::TempList({x, bias}));
+    Emit(instr_list, "sarq $" + std::to_string(k) + ", `d0", dst,
+         new temp::TempList(dst));
+    if (c < 0)
+      Unary(instr_list, "negq", dst, dst);
+    return true;
+  }
+
+  long magic;
+  int shift;
+  MagicOf(c, &magic, &shift);
+  temp::Temp *rax = reg_manager->RAX();
+  temp::Temp *rdx = reg_manager->RDX();
+  temp::Temp *m = temp::TempFactory::NewTemp();
+  Emit(instr_list, "movabsq $" + std::to_string(magic) + ", `d0", m, nullptr);
+  instr_list.Append(new assem::MoveInstr("movq `s0, `d0",
+                                         new temp::TempList(rax),
+                                         new temp::TempList(x)));
+  instr_list.Append(new assem::OperInstr(
+      "imulq `s0", new temp::TempList({rax, rdx}),
+      new temp::TempList({m, rax}), nullptr));
+  instr_list.Append(new assem::MoveInstr("movq `s0, `d0",
+                                         new temp::TempList(dst),
+                                         new temp::TempList(rdx)));
+  // The magic number wrapped around its sign: correct the product
+  if (c > 0 && magic < 0)
+    Emit(instr_list, "addq `s0, `d0", dst, new temp::TempList({x, dst}));
+  else if (c < 0 && magic > 0)
+    Emit(instr_list, "subq `s0, `d0", dst, new temp::TempList({x, dst}));
+  if (shift > 0)
+    Emit(instr_list, "sarq $" + std::to_string(shift) + ", `d0", dst,
+         new temp::TempList(dst));
+  temp::Temp *sign = temp::TempFactory::NewTemp();
+  Unary(instr_list, "shrq $63,", dst, sign);
+  Emit(instr_list, "addq `s0, `d0", dst, new temp::TempList({sign, dst}));
+  return true;
+}
 
 } // namespace
 
@@ -26,6 +371,7 @@ void CodeGen::PopReg(assem::InstrList &instr_list, temp::Temp *pos, temp::Temp *
 }
 
 void CodeGen::SaveCalleeRegs(assem::InstrList &instr_list, std::string_view fs) {
+  frame_->callee_save_offset_ = frame_->s_offset_;
   auto new_temp = reg_manager->RAX();
   instr_list.Append(new assem::OperInstr("leaq " + frame_->label_->Name() + "_framesize(%rsp), `d0", new temp::TempList(new_temp), nullptr, nullptr));
   instr_list.Append(new assem::OperInstr("addq $" + std::to_string(frame_->s_offset_) + ", `d0", new temp::TempList(new_temp), nullptr, nullptr));
@@ -92,50 +438,78 @@ void JumpStm::Munch(assem::InstrList &instr_list, std::string_view fs) {
 }
 
 void CjumpStm::Munch(assem::InstrList &instr_list, std::string_view fs) {
-  auto left = left_->Munch(instr_list, fs);
-  auto right = right_->Munch(instr_list, fs);
-  auto tempList = new temp::TempList();
-  tempList->Append(left);
-  tempList->Append(right);
-
-  std::string str = "";
-  switch(op_){
-    case EQ_OP: 
-      str = std::string("je ");  
-      break;
-    case NE_OP: 
-      str = std::string("jne "); 
-      break;
-    case LT_OP: 
-      str = std::string("jl ");  
-      break;
-    case GT_OP: 
-      str = std::string("jg ");  
-      break;
-    case LE_OP: 
-      str = std::string("jle "); 
-      break;
-    case GE_OP: 
-      str = std::string("jge "); 
-      break;
+  RelOp op = op_;
+  Exp *left_exp = left_;
+  Exp *right_exp = right_;
+  // Immediates can only be the first operand of cmpq
+  if (left_exp->kind_ == Exp::CONST && right_exp->kind_ != Exp::CONST) {
+    std::swap(left_exp, right_exp);
+    op = tree::Commute(op);
+  }
+
+  // cmpq right, left sets the flags of left - right
+  auto srcs = new temp::TempList();
+  std::string assem;
+  if (left_exp->kind_ == Exp::MEM &&
+      (right_exp->kind_ == Exp::CONST || right_exp->kind_ == Exp::TEMP)) {
+    std::string right;
+    if (right_exp->kind_ == Exp::CONST) {
+      right = Imm(right_exp);
+    } else {
+      srcs->Append(right_exp->Munch(instr_list, fs));
+      right = "`s0";
+    }
+    Address addr = MunchAddress(((MemExp *)left_exp)->exp_, instr_list, fs);
+    addr.Sources(srcs);
+    assem = "cmpq " + right + ", " +
+            addr.Format(right_exp->kind_ == Exp::CONST ? 0 : 1);
+  } else {
+    srcs->Append(left_exp->Munch(instr_list, fs));
+    if (right_exp->kind_ == Exp::CONST) {
+      assem = "cmpq " + Imm(right_exp) + ", `s0";
+    } else if (right_exp->kind_ == Exp::MEM) {
+      Address addr = MunchAddress(((MemExp *)right_exp)->exp_, instr_list, fs);
+      addr.Sources(srcs);
+      assem = "cmpq " + addr.Format(1) + ", `s0";
+    } else {
+      srcs->Append(right_exp->Munch(instr_list, fs));
+      assem = "cmpq `s1, `s0";
+    }
   }
+  instr_list.Append(new assem::OperInstr(assem, nullptr, srcs, nullptr));
 
   auto labelList = new std::vector<temp::Label *>();
   labelList->push_back(true_label_);
-  instr_list.Append(new assem::OperInstr("cmpq `s0, `s1", nullptr, new temp::TempList({right, left}), nullptr));
-  instr_list.Append(new assem::OperInstr(str + "`j0", nullptr, nullptr, new assem::Targets(labelList)));
+  instr_list.Append(new assem::OperInstr("j" + Condition(op) + " `j0", nullptr, nullptr, new assem::Targets(labelList)));
 }
 
 void MoveStm::Munch(assem::InstrList &instr_list, std::string_view fs) {
   if (dst_->kind_ == Exp::TEMP) {
-    auto src = src_->Munch(instr_list, fs);
     auto dst = ((TempExp*) dst_)->temp_;
-    instr_list.Append(new assem::MoveInstr("movq `s0, `d0", new temp::TempList(dst), new temp::TempList(src)));
+    if (src_->kind_ == Exp::MEM) {
+      auto srcs = new temp::TempList();
+      Address addr = MunchAddress(((MemExp *)src_)->exp_, instr_list, fs);
+      addr.Sources(srcs);
+      instr_list.Append(new assem::OperInstr("movq " + addr.Format(0) + ", `d0", new temp::TempList(dst), srcs, nullptr));
+    } else if (src_->kind_ == Exp::CONST) {
+      instr_list.Append(new assem::OperInstr("movq " + Imm(src_) + ", `d0", new temp::TempList(dst), nullptr, nullptr));
+    } else {
+      auto src = src_->Munch(instr_list, fs);
+      instr_list.Append(new assem::MoveInstr("movq `s0, `d0", new temp::TempList(dst), new temp::TempList(src)));
+    }
   }
   else if(dst_->kind_ == Exp::MEM) {
-    auto left = src_->Munch(instr_list, fs);
-    auto right = ((MemExp *)dst_)->exp_->Munch(instr_list, fs);
-    instr_list.Append(new assem::OperInstr("movq `s0, (`s1)", nullptr, new temp::TempList({left, right}), nullptr));
+    auto srcs = new temp::TempList();
+    std::string value;
+    if (src_->kind_ == Exp::CONST) {
+      value = Imm(src_);
+    } else {
+      srcs->Append(src_->Munch(instr_list, fs));
+      value = "`s0";
+    }
+    Address addr = MunchAddress(((MemExp *)dst_)->exp_, instr_list, fs);
+    addr.Sources(srcs);
+    instr_list.Append(new assem::OperInstr("movq " + value + ", " + addr.Format(src_->kind_ == Exp::CONST ? 0 : 1), nullptr, srcs, nullptr));
   }
 }
 
@@ -151,36 +525,67 @@ temp::Temp *BinopExp::Munch(assem::InstrList &instr_list, std::string_view fs) {
   temp::Label *label_false = temp::LabelFactory::NewLabel();
   temp::Label *label_end = temp::LabelFactory::NewLabel();
   switch (op_){
-    case PLUS_OP: case OR_OP:
-      left = left_->Munch(instr_list, fs);
-      right = right_->Munch(instr_list, fs);
-      instr_list.Append(new assem::MoveInstr("movq `s0, `d0", new temp::TempList(new_reg), new temp::TempList(left)));
-      instr_list.Append(new assem::OperInstr("addq `s0, `d0", new temp::TempList(new_reg), new temp::TempList(right), nullptr));
+    case PLUS_OP: {
+      // One leaq computes any sum an address can express
+      auto srcs = new temp::TempList();
+      Address addr = MunchAddress(this, instr_list, fs);
+      addr.Sources(srcs);
+      instr_list.Append(new assem::OperInstr("leaq " + addr.Format(0) + ", `d0", new temp::TempList(new_reg), srcs, nullptr));
       break;
+    }
 
     case MINUS_OP:
-      left = left_->Munch(instr_list, fs);
-      right = right_->Munch(instr_list, fs);
-      instr_list.Append(new assem::MoveInstr("movq `s0, `d0", new temp::TempList(new_reg), new temp::TempList(left)));
-      instr_list.Append(new assem::OperInstr("subq `s0, `d0", new temp::TempList(new_reg), new temp::TempList(right), nullptr));
+      if (right_->kind_ == CONST && ((ConstExp *)right_)->consti_ != INT32_MIN) {
+        auto srcs = new temp::TempList();
+        Address addr = MunchAddress(this, instr_list, fs);
+        addr.Sources(srcs);
+        instr_list.Append(new assem::OperInstr("leaq " + addr.Format(0) + ", `d0", new temp::TempList(new_reg), srcs, nullptr));
+        break;
+      }
+      MunchOperand("subq", new_reg, instr_list, fs);
       break;
 
-    case MUL_OP: case AND_OP:
-      left = left_->Munch(instr_list, fs);
-      right = right_->Munch(instr_list, fs);
-      instr_list.Append(new assem::MoveInstr("movq `s0, `d0", new temp::TempList(reg_manager->RAX()), new temp::TempList(left)));
-      instr_list.Append(new assem::OperInstr("imulq `s0", new temp::TempList({reg_manager->RAX(), reg_manager->RDX()}), new temp::TempList(right), nullptr));
-      instr_list.Append(new assem::MoveInstr("movq `s0, `d0", new temp::TempList(new_reg), new temp::TempList(reg_manager->RAX())));
+    case MUL_OP:
+      if (right_->kind_ == CONST || left_->kind_ == CONST) {
+        Exp *factor = right_->kind_ == CONST ? right_ : left_;
+        left = (factor == right_ ? left_ : right_)->Munch(instr_list, fs);
+        MultiplyBy(instr_list, left, ((ConstExp *)factor)->consti_, new_reg);
+        break;
+      }
+      MunchOperand("imulq", new_reg, instr_list, fs);
       break;
 
     case DIV_OP:
       left = left_->Munch(instr_list, fs);
+      if (right_->kind_ == CONST &&
+          DivideBy(instr_list, left, ((ConstExp *)right_)->consti_, new_reg))
+        break;
       right = right_->Munch(instr_list, fs);
       instr_list.Append(new assem::MoveInstr("movq `s0, `d0", new temp::TempList(reg_manager->RAX()), new temp::TempList(left)));
       instr_list.Append(new assem::OperInstr("cqto", new temp::TempList(reg_manager->RDX()), new temp::TempList(reg_manager->RAX()), nullptr));
-      instr_list.Append(new assem::OperInstr("idivq `s0", new temp::TempList({reg_manager->RAX(), reg_manager->RDX()}), new temp::TempList(right), nullptr));
+      instr_list.Append(new assem::OperInstr("idivq `s0", new temp::TempList({reg_manager->RAX(), reg_manager->RDX()}), new temp::TempList({right, reg_manager->RAX(), reg_manager->RDX()}), nullptr));
       instr_list.Append(new assem::MoveInstr("movq `s0, `d0", new temp::TempList(new_reg), new temp::TempList(reg_manager->RAX())));
       break;
+
+    case AND_OP: case OR_OP: case XOR_OP:
+      MunchOperand(op_ == AND_OP ? "andq" : op_ == OR_OP ? "orq" : "xorq", new_reg, instr_list, fs);
+      break;
+
+    case LSHIFT_OP: case RSHIFT_OP: case ARSHIFT_OP: {
+      std::string shift = op_ == LSHIFT_OP ? "shlq " : op_ == RSHIFT_OP ? "shrq " : "sarq ";
+      left = left_->Munch(instr_list, fs);
+      instr_list.Append(new assem::MoveInstr("movq `s0, `d0", new temp::TempList(new_reg), new temp::TempList(left)));
+      if (right_->kind_ == CONST) {
+        shift += "$" + std::to_string(((ConstExp *)right_)->consti_) + ", `d0";
+        instr_list.Append(new assem::OperInstr(shift, new temp::TempList(new_reg), new temp::TempList(new_reg), nullptr));
+      } else {
+        // A variable shift count has to be in %cl
+        right = right_->Munch(instr_list, fs);
+        instr_list.Append(new assem::MoveInstr("movq `s0, `d0", new temp::TempList(reg_manager->RCX()), new temp::TempList(right)));
+        instr_list.Append(new assem::OperInstr(shift + "%cl, `d0", new temp::TempList(new_reg), new temp::TempList({reg_manager->RCX(), new_reg}), nullptr));
+      }
+      break;
+    }
     // case AND_OP:
     //   left = left_->Munch(instr_list, fs);
     //   right = right_->Munch(instr_list, fs);
@@ -215,10 +620,31 @@ temp::Temp *BinopExp::Munch(assem::InstrList &instr_list, std::string_view fs) {
   return new_reg;
 }
 
+void BinopExp::MunchOperand(std::string_view op, temp::Temp *dst, assem::InstrList &instr_list, std::string_view fs) {
+  auto left = left_->Munch(instr_list, fs);
+  std::string src;
+  auto srcs = new temp::TempList();
+  if (right_->kind_ == CONST) {
+    src = Imm(right_);
+  } else if (right_->kind_ == MEM) {
+    Address addr = MunchAddress(((MemExp *)right_)->exp_, instr_list, fs);
+    addr.Sources(srcs);
+    src = addr.Format(0);
+  } else {
+    srcs->Append(right_->Munch(instr_list, fs));
+    src = "`s0";
+  }
+  srcs->Append(dst);
+  instr_list.Append(new assem::MoveInstr("movq `s0, `d0", new temp::TempList(dst), new temp::TempList(left)));
+  instr_list.Append(new assem::OperInstr(std::string(op) + " " + src + ", `d0", new temp::TempList(dst), srcs, nullptr));
+}
+
 temp::Temp *MemExp::Munch(assem::InstrList &instr_list, std::string_view fs) {
   temp::Temp *new_reg = temp::TempFactory::NewTemp();
-  auto res = exp_->Munch(instr_list, fs);
-  instr_list.Append(new assem::OperInstr("movq (`s0), `d0", new temp::TempList(new_reg), new temp::TempList(res), nullptr));
+  auto srcs = new temp::TempList();
+  Address addr = MunchAddress(exp_, instr_list, fs);
+  addr.Sources(srcs);
+  instr_list.Append(new assem::OperInstr("movq " + addr.Format(0) + ", `d0", new temp::TempList(new_reg), srcs, nullptr));
   return new_reg;
 }
 
@@ -57,6 +57,13 @@ void ProgSem::FillBaseVEnv() {
   venv_->Enter(sym::Symbol::UniqueSymbol("substring"),
                new env::FunEntry(formals, result));
 
+  // Heap statistics reported by the runtime's collector
+  result = type::IntTy::Instance();
+  venv_->Enter(sym::Symbol::UniqueSymbol("Used"),
+               new env::FunEntry(new type::TyList(), result));
+  venv_->Enter(sym::Symbol::UniqueSymbol("MaxFree"),
+               new env::FunEntry(new type::TyList(), result));
+
 }
 
 } // namespace sem
@@ -122,6 +129,13 @@ void ProgTr::FillBaseVEnv() {
   venv_->Enter(sym::Symbol::UniqueSymbol("substring"),
                new env::FunEntry(level, label, formals, result));
 
+  // Heap statistics reported by the runtime's collector
+  result = type::IntTy::Instance();
+  venv_->Enter(sym::Symbol::UniqueSymbol("Used"),
+               new env::FunEntry(level, label, new type::TyList(), result));
+  venv_->Enter(sym::Symbol::UniqueSymbol("MaxFree"),
+               new env::FunEntry(level, label, new type::TyList(), result));
+
 }
 
 } // namespace tr
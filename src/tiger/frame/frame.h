@@ -1,9 +1,12 @@
 #ifndef TIGER_FRAME_FRAME_H_
 #define TIGER_FRAME_FRAME_H_
 
+#include <cstdint>
 #include <list>
+#include <map>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "tiger/frame/temp.h"
 #include "tiger/translate/tree.h"
@@ -122,8 +125,16 @@ public:
   temp::Label* label_;
   AccessList* formals_;
   int s_offset_;
+  // Offset of the area where the prologue saves callee-saved registers
+  int callee_save_offset_ = 0;
+  // Offsets of the escaping variables that hold heap pointers
+  std::vector<int> pointer_slots_;
 
-  virtual Access *AllocLocal(bool escape) = 0;
+  /**
+   * @param escape whether the variable must live in memory
+   * @param pointer whether it holds a heap pointer, for the collector
+   */
+  virtual Access *AllocLocal(bool escape, bool pointer) = 0;
 
   virtual tree::Stm *ProcEntryExit1(tree::Stm *body) = 0;
   virtual assem::InstrList *ProcEntryExit2(assem::InstrList *body) = 0;
@@ -141,7 +152,7 @@ public:
   virtual ~Frag() = default;
 
 public:
-  enum Kind { STRING, PROC };
+  enum Kind { STRING, PROC, DESCRIPTORS };
   
   Kind kind_;
 
@@ -180,6 +191,42 @@ public:
   void OutputAssem(FILE *out, OutputPhase phase, bool need_ra) const override;
 };
 
+/**
+ * Descriptors of the records the program allocates, emitted as the words of
+ * GLOBAL_GC_DESCRIPTORS: each is its number of fields followed by a bitmap
+ * of its pointer fields, one word per 64 fields
+ */
+class DescriptorsFrag : public Frag {
+public:
+  DescriptorsFrag() : Frag(DESCRIPTORS) {}
+
+  /**
+   * Word index of the descriptor of records whose "i"th field is a pointer
+   * where pointers[i] is set
+   */
+  int Add(const std::vector<bool> &pointers) {
+    auto it = indices_.find(pointers);
+    if (it != indices_.end())
+      return it->second;
+    int index = words_.size();
+    words_.push_back(pointers.size());
+    for (std::size_t i = 0; i < pointers.size(); i++) {
+      if (i % 64 == 0)
+        words_.push_back(0);
+      if (pointers[i])
+        words_.back() |= uint64_t(1) << (i % 64);
+    }
+    indices_.emplace(pointers, index);
+    return index;
+  }
+
+  void OutputAssem(FILE *out, OutputPhase phase, bool need_ra) const override;
+
+private:
+  std::vector<uint64_t> words_;
+  std::map<std::vector<bool>, int> indices_;
+};
+
 class Frags {
 public:
   Frags() = default;
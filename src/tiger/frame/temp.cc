@@ -2,19 +2,28 @@
 
 #include <cstdio>
 #include <set>
-#include <sstream>
 
 namespace temp {
 
 LabelFactory LabelFactory::label_factory;
 TempFactory TempFactory::temp_factory;
+thread_local LabelFactory::Scope *LabelFactory::scope_ = nullptr;
 
 Label *LabelFactory::NewLabel() {
+  if (scope_)
+    return NamedLabel(scope_->prefix_ + std::to_string(scope_->label_id_++));
   char buf[100];
   sprintf(buf, "L%d", label_factory.label_id_++);
   return NamedLabel(std::string(buf));
 }
 
+LabelFactory::Scope::Scope(std::string prefix)
+    : prefix_(std::move(prefix)), outer_(scope_) {
+  scope_ = this;
+}
+
+LabelFactory::Scope::~Scope() { scope_ = outer_; }
+
 /**
  * Get symbol of a label_. The label_ will be created only if it is not found.
  * @param s label_ string
@@ -27,13 +36,8 @@ Label *LabelFactory::NamedLabel(std::string_view s) {
 std::string LabelFactory::LabelString(Label *s) { return s->Name(); }
 
 Temp *TempFactory::NewTemp() {
-  Temp *p = new Temp(temp_factory.temp_id_++);
-  std::stringstream stream;
-  stream << 't';
-  stream << p->num_;
-  Map::Name()->Enter(p, new std::string(stream.str()));
-
-  return p;
+  // The name lives in the temp itself, so no shared table is written here
+  return new Temp(temp_factory.temp_id_++);
 }
 
 int Temp::Int() const { return num_; }
@@ -41,9 +45,8 @@ int Temp::Int() const { return num_; }
 Map *Map::Empty() { return new Map(); }
 
 Map *Map::Name() {
-  static Map *m = nullptr;
-  if (!m)
-    m = Empty();
+  // A map without a table names every temp after its number
+  static Map *m = new Map(nullptr, nullptr);
   return m;
 }
 
@@ -61,7 +64,8 @@ void Map::Enter(Temp *t, std::string *s) {
 
 std::string *Map::Look(Temp *t) {
   std::string *s;
-  assert(tab_);
+  if (!tab_)
+    return &t->name_;
   s = tab_->Look(t);
   if (s)
     return s;
@@ -72,6 +76,10 @@ std::string *Map::Look(Temp *t) {
 }
 
 void Map::DumpMap(FILE *out) {
+  if (!tab_) {
+    fprintf(out, "tN -> tN\n");
+    return;
+  }
   tab_->Dump([out](temp::Temp *t, std::string *r) {
     fprintf(out, "t%d -> %s\n", t->Int(), r->data());
   });
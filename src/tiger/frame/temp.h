@@ -2,8 +2,11 @@
 #define TIGER_FRAME_TEMP_H_
 
 #include "tiger/symbol/symbol.h"
+#include "tiger/util/arena.h"
 
+#include <atomic>
 #include <list>
+#include <string>
 
 namespace temp {
 
@@ -15,28 +18,56 @@ public:
   static Label *NamedLabel(std::string_view name);
   static std::string LabelString(Label *s);
 
+  /**
+   * While alive, labels made by NewLabel on this thread are named "prefix"
+   * followed by a count from zero, so their names do not depend on what
+   * other threads are doing
+   */
+  class Scope {
+  public:
+    explicit Scope(std::string prefix);
+    ~Scope();
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+  private:
+    friend class LabelFactory;
+    std::string prefix_;
+    int label_id_ = 0;
+    Scope *outer_;
+  };
+
 private:
-  int label_id_ = 0;
+  std::atomic<int> label_id_{0};
   static LabelFactory label_factory;
+  static thread_local Scope *scope_;
 };
 
 class Temp {
   friend class TempFactory;
+  friend class Map;
 
 public:
   [[nodiscard]] int Int() const;
+  // Whether the temp may hold a pointer into the garbage-collected heap
+  [[nodiscard]] bool IsPointer() const { return pointer_; }
+  void SetPointer() { pointer_ = true; }
 
 private:
   int num_;
-  explicit Temp(int num) : num_(num) {}
+  bool pointer_ = false;
+  // Name used when the temp has no register, e.g. "t100"
+  std::string name_;
+  explicit Temp(int num) : num_(num), name_("t" + std::to_string(num)) {}
 };
 
 class TempFactory {
 public:
+  // Safe to call from several threads
   static Temp *NewTemp();
 
 private:
-  int temp_id_ = 100;
+  std::atomic<int> temp_id_{100};
   static TempFactory temp_factory;
 };
 
@@ -59,14 +90,16 @@ private:
       : tab_(tab), under_(under) {}
 };
 
-class TempList {
+class TempList : public arena::Object {
 public:
   explicit TempList(Temp *t) : temp_list_({t}) {}
   TempList(std::initializer_list<Temp *> list) : temp_list_(list) {}
   TempList() = default;
   void Append(Temp *t) { temp_list_.push_back(t); }
   [[nodiscard]] Temp *NthTemp(int i) const;
-  [[nodiscard]] const std::list<Temp *> &GetList() const { return temp_list_; }
+  [[nodiscard]] const arena::List<Temp *> &GetList() const {
+    return temp_list_;
+  }
 
   [[nodiscard]] bool Contain(Temp* temp) {
     return std::find(temp_list_.begin(), temp_list_.end(), temp) != temp_list_.end();
@@ -80,7 +113,7 @@ public:
 
 
 private:
-  std::list<Temp *> temp_list_;
+  arena::List<Temp *> temp_list_;
 };
 
 } // namespace temp
@@ -4,15 +4,18 @@ extern frame::RegManager *reg_manager;
 
 namespace frame {
 
-X64Frame::X64Frame(temp::Label *name, std::list<bool> escapes) {
+X64Frame::X64Frame(temp::Label *name, std::list<bool> escapes,
+                   std::list<bool> pointers) {
   label_ = name;
   formals_ = new AccessList();
 
   s_offset_ = -8;
   int i = 1;
   int arg_num = escapes.size();
+  auto pointer = pointers.begin();
   for (auto it : escapes) {
-    Access *a = AllocLocal(it);
+    bool is_pointer = pointer != pointers.end() && *pointer++;
+    Access *a = AllocLocal(it, is_pointer);
     formals_->Append(a);
 
     if (reg_manager->GetNthArg(i)) {
@@ -38,6 +41,14 @@ tree::Stm *X64Frame::ProcEntryExit1(tree::Stm *body) {
   for (auto &it : save_args) {
     body = tree::Stm::Seq(it, body);
   }
+  // The collector may look at a pointer slot before its variable is
+  // initialized, so it must not hold garbage left by an earlier frame
+  for (int offset : pointer_slots_) {
+    tree::Exp *fp = new tree::TempExp(reg_manager->FramePointer());
+    body = tree::Stm::Seq(
+        new tree::MoveStm(InFrameAccess(offset).ToExp(fp), new tree::ConstExp(0)),
+        body);
+  }
   return body;
 }
 
@@ -47,7 +58,7 @@ assem::InstrList *X64Frame::ProcEntryExit2(assem::InstrList *body) {
 }
 
 assem::Proc *X64Frame::ProcEntryExit3(assem::InstrList *body) {
-  static char buf[256];
+  char buf[256];
   std::string prolog;
   std::string epilog;
 
@@ -70,87 +81,22 @@ assem::Proc *X64Frame::ProcEntryExit3(assem::InstrList *body) {
 
 
 temp::TempList* X64RegManager::Registers() {
-  static temp::TempList* templist = NULL;
-  
-  if (templist) return templist;
-  
-  templist = new temp::TempList();
-
-  templist->Append(RAX());
-  templist->Append(RDI());
-  templist->Append(RSI());
-  templist->Append(RDX());
-  templist->Append(RCX());
-  templist->Append(R8());
-  templist->Append(R9());
-  templist->Append(R10());
-  templist->Append(R11());
-  templist->Append(RBX());
-  templist->Append(RBP());
-  templist->Append(R12());
-  templist->Append(R13());
-  templist->Append(R14());
-  templist->Append(R15());
-  return templist;
+  return registers_;
 }
 
 temp::TempList* X64RegManager::ArgRegs() {
-  static temp::TempList* templist = NULL;
-
-  if (templist) return templist;
-
-  templist = new temp::TempList();
-  templist->Append(RDI());
-  templist->Append(RSI());
-  templist->Append(RDX());
-  templist->Append(RCX());
-  templist->Append(R8());
-  templist->Append(R9());
-  return templist;
+  return arg_regs_;
 }
 
 temp::TempList* X64RegManager::CallerSaves() {
-  static temp::TempList* templist = NULL;
-
-  if (templist)
-    return templist;
-
-  templist = new temp::TempList();
-  templist->Append(RAX());
-  templist->Append(RDI());
-  templist->Append(RSI());
-  templist->Append(RDX());
-  templist->Append(RCX());
-  templist->Append(R8());
-  templist->Append(R9());
-  templist->Append(R10());
-  templist->Append(R11());
-  return templist;
+  return caller_saves_;
 }
 temp::TempList* X64RegManager::CalleeSaves() {
-  static temp::TempList* templist = NULL;
-
-  if (templist)
-    return templist;
-
-  templist = new temp::TempList();
-  templist->Append(RBX());
-  templist->Append(RBP());
-  templist->Append(R12());
-  templist->Append(R13());
-  templist->Append(R14());
-  templist->Append(R15());
-  return templist; 
+  return callee_saves_;
 }
 
 temp::TempList* X64RegManager::ReturnSink() {
-  static temp::TempList* templist = NULL;
-  if (templist)
-    return templist;
-  
-  templist = new temp::TempList();
-  templist->Append(ReturnValue());
-  return templist;
+  return return_sink_;
 }
 
 int X64RegManager::WordSize() {
@@ -30,6 +30,18 @@ public:
     temp_map_->Enter(R14(), new std::string("%r14"));
     temp_map_->Enter(R15(), new std::string("%r15"));
     temp_map_->Enter(RSP(), new std::string("%rsp"));
+
+    // Built up front rather than on first use, so that they never land in
+    // an arena that is released after one function
+    registers_ = new temp::TempList({RAX(), RDI(), RSI(), RDX(), RCX(), R8(),
+                                     R9(), R10(), R11(), RBX(), RBP(), R12(),
+                                     R13(), R14(), R15()});
+    arg_regs_ = new temp::TempList({RDI(), RSI(), RDX(), RCX(), R8(), R9()});
+    caller_saves_ = new temp::TempList(
+        {RAX(), RDI(), RSI(), RDX(), RCX(), R8(), R9(), R10(), R11()});
+    callee_saves_ =
+        new temp::TempList({RBX(), RBP(), R12(), R13(), R14(), R15()});
+    return_sink_ = new temp::TempList(ReturnValue());
   };
   temp::TempList* Registers() override;
   temp::TempList* ArgRegs() override;
@@ -62,18 +74,29 @@ public:
   std::vector<std::string> Colors() override;
 
 private:
-  temp::Temp *rax, *rdi, *rsi, *rdx, *rcx, *r8, 
-            *r9, *r10, *r11, *rbx, *rbp, *r12, 
-            *r13, *r14, *r15, *rsp;
+  // Created on first use by the accessors above
+  temp::Temp *rax = nullptr, *rdi = nullptr, *rsi = nullptr, *rdx = nullptr,
+             *rcx = nullptr, *r8 = nullptr, *r9 = nullptr, *r10 = nullptr,
+             *r11 = nullptr, *rbx = nullptr, *rbp = nullptr, *r12 = nullptr,
+             *r13 = nullptr, *r14 = nullptr, *r15 = nullptr, *rsp = nullptr;
+  temp::TempList *registers_, *arg_regs_, *caller_saves_, *callee_saves_,
+      *return_sink_;
 };
 
 class InFrameAccess : public Access {
 public:
   int offset;
+  // Whether the slot holds a heap pointer
+  bool pointer;
 
-  InFrameAccess(int offset) : Access(INFRAME), offset(offset) { assert(offset < 0); };
+  InFrameAccess(int offset, bool pointer = false)
+      : Access(INFRAME), offset(offset), pointer(pointer) {
+    assert(offset < 0);
+  };
   tree::Exp* ToExp(tree::Exp* framPtr) const { 
-    return new tree::MemExp(new tree::BinopExp(tree::BinOp::PLUS_OP, framPtr, new tree::ConstExp(offset)));
+    auto mem = new tree::MemExp(new tree::BinopExp(tree::BinOp::PLUS_OP, framPtr, new tree::ConstExp(offset)));
+    mem->pointer_ = pointer;
+    return mem;
   };
 };
 
@@ -89,14 +112,25 @@ class X64Frame : public Frame {
 public:
   std::list<tree::Stm *> save_args;
 
-  X64Frame(temp::Label* name, std::list<bool> escapes);
-  Access* AllocLocal(bool escape) {
+  /**
+   * @param escapes whether each formal escapes
+   * @param pointers whether each formal is a heap pointer; missing entries
+   * mean it is not
+   */
+  X64Frame(temp::Label* name, std::list<bool> escapes,
+           std::list<bool> pointers = {});
+  Access* AllocLocal(bool escape, bool pointer = false) override {
     Access *tmp = nullptr;
     if (escape) {
-      tmp = new InFrameAccess(s_offset_);
+      tmp = new InFrameAccess(s_offset_, pointer);
+      if (pointer)
+        pointer_slots_.push_back(s_offset_);
       s_offset_ -= wordsize;
     } else {
-      tmp = new InRegAccess(temp::TempFactory::NewTemp());
+      temp::Temp *reg = temp::TempFactory::NewTemp();
+      if (pointer)
+        reg->SetPointer();
+      tmp = new InRegAccess(reg);
     }
     return tmp;
   };
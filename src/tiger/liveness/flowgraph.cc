@@ -38,6 +38,60 @@ void FlowGraphFactory::AssemFlowGraph() {
   }
 }
 
+std::vector<int> LoopDepth(FGraphPtr flowgraph) {
+  const auto &nodes = flowgraph->Nodes()->GetList();
+  int node_count = nodes.size();
+  std::vector<int> depth(node_count, 0);
+  if (node_count == 0)
+    return depth;
+
+  /* Find the back edges: edges into a node still on the DFS stack */
+  std::vector<std::vector<int>> latches(node_count);
+  std::vector<char> state(node_count, 0); // 0 new, 1 on stack, 2 done
+  std::vector<std::pair<int, std::size_t>> stack;
+  state[0] = 1;
+  stack.emplace_back(0, 0);
+  while (!stack.empty()) {
+    auto &top = stack.back();
+    auto &succs = nodes[top.first]->Succ()->GetList();
+    if (top.second == succs.size()) {
+      state[top.first] = 2;
+      stack.pop_back();
+      continue;
+    }
+    int next = succs[top.second++]->Key();
+    if (state[next] == 1) {
+      latches[next].push_back(top.first);
+    } else if (state[next] == 0) {
+      state[next] = 1;
+      stack.emplace_back(next, 0);
+    }
+  }
+
+  /* Every header with back edges heads one loop; its body is everything
+   * that reaches a latch without passing through the header */
+  std::vector<int> in_loop(node_count, -1);
+  std::vector<int> worklist;
+  for (int header = 0; header < node_count; header++) {
+    if (latches[header].empty())
+      continue;
+    in_loop[header] = header;
+    depth[header]++;
+    worklist = latches[header];
+    while (!worklist.empty()) {
+      int n = worklist.back();
+      worklist.pop_back();
+      if (in_loop[n] == header)
+        continue;
+      in_loop[n] = header;
+      depth[n]++;
+      for (auto pred : nodes[n]->Pred()->GetList())
+        worklist.push_back(pred->Key());
+    }
+  }
+  return depth;
+}
+
 } // namespace fg
 
 namespace assem {
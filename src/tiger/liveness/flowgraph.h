@@ -6,6 +6,8 @@
 #include "tiger/frame/temp.h"
 #include "tiger/util/graph.h"
 
+#include <vector>
+
 namespace fg {
 
 using FNode = graph::Node<assem::Instr>;
@@ -28,6 +30,14 @@ private:
   std::unique_ptr<tab::Table<temp::Label, FNode>> label_map_;
 };
 
+/**
+ * Compute the loop nesting depth of every flowgraph node
+ * Loops are the natural loops of the back edges found by a DFS from the entry
+ * @param flowgraph flowgraph whose first node is the entry
+ * @return depths indexed by node key
+ */
+std::vector<int> LoopDepth(FGraphPtr flowgraph);
+
 } // namespace fg
 
 #endif
\ No newline at end of file
@@ -43,59 +43,108 @@ MoveList *MoveList::Intersect(MoveList *list) {
   return res;
 }
 
-std::set<temp::Temp *> ToSet(const std::list<temp::Temp *>& origin) {
-  std::set<temp::Temp *> res;
-  for (auto &it : origin)
-    res.insert(it);
-  return res;
-}
-
-temp::TempList* ToTempList(const std::set<temp::Temp *>& origin) {
-  temp::TempList* res = new temp::TempList();
-  for (auto &it : origin) 
-    res->Append(it);
-  return res;
-}
-
 void LiveGraphFactory::LiveMap() {
-  for (auto &node : flowgraph_->Nodes()->GetList()) {
-    in_->Enter(node, new temp::TempList());
-    out_->Enter(node, new temp::TempList());
+  // Flowgraph nodes are indexed by their keys
+  auto &nodes = flowgraph_->Nodes()->GetList();
+  int node_count = nodes.size();
+
+  /* Renumber the temps to contiguous indices */
+  std::unordered_map<temp::Temp *, int> temp_index;
+  std::vector<temp::Temp *> temps;
+  auto index_of = [&temp_index, &temps](temp::Temp *t) {
+    auto res = temp_index.emplace(t, temps.size());
+    if (res.second)
+      temps.push_back(t);
+    return res.first->second;
+  };
+  std::vector<std::vector<int>> uses(node_count), defs(node_count);
+  for (int i = 0; i < node_count; i++) {
+    for (auto t : nodes[i]->NodeInfo()->Use()->GetList())
+      uses[i].push_back(index_of(t));
+    for (auto t : nodes[i]->NodeInfo()->Def()->GetList())
+      defs[i].push_back(index_of(t));
   }
 
-  bool fixed = false;
-
-  while (!fixed) {
-    fixed = true;
-    for (auto &node: flowgraph_->Nodes()->GetList()) {
-      auto cur = node->NodeInfo();
-      auto in_1 = ToSet(out_->Look(node)->GetList());
-
-      for (auto &iter : cur->Def()->GetList())
-        in_1.erase(iter);
-      for (auto &iter : cur->Use()->GetList())
-        in_1.insert(iter);
-      /* Judge whether change the original in_ TempList */
-      if (in_1 != ToSet(in_->Look(node)->GetList())) {
-        fixed = false;
-        in_->Set(node, ToTempList(in_1));
+  int temp_count = temps.size();
+  std::vector<bits::BitSet> use(node_count, bits::BitSet(temp_count));
+  std::vector<bits::BitSet> def(node_count, bits::BitSet(temp_count));
+  std::vector<bits::BitSet> in(node_count, bits::BitSet(temp_count));
+  std::vector<bits::BitSet> out(node_count, bits::BitSet(temp_count));
+  for (int i = 0; i < node_count; i++) {
+    for (int t : uses[i])
+      use[i].Set(t);
+    for (int t : defs[i])
+      def[i].Set(t);
+  }
+
+  /*
+   * Liveness flows backwards, so seed the worklist with the postorder of the
+   * flowgraph: successors are then mostly settled before their predecessors.
+   */
+  std::vector<int> order;
+  order.reserve(node_count);
+  {
+    std::vector<bool> visited(node_count, false);
+    // Pairs of (node, index of the next successor to visit)
+    std::vector<std::pair<int, std::size_t>> stack;
+    for (int root = 0; root < node_count; root++) {
+      if (visited[root])
+        continue;
+      visited[root] = true;
+      stack.emplace_back(root, 0);
+      while (!stack.empty()) {
+        auto &top = stack.back();
+        auto &succs = nodes[top.first]->Succ()->GetList();
+        if (top.second == succs.size()) {
+          order.push_back(top.first);
+          stack.pop_back();
+          continue;
+        }
+        int next = succs[top.second++]->Key();
+        if (!visited[next]) {
+          visited[next] = true;
+          stack.emplace_back(next, 0);
+        }
       }
+    }
+  }
 
-      std::set<temp::Temp *> out_1;
-      for (auto &iter : node->Succ()->GetList())
-        for (auto &iterator : in_->Look(iter)->GetList())
-          out_1.insert(iterator);
-      /* Judge whether change the original out_ TempList */
-      if (out_1 != ToSet(out_->Look(node)->GetList())) {
-        fixed = false;
-        out_->Set(node, ToTempList(out_1));
+  std::deque<int> worklist(order.begin(), order.end());
+  std::vector<bool> queued(node_count, true);
+  while (!worklist.empty()) {
+    int n = worklist.front();
+    worklist.pop_front();
+    queued[n] = false;
+
+    for (auto succ : nodes[n]->Succ()->GetList())
+      out[n].UnionWith(in[succ->Key()]);
+    if (!in[n].AssignTransfer(use[n], out[n], def[n]))
+      continue;
+    for (auto pred : nodes[n]->Pred()->GetList()) {
+      if (!queued[pred->Key()]) {
+        queued[pred->Key()] = true;
+        worklist.push_back(pred->Key());
       }
     }
   }
+
+  /* Publish the fixed point through the TempList tables */
+  for (int i = 0; i < node_count; i++) {
+    auto in_list = new temp::TempList();
+    auto out_list = new temp::TempList();
+    in[i].ForEach([&](int t) { in_list->Append(temps[t]); });
+    out[i].ForEach([&](int t) { out_list->Append(temps[t]); });
+    in_->Enter(nodes[i], in_list);
+    out_->Enter(nodes[i], out_list);
+  }
 }
 
 void LiveGraphFactory::InterfGraph() {
-  std::set<temp::Temp *> templist;
+  // Ordered by temp number so that the graph does not depend on heap layout
+  auto by_number = [](temp::Temp *a, temp::Temp *b) {
+    return a->Int() < b->Int();
+  };
+  std::set<temp::Temp *, decltype(by_number)> templist(by_number);
   
   for (auto &node : flowgraph_->Nodes()->GetList()) {
     for (auto &temp : node->NodeInfo()->Def()->GetList())
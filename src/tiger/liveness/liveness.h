@@ -5,9 +5,13 @@
 #include "tiger/frame/x64frame.h"
 #include "tiger/frame/temp.h"
 #include "tiger/liveness/flowgraph.h"
+#include "tiger/util/bitset.h"
 #include "tiger/util/graph.h"
+#include <deque>
 #include <map>
 #include <set>
+#include <unordered_map>
+#include <vector>
 namespace live {
 
 using INode = graph::Node<temp::Temp>;
@@ -52,7 +56,7 @@ struct LiveGraph {
 
   LiveGraph(IGraphPtr interf_graph, MoveList *moves)
       : interf_graph(interf_graph), moves(moves) {}
-  LiveGraph() {};
+  LiveGraph() : interf_graph(nullptr), moves(nullptr) {}
 };
 
 class LiveGraphFactory {
@@ -65,6 +69,9 @@ public:
   void Liveness();
   LiveGraph GetLiveGraph() { return live_graph_; }
   tab::Table<temp::Temp, INode> *GetTempNodeMap() { return temp_node_map_; }
+  // Temps live on entry to and exit from "node", valid after Liveness()
+  temp::TempList *LiveIn(fg::FNodePtr node) { return in_->Look(node); }
+  temp::TempList *LiveOut(fg::FNodePtr node) { return out_->Look(node); }
 
 private:
   fg::FGraphPtr flowgraph_;
@@ -77,9 +84,6 @@ private:
   void LiveMap();
   void InterfGraph();
 };
-
-std::set<temp::Temp *> ToSet(const std::list<temp::Temp *> &origin);
-temp::TempList *ToTempList(const std::set<temp::Temp *> &origin);
 } // namespace live
 
 #endif
\ No newline at end of file
@@ -1,11 +1,18 @@
 #include "tiger/absyn/absyn.h"
 #include "tiger/escape/escape.h"
 #include "tiger/frame/x64frame.h"
+#include "tiger/optimize/optimize.h"
 #include "tiger/output/logger.h"
 #include "tiger/output/output.h"
+#include "tiger/output/report.h"
 #include "tiger/parse/parser.h"
 #include "tiger/translate/translate.h"
 #include "tiger/semant/semant.h"
+#include "tiger/util/arena.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <thread>
 
 frame::RegManager *reg_manager;
 frame::Frags *frags;
@@ -16,18 +23,63 @@ int main(int argc, char **argv) {
   reg_manager = new frame::X64RegManager();
   frags = new frame::Frags();
 
-  if (argc < 2) {
-    fprintf(stderr, "usage: tiger-compiler file.tig\n");
+  // Lower procedures on every core unless told otherwise with -j
+  int jobs = std::max(1u, std::thread::hardware_concurrency());
+  // Where --time-report goes, if asked for
+  FILE *report_out = nullptr;
+  for (int i = 1; i < argc; i++) {
+    std::string_view arg(argv[i]);
+    if (arg == "--time-report")
+      report_out = stderr;
+    else if (arg.substr(0, 14) == "--time-report=") {
+      report_out = fopen(argv[i] + 14, "w");
+      if (!report_out) {
+        perror(argv[i] + 14);
+        exit(1);
+      }
+    }
+    else if (arg == "-O")
+      opt::Enable();
+    else if (arg == "-j" && i + 1 < argc)
+      jobs = std::atoi(argv[++i]);
+    else if (arg.substr(0, 2) == "-j")
+      jobs = std::atoi(argv[i] + 2);
+    else if (arg.substr(0, 1) == "-") {
+      fprintf(stderr, "tiger-compiler: unknown option %s\n", argv[i]);
+      fname = {};
+      break;
+    }
+    else
+      fname = arg;
+  }
+
+  if (fname.empty() || jobs < 1) {
+    fprintf(stderr, "usage: tiger-compiler [-O] [-j jobs] "
+                    "[--time-report[=file.json]] file.tig\n");
     exit(1);
   }
+  if (report_out)
+    report::Enable();
+  auto write_report = [&]() {
+    if (!report_out)
+      return;
+    report::Write(report_out, fname, jobs);
+    if (report_out != stderr)
+      fclose(report_out);
+  };
 
-  fname = std::string_view(argv[1]);
+  // The syntax tree is dropped after translation; the IR fragments live until
+  // the backend has lowered them
+  arena::Arena ast_arena;
+  arena::Arena ir_arena;
 
   {
     std::unique_ptr<err::ErrorMsg> errormsg;
+    arena::Arena::Scope ast_scope(&ast_arena);
 
     {
       // Lab 3: parsing
+      report::PhaseTimer timer("parse");
       TigerLog("-------====Parse=====-----\n");
       Parser parser(fname, std::cerr);
       parser.parse();
@@ -37,6 +89,7 @@ int main(int argc, char **argv) {
 
     {
       // Lab 4: semantic analysis
+      report::PhaseTimer timer("semant");
       TigerLog("-------====Semantic analysis=====-----\n");
       sem::ProgSem prog_sem(std::move(absyn_tree), std::move(errormsg));
       prog_sem.SemAnalyze();
@@ -46,6 +99,7 @@ int main(int argc, char **argv) {
 
     {
       // Lab 5: escape analysis
+      report::PhaseTimer timer("escape");
       TigerLog("-------====Escape analysis=====-----\n");
       esc::EscFinder esc_finder(std::move(absyn_tree));
       esc_finder.FindEscape();
@@ -54,21 +108,28 @@ int main(int argc, char **argv) {
 
     {
       // Lab 5: translate IR tree
+      report::PhaseTimer timer("translate");
       TigerLog("-------====Translate=====-----\n");
+      arena::Arena::Scope ir_scope(&ir_arena);
       tr::ProgTr prog_tr(std::move(absyn_tree), std::move(errormsg));
       prog_tr.Translate();
       errormsg = prog_tr.TransferErrormsg();
     }
 
-    if (errormsg->AnyErrors())
+    if (errormsg->AnyErrors()) {
+      write_report();
       return 1; // Don't continue if error occurrs
+    }
   }
+  ast_arena.Release();
 
   {
     // Output assembly
-    output::AssemGen assem_gen(fname);
+    report::PhaseTimer timer("assem");
+    output::AssemGen assem_gen(fname, jobs);
     assem_gen.GenAssem(true);
   }
 
+  write_report();
   return 0;
 }
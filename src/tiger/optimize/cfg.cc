@@ -0,0 +1,229 @@
+#include "tiger/optimize/cfg.h"
+
+#include <algorithm>
+#include <cassert>
+#include <unordered_map>
+
+namespace {
+
+tree::Stm *JumpTo(temp::Label *label) {
+  return new tree::JumpStm(new tree::NameExp(label),
+                           new std::vector<temp::Label *>{label});
+}
+
+// The labels the jump "stm" may go to
+std::vector<temp::Label *> Targets(tree::Stm *stm) {
+  if (stm->kind_ == tree::Stm::CJUMP) {
+    auto cjump = static_cast<tree::CjumpStm *>(stm);
+    return {cjump->true_label_, cjump->false_label_};
+  }
+  assert(stm->kind_ == tree::Stm::JUMP);
+  return *static_cast<tree::JumpStm *>(stm)->jumps_;
+}
+
+} // namespace
+
+namespace opt {
+
+int Block::PredIndex(int pred) const {
+  auto it = std::find(preds.begin(), preds.end(), pred);
+  assert(it != preds.end());
+  return static_cast<int>(it - preds.begin());
+}
+
+Cfg::Cfg(canon::StmListList *blocks) {
+  for (tree::StmList *list : blocks->GetList()) {
+    Block block;
+    auto it = list->GetList().begin();
+    block.label = static_cast<tree::LabelStm *>(*it)->label_;
+    block.stms.assign(++it, list->GetList().end());
+    blocks_.push_back(std::move(block));
+  }
+
+  // The entry must have no predecessors, or its phis could not tell the
+  // values on entry apart
+  bool entered = false;
+  for (Block &block : blocks_)
+    for (temp::Label *target : Targets(block.Jump()))
+      entered |= target == blocks_.front().label;
+  if (entered) {
+    Block entry;
+    entry.label = temp::LabelFactory::NewLabel();
+    entry.stms.push_back(JumpTo(blocks_.front().label));
+    blocks_.insert(blocks_.begin(), std::move(entry));
+  }
+  Analyze();
+}
+
+void Cfg::Analyze() {
+  int n = static_cast<int>(blocks_.size());
+  std::unordered_map<temp::Label *, int> index;
+  for (int b = 0; b < n; b++)
+    if (!blocks_[b].dead)
+      index[blocks_[b].label] = b;
+  auto successors = [&](int b) {
+    std::vector<int> succs;
+    for (temp::Label *target : Targets(blocks_[b].Jump())) {
+      auto it = index.find(target);
+      // Jumps out of the procedure have no block
+      if (it != index.end() &&
+          std::find(succs.begin(), succs.end(), it->second) == succs.end())
+        succs.push_back(it->second);
+    }
+    return succs;
+  };
+
+  // Depth-first from the entry, for reachability and postorder
+  std::vector<int> postorder;
+  std::vector<bool> seen(n, false);
+  std::vector<std::pair<int, std::vector<int>>> stack;
+  seen[0] = true;
+  stack.emplace_back(0, successors(0));
+  while (!stack.empty()) {
+    auto &[b, succs] = stack.back();
+    if (succs.empty()) {
+      postorder.push_back(b);
+      stack.pop_back();
+      continue;
+    }
+    int s = succs.back();
+    succs.pop_back();
+    if (!seen[s]) {
+      seen[s] = true;
+      stack.emplace_back(s, successors(s));
+    }
+  }
+
+  std::vector<std::vector<int>> old_preds(n);
+  for (int b = 0; b < n; b++) {
+    blocks_[b].dead |= !seen[b];
+    old_preds[b] = std::move(blocks_[b].preds);
+    blocks_[b].preds.clear();
+    blocks_[b].succs.clear();
+  }
+  for (int b = 0; b < n; b++) {
+    if (blocks_[b].dead)
+      continue;
+    blocks_[b].succs = successors(b);
+    for (int s : blocks_[b].succs)
+      blocks_[s].preds.push_back(b);
+  }
+  for (int b = 0; b < n; b++) {
+    Block &block = blocks_[b];
+    for (Phi &phi : block.phis) {
+      std::vector<tree::Exp *> args;
+      for (int p : block.preds) {
+        auto it = std::find(old_preds[b].begin(), old_preds[b].end(), p);
+        assert(it != old_preds[b].end());
+        args.push_back(phi.args[it - old_preds[b].begin()]);
+      }
+      phi.args = std::move(args);
+    }
+  }
+
+  order_.assign(postorder.rbegin(), postorder.rend());
+  rpo_.assign(n, -1);
+  for (int i = 0; i < static_cast<int>(order_.size()); i++)
+    rpo_[order_[i]] = i;
+
+  // Dominators by Cooper, Harvey and Kennedy's iteration over the reverse
+  // postorder
+  std::vector<int> idom(n, -1);
+  idom[0] = 0;
+  auto intersect = [&](int a, int b) {
+    while (a != b) {
+      while (rpo_[a] > rpo_[b])
+        a = idom[a];
+      while (rpo_[b] > rpo_[a])
+        b = idom[b];
+    }
+    return a;
+  };
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (int b : order_) {
+      if (b == 0)
+        continue;
+      int dom = -1;
+      for (int p : blocks_[b].preds)
+        if (idom[p] != -1)
+          dom = dom == -1 ? p : intersect(p, dom);
+      if (dom != idom[b]) {
+        idom[b] = dom;
+        changed = true;
+      }
+    }
+  }
+  for (Block &block : blocks_) {
+    block.children.clear();
+    block.frontier.clear();
+  }
+  for (int b : order_) {
+    blocks_[b].idom = b == 0 ? -1 : idom[b];
+    if (b != 0)
+      blocks_[idom[b]].children.push_back(b);
+  }
+  for (int b : order_) {
+    if (blocks_[b].preds.size() < 2)
+      continue;
+    for (int p : blocks_[b].preds) {
+      for (int runner = p; runner != blocks_[b].idom;
+           runner = blocks_[runner].idom) {
+        auto &frontier = blocks_[runner].frontier;
+        if (std::find(frontier.begin(), frontier.end(), b) == frontier.end())
+          frontier.push_back(b);
+      }
+    }
+  }
+}
+
+bool Cfg::Dominates(int a, int b) const {
+  while (b != -1 && b != a)
+    b = blocks_[b].idom;
+  return b == a;
+}
+
+int Cfg::SplitEdge(int pred, int succ) {
+  int split = static_cast<int>(blocks_.size());
+  Block block;
+  block.label = temp::LabelFactory::NewLabel();
+  block.stms.push_back(JumpTo(blocks_[succ].label));
+  block.preds.push_back(pred);
+  block.succs.push_back(succ);
+  block.idom = pred;
+
+  temp::Label *target = blocks_[succ].label;
+  tree::Stm *&jump = blocks_[pred].stms.back();
+  if (jump->kind_ == tree::Stm::CJUMP) {
+    auto cjump = static_cast<tree::CjumpStm *>(jump);
+    if (cjump->true_label_ == target)
+      cjump->true_label_ = block.label;
+    if (cjump->false_label_ == target)
+      cjump->false_label_ = block.label;
+  } else {
+    jump = JumpTo(block.label);
+  }
+  std::replace(blocks_[pred].succs.begin(), blocks_[pred].succs.end(), succ,
+               split);
+  std::replace(blocks_[succ].preds.begin(), blocks_[succ].preds.end(), pred,
+               split);
+  blocks_.push_back(std::move(block));
+  rpo_.push_back(-1);
+  return split;
+}
+
+canon::StmListList *Cfg::ToStmLists() const {
+  auto lists = new canon::StmListList();
+  for (const Block &block : blocks_) {
+    if (block.dead)
+      continue;
+    assert(block.phis.empty());
+    auto list = new tree::StmList(new tree::LabelStm(block.label));
+    for (tree::Stm *stm : block.stms)
+      list->Append(stm);
+    lists->Append(list);
+  }
+  return lists;
+}
+
+} // namespace opt
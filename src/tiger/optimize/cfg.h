@@ -0,0 +1,84 @@
+#ifndef TIGER_OPTIMIZE_CFG_H_
+#define TIGER_OPTIMIZE_CFG_H_
+
+#include <vector>
+
+#include "tiger/canon/canon.h"
+
+namespace opt {
+
+/**
+ * dst = phi(args) at the start of a block, with one argument per
+ * predecessor of the block, in the order of its preds
+ */
+struct Phi {
+  temp::Temp *dst;
+  // The variable "dst" is a version of
+  temp::Temp *var;
+  std::vector<tree::Exp *> args;
+};
+
+/**
+ * A basic block as made by canon::Canon::BasicBlocks: a label, straight-line
+ * statements, then a JUMP or CJUMP, which is the last of "stms"
+ */
+struct Block {
+  temp::Label *label;
+  std::vector<Phi> phis;
+  std::vector<tree::Stm *> stms;
+  // Each block appears once in these, even if a CJUMP goes to it both ways
+  std::vector<int> succs;
+  std::vector<int> preds;
+  // Immediate dominator, -1 for the entry, and the blocks it dominates
+  // directly
+  int idom = -1;
+  std::vector<int> children;
+  std::vector<int> frontier;
+  // Unreachable, and left out of the output
+  bool dead = false;
+
+  tree::Stm *Jump() const { return stms.back(); }
+  // Where "pred" is in preds, which is also its phi argument
+  int PredIndex(int pred) const;
+};
+
+/**
+ * Control-flow graph of the basic blocks of a procedure, whose entry is
+ * block 0, with its dominator tree and dominance frontiers
+ */
+class Cfg {
+public:
+  explicit Cfg(canon::StmListList *blocks);
+
+  /**
+   * Recompute the edges from the jumps, mark the blocks the entry no
+   * longer reaches dead, and recompute dominance. Phi arguments follow
+   * their predecessors.
+   */
+  void Analyze();
+
+  bool Dominates(int a, int b) const;
+  // The live blocks in reverse postorder
+  const std::vector<int> &Order() const { return order_; }
+
+  /**
+   * Put a new block on the edge from "pred" to "succ", retargeting the jump
+   * of "pred", and return it. The new block takes the place of "pred" among
+   * the predecessors of "succ".
+   */
+  int SplitEdge(int pred, int succ);
+
+  // The live blocks, entry first, for canon::Canon::TraceSchedule
+  canon::StmListList *ToStmLists() const;
+
+  std::vector<Block> blocks_;
+
+private:
+  std::vector<int> order_;
+  // Position of each block in order_, -1 if dead
+  std::vector<int> rpo_;
+};
+
+} // namespace opt
+
+#endif // TIGER_OPTIMIZE_CFG_H_
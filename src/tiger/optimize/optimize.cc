@@ -0,0 +1,17 @@
+#include "tiger/optimize/optimize.h"
+
+#include <atomic>
+
+namespace {
+
+std::atomic<bool> enabled(false);
+
+} // namespace
+
+namespace opt {
+
+void Enable() { enabled = true; }
+
+bool Enabled() { return enabled.load(std::memory_order_relaxed); }
+
+} // namespace opt
@@ -0,0 +1,49 @@
+#ifndef TIGER_OPTIMIZE_OPTIMIZE_H_
+#define TIGER_OPTIMIZE_OPTIMIZE_H_
+
+#include <cstdint>
+
+#include "tiger/canon/canon.h"
+#include "tiger/translate/tree.h"
+
+/**
+ * Optimizations of the IR of each procedure, run when the driver is given
+ * -O. Until Enable is called the backend lowers the IR as translated.
+ */
+namespace opt {
+
+void Enable();
+bool Enabled();
+
+/**
+ * Fold constant arithmetic and algebraic identities in the IR tree "stm" of
+ * a procedure, turn conditional jumps on constants into jumps and drop
+ * statements that compute nothing. Runs before canonicalization, and
+ * rewrites the tree in place where it can.
+ */
+tree::Stm *Simplify(tree::Stm *stm);
+
+/**
+ * Optimize the basic blocks of a procedure in SSA form: propagate
+ * constants and copies, number values along the dominator tree and remove
+ * dead code. Runs between canon::Canon::BasicBlocks and TraceSchedule, and
+ * returns blocks for the latter, entry first.
+ */
+canon::StmListList *Optimize(canon::StmListList *blocks);
+
+/**
+ * Whether evaluating "exp" has no effect but its value: no calls, no
+ * statements and no loads, which may fault on nil
+ */
+bool Pure(tree::Exp *exp);
+
+/**
+ * "a op b" on the 64-bit words the generated code computes with, or false
+ * if it is undefined there
+ */
+bool Evaluate(tree::BinOp op, int64_t a, int64_t b, int64_t *result);
+bool Compare(tree::RelOp op, int64_t a, int64_t b);
+
+} // namespace opt
+
+#endif // TIGER_OPTIMIZE_OPTIMIZE_H_
@@ -0,0 +1,244 @@
+#include "tiger/optimize/optimize.h"
+
+#include <climits>
+#include <cstdint>
+
+namespace {
+
+bool IsConst(tree::Exp *exp) { return exp->kind_ == tree::Exp::CONST; }
+
+int64_t ValueOf(tree::Exp *exp) {
+  return static_cast<tree::ConstExp *>(exp)->consti_;
+}
+
+bool FitsConst(int64_t value) {
+  return value >= INT_MIN && value <= INT_MAX;
+}
+
+} // namespace
+
+namespace opt {
+
+bool Pure(tree::Exp *exp) {
+  switch (exp->kind_) {
+  case tree::Exp::CONST:
+  case tree::Exp::NAME:
+  case tree::Exp::TEMP:
+    return true;
+  case tree::Exp::BINOP: {
+    auto binop = static_cast<tree::BinopExp *>(exp);
+    // Division traps on zero
+    if (binop->op_ == tree::DIV_OP &&
+        !(IsConst(binop->right_) && ValueOf(binop->right_) != 0))
+      return false;
+    return Pure(binop->left_) && Pure(binop->right_);
+  }
+  default:
+    return false;
+  }
+}
+
+bool Evaluate(tree::BinOp op, int64_t a, int64_t b, int64_t *result) {
+  auto ua = static_cast<uint64_t>(a);
+  auto ub = static_cast<uint64_t>(b);
+  switch (op) {
+  case tree::PLUS_OP: *result = static_cast<int64_t>(ua + ub); return true;
+  case tree::MINUS_OP: *result = static_cast<int64_t>(ua - ub); return true;
+  case tree::MUL_OP: *result = static_cast<int64_t>(ua * ub); return true;
+  case tree::DIV_OP:
+    if (b == 0 || (a == INT64_MIN && b == -1))
+      return false;
+    *result = a / b;
+    return true;
+  case tree::AND_OP: *result = a & b; return true;
+  case tree::OR_OP: *result = a | b; return true;
+  case tree::XOR_OP: *result = a ^ b; return true;
+  case tree::LSHIFT_OP: case tree::RSHIFT_OP: case tree::ARSHIFT_OP:
+    if (b < 0 || b > 63)
+      return false;
+    if (op == tree::LSHIFT_OP)
+      *result = static_cast<int64_t>(ua << b);
+    else if (op == tree::RSHIFT_OP)
+      *result = static_cast<int64_t>(ua >> b);
+    else
+      *result = a >> b;
+    return true;
+  default:
+    return false;
+  }
+}
+
+bool Compare(tree::RelOp op, int64_t a, int64_t b) {
+  auto ua = static_cast<uint64_t>(a);
+  auto ub = static_cast<uint64_t>(b);
+  switch (op) {
+  case tree::EQ_OP: return a == b;
+  case tree::NE_OP: return a != b;
+  case tree::LT_OP: return a < b;
+  case tree::GT_OP: return a > b;
+  case tree::LE_OP: return a <= b;
+  case tree::GE_OP: return a >= b;
+  case tree::ULT_OP: return ua < ub;
+  case tree::ULE_OP: return ua <= ub;
+  case tree::UGT_OP: return ua > ub;
+  case tree::UGE_OP: return ua >= ub;
+  default: return false;
+  }
+}
+
+} // namespace opt
+
+namespace {
+
+tree::Stm *Nop() { return new tree::ExpStm(new tree::ConstExp(0)); }
+
+tree::Exp *Fold(tree::Exp *exp);
+
+tree::Exp *FoldBinop(tree::BinopExp *binop) {
+  binop->left_ = Fold(binop->left_);
+  binop->right_ = Fold(binop->right_);
+  tree::BinOp op = binop->op_;
+  tree::Exp *&left = binop->left_;
+  tree::Exp *&right = binop->right_;
+
+  int64_t value;
+  if (IsConst(left) && IsConst(right)) {
+    if (opt::Evaluate(op, ValueOf(left), ValueOf(right), &value) &&
+        FitsConst(value))
+      return new tree::ConstExp(static_cast<int>(value));
+    return binop;
+  }
+
+  // Keep constants on the right of commutative operators, and subtract a
+  // constant by adding its negation, so that the rules below see them there
+  if (IsConst(left) && (op == tree::PLUS_OP || op == tree::MUL_OP ||
+                        op == tree::AND_OP || op == tree::OR_OP ||
+                        op == tree::XOR_OP))
+    std::swap(left, right);
+  if (op == tree::MINUS_OP && IsConst(right) && ValueOf(right) != INT_MIN) {
+    binop->op_ = op = tree::PLUS_OP;
+    right = new tree::ConstExp(-static_cast<int>(ValueOf(right)));
+  }
+  if (!IsConst(right))
+    return binop;
+
+  // (x op c1) op c2 is x op (c1 op c2) for + and *
+  int64_t c = ValueOf(right);
+  if ((op == tree::PLUS_OP || op == tree::MUL_OP) &&
+      left->kind_ == tree::Exp::BINOP) {
+    auto inner = static_cast<tree::BinopExp *>(left);
+    if (inner->op_ == op && IsConst(inner->right_) &&
+        opt::Evaluate(op, ValueOf(inner->right_), c, &value) &&
+        FitsConst(value)) {
+      left = inner->left_;
+      right = new tree::ConstExp(static_cast<int>(value));
+      c = value;
+    }
+  }
+
+  switch (op) {
+  case tree::PLUS_OP: case tree::OR_OP: case tree::XOR_OP:
+  case tree::LSHIFT_OP: case tree::RSHIFT_OP: case tree::ARSHIFT_OP:
+    if (c == 0)
+      return left;
+    break;
+  case tree::MUL_OP: case tree::DIV_OP:
+    if (c == 1)
+      return left;
+    if (op == tree::MUL_OP && c == 0 && opt::Pure(left))
+      return right;
+    break;
+  case tree::AND_OP:
+    if (c == 0 && opt::Pure(left))
+      return right;
+    break;
+  default:
+    break;
+  }
+  return binop;
+}
+
+tree::Stm *Fold(tree::Stm *stm);
+
+tree::Exp *Fold(tree::Exp *exp) {
+  switch (exp->kind_) {
+  case tree::Exp::BINOP:
+    return FoldBinop(static_cast<tree::BinopExp *>(exp));
+  case tree::Exp::MEM: {
+    auto mem = static_cast<tree::MemExp *>(exp);
+    mem->exp_ = Fold(mem->exp_);
+    return mem;
+  }
+  case tree::Exp::ESEQ: {
+    auto eseq = static_cast<tree::EseqExp *>(exp);
+    eseq->stm_ = Fold(eseq->stm_);
+    eseq->exp_ = Fold(eseq->exp_);
+    return eseq->stm_->IsNop() ? eseq->exp_ : eseq;
+  }
+  case tree::Exp::CALL: {
+    auto call = static_cast<tree::CallExp *>(exp);
+    call->fun_ = Fold(call->fun_);
+    for (auto &arg : call->args_->GetNonConstList())
+      arg = Fold(arg);
+    return call;
+  }
+  default:
+    return exp;
+  }
+}
+
+tree::Stm *Fold(tree::Stm *stm) {
+  switch (stm->kind_) {
+  case tree::Stm::SEQ: {
+    auto seq = static_cast<tree::SeqStm *>(stm);
+    seq->left_ = Fold(seq->left_);
+    seq->right_ = Fold(seq->right_);
+    if (seq->left_->IsNop())
+      return seq->right_;
+    if (seq->right_->IsNop())
+      return seq->left_;
+    return seq;
+  }
+  case tree::Stm::CJUMP: {
+    auto cjump = static_cast<tree::CjumpStm *>(stm);
+    cjump->left_ = Fold(cjump->left_);
+    cjump->right_ = Fold(cjump->right_);
+    if (!IsConst(cjump->left_) || !IsConst(cjump->right_) ||
+        !cjump->true_label_ || !cjump->false_label_)
+      return cjump;
+    temp::Label *target =
+        opt::Compare(cjump->op_, ValueOf(cjump->left_),
+                     ValueOf(cjump->right_))
+            ? cjump->true_label_
+            : cjump->false_label_;
+    return new tree::JumpStm(new tree::NameExp(target),
+                             new std::vector<temp::Label *>{target});
+  }
+  case tree::Stm::MOVE: {
+    auto move = static_cast<tree::MoveStm *>(stm);
+    move->dst_ = Fold(move->dst_);
+    move->src_ = Fold(move->src_);
+    return move;
+  }
+  case tree::Stm::EXP: {
+    auto exp_stm = static_cast<tree::ExpStm *>(stm);
+    exp_stm->exp_ = Fold(exp_stm->exp_);
+    // A value nobody uses: keep only the statements computing it
+    tree::Exp *exp = exp_stm->exp_;
+    if (exp->kind_ == tree::Exp::ESEQ &&
+        opt::Pure(static_cast<tree::EseqExp *>(exp)->exp_))
+      return static_cast<tree::EseqExp *>(exp)->stm_;
+    return opt::Pure(exp) ? Nop() : exp_stm;
+  }
+  default:
+    return stm;
+  }
+}
+
+} // namespace
+
+namespace opt {
+
+tree::Stm *Simplify(tree::Stm *stm) { return Fold(stm); }
+
+} // namespace opt
@@ -0,0 +1,1406 @@
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <set>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "tiger/frame/frame.h"
+#include "tiger/optimize/cfg.h"
+#include "tiger/optimize/optimize.h"
+
+extern frame::RegManager *reg_manager;
+
+namespace {
+
+using opt::Block;
+using opt::Cfg;
+using opt::Phi;
+
+using Rename = std::function<temp::Temp *(temp::Temp *)>;
+
+// Machine registers are not SSA variables: calls and codegen define them
+bool IsRegister(temp::Temp *t) {
+  return reg_manager->temp_map_->Look(t) != nullptr;
+}
+
+temp::Temp *TempOf(tree::Exp *exp) {
+  return exp->kind_ == tree::Exp::TEMP ? static_cast<tree::TempExp *>(exp)->temp_
+                                       : nullptr;
+}
+
+// The temp "stm" defines, if any
+temp::Temp *DefOf(tree::Stm *stm) {
+  if (stm->kind_ != tree::Stm::MOVE)
+    return nullptr;
+  return TempOf(static_cast<tree::MoveStm *>(stm)->dst_);
+}
+
+tree::Stm *JumpTo(temp::Label *label) {
+  return new tree::JumpStm(new tree::NameExp(label),
+                           new std::vector<temp::Label *>{label});
+}
+
+// Whether "exp" reads memory or calls
+bool Loads(tree::Exp *exp) {
+  switch (exp->kind_) {
+  case tree::Exp::BINOP:
+    return Loads(static_cast<tree::BinopExp *>(exp)->left_) ||
+           Loads(static_cast<tree::BinopExp *>(exp)->right_);
+  case tree::Exp::MEM:
+  case tree::Exp::CALL:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// Call "f" on every slot of "exp" holding a TEMP
+void VisitTemps(tree::Exp *&exp, const std::function<void(tree::Exp *&)> &f) {
+  switch (exp->kind_) {
+  case tree::Exp::TEMP:
+    f(exp);
+    break;
+  case tree::Exp::BINOP: {
+    auto binop = static_cast<tree::BinopExp *>(exp);
+    VisitTemps(binop->left_, f);
+    VisitTemps(binop->right_, f);
+    break;
+  }
+  case tree::Exp::MEM:
+    VisitTemps(static_cast<tree::MemExp *>(exp)->exp_, f);
+    break;
+  case tree::Exp::CALL: {
+    auto call = static_cast<tree::CallExp *>(exp);
+    VisitTemps(call->fun_, f);
+    for (auto &arg : call->args_->GetNonConstList())
+      VisitTemps(arg, f);
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+// Call "f" on every slot of "stm" holding a TEMP it reads
+void VisitUses(tree::Stm *stm, const std::function<void(tree::Exp *&)> &f) {
+  switch (stm->kind_) {
+  case tree::Stm::MOVE: {
+    auto move = static_cast<tree::MoveStm *>(stm);
+    if (move->dst_->kind_ == tree::Exp::MEM)
+      VisitTemps(static_cast<tree::MemExp *>(move->dst_)->exp_, f);
+    VisitTemps(move->src_, f);
+    break;
+  }
+  case tree::Stm::EXP:
+    VisitTemps(static_cast<tree::ExpStm *>(stm)->exp_, f);
+    break;
+  case tree::Stm::CJUMP: {
+    auto cjump = static_cast<tree::CjumpStm *>(stm);
+    VisitTemps(cjump->left_, f);
+    VisitTemps(cjump->right_, f);
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+// A fresh copy of "exp" reading "use(t)" for each temp t
+tree::Exp *Copy(tree::Exp *exp, const Rename &use) {
+  switch (exp->kind_) {
+  case tree::Exp::TEMP:
+    return new tree::TempExp(use(static_cast<tree::TempExp *>(exp)->temp_));
+  case tree::Exp::BINOP: {
+    auto binop = static_cast<tree::BinopExp *>(exp);
+    return new tree::BinopExp(binop->op_, Copy(binop->left_, use),
+                              Copy(binop->right_, use));
+  }
+  case tree::Exp::MEM: {
+    auto mem = static_cast<tree::MemExp *>(exp);
+    auto copy = new tree::MemExp(Copy(mem->exp_, use));
+    copy->pointer_ = mem->pointer_;
+    return copy;
+  }
+  case tree::Exp::CALL: {
+    auto call = static_cast<tree::CallExp *>(exp);
+    auto args = new tree::ExpList();
+    for (tree::Exp *arg : call->args_->GetList())
+      args->Append(Copy(arg, use));
+    auto copy = new tree::CallExp(Copy(call->fun_, use), args);
+    copy->pointer_ = call->pointer_;
+    return copy;
+  }
+  default:
+    return exp;
+  }
+}
+
+/**
+ * A fresh copy of "stm" reading "use(t)" for each temp t and defining
+ * "def(t)" for the temp t it defines, so that it may be rewritten in place.
+ * Trees out of the translator share nodes.
+ */
+tree::Stm *Copy(tree::Stm *stm, const Rename &use, const Rename &def) {
+  switch (stm->kind_) {
+  case tree::Stm::MOVE: {
+    auto move = static_cast<tree::MoveStm *>(stm);
+    tree::Exp *src = Copy(move->src_, use);
+    if (temp::Temp *t = TempOf(move->dst_))
+      return new tree::MoveStm(new tree::TempExp(def(t)), src);
+    return new tree::MoveStm(Copy(move->dst_, use), src);
+  }
+  case tree::Stm::EXP:
+    return new tree::ExpStm(Copy(static_cast<tree::ExpStm *>(stm)->exp_, use));
+  case tree::Stm::CJUMP: {
+    auto cjump = static_cast<tree::CjumpStm *>(stm);
+    return new tree::CjumpStm(cjump->op_, Copy(cjump->left_, use),
+                              Copy(cjump->right_, use), cjump->true_label_,
+                              cjump->false_label_);
+  }
+  default:
+    return stm;
+  }
+}
+
+/**
+ * The base of "exp" if it is MEM(base + wordsize) with base a temp. From
+ * the frame pointer or a static link, that is the word above a frame,
+ * which holds the static link its caller pushed and is never written
+ * afterwards.
+ */
+tree::Exp *StaticLinkBase(tree::Exp *exp) {
+  if (exp->kind_ != tree::Exp::MEM)
+    return nullptr;
+  auto addr = static_cast<tree::MemExp *>(exp)->exp_;
+  if (addr->kind_ != tree::Exp::BINOP)
+    return nullptr;
+  auto binop = static_cast<tree::BinopExp *>(addr);
+  if (binop->op_ != tree::PLUS_OP)
+    return nullptr;
+  tree::Exp *base = binop->left_;
+  tree::Exp *offset = binop->right_;
+  if (base->kind_ == tree::Exp::CONST)
+    std::swap(base, offset);
+  if (offset->kind_ != tree::Exp::CONST ||
+      static_cast<tree::ConstExp *>(offset)->consti_ !=
+          reg_manager->WordSize())
+    return nullptr;
+  return base->kind_ == tree::Exp::TEMP ? base : nullptr;
+}
+
+bool FitsConst(int64_t value) {
+  return value >= INT_MIN && value <= INT_MAX;
+}
+
+bool Calls(tree::Exp *exp) {
+  switch (exp->kind_) {
+  case tree::Exp::BINOP:
+    return Calls(static_cast<tree::BinopExp *>(exp)->left_) ||
+           Calls(static_cast<tree::BinopExp *>(exp)->right_);
+  case tree::Exp::MEM:
+    return Calls(static_cast<tree::MemExp *>(exp)->exp_);
+  case tree::Exp::CALL:
+    return true;
+  default:
+    return false;
+  }
+}
+
+bool Calls(tree::Stm *stm) {
+  switch (stm->kind_) {
+  case tree::Stm::MOVE:
+    return Calls(static_cast<tree::MoveStm *>(stm)->dst_) ||
+           Calls(static_cast<tree::MoveStm *>(stm)->src_);
+  case tree::Stm::EXP:
+    return Calls(static_cast<tree::ExpStm *>(stm)->exp_);
+  case tree::Stm::CJUMP:
+    return Calls(static_cast<tree::CjumpStm *>(stm)->left_) ||
+           Calls(static_cast<tree::CjumpStm *>(stm)->right_);
+  default:
+    return false;
+  }
+}
+
+// Whether "addr" is a temp "base" plus a constant "offset"
+bool Slot(tree::Exp *addr, temp::Temp **base, int64_t *offset) {
+  *offset = 0;
+  if (addr->kind_ == tree::Exp::BINOP) {
+    auto binop = static_cast<tree::BinopExp *>(addr);
+    tree::Exp *left = binop->left_;
+    tree::Exp *right = binop->right_;
+    if (left->kind_ == tree::Exp::CONST)
+      std::swap(left, right);
+    if (binop->op_ != tree::PLUS_OP || right->kind_ != tree::Exp::CONST)
+      return false;
+    *offset = static_cast<tree::ConstExp *>(right)->consti_;
+    addr = left;
+  }
+  *base = TempOf(addr);
+  return *base != nullptr;
+}
+
+// Whether codegen multiplies by "c" with shifts and leaq rather than imulq
+bool ShiftsAndAdds(int64_t c) {
+  uint64_t abs = c < 0 ? -static_cast<uint64_t>(c) : c;
+  for (uint64_t factor : {1, 3, 5, 9}) {
+    uint64_t power = abs / factor;
+    if (abs % factor == 0 && power && !(power & (power - 1)))
+      return !(c < 0 && factor > 1 && power > 1);
+  }
+  return false;
+}
+
+// Lattice of sparse conditional constant propagation
+struct Value {
+  enum Kind { TOP, CONST, BOTTOM } kind = TOP;
+  int64_t value = 0;
+
+  bool operator!=(const Value &other) const {
+    return kind != other.kind || (kind == CONST && value != other.value);
+  }
+};
+
+Value Meet(Value a, Value b) {
+  if (a.kind == Value::TOP)
+    return b;
+  if (b.kind == Value::TOP || !(a != b))
+    return a;
+  return {Value::BOTTOM};
+}
+
+/**
+ * The optimizer of one procedure. Between building and leaving SSA every
+ * temp but the machine registers is defined once, by a statement or a phi,
+ * and the passes keep it so.
+ */
+class Optimizer {
+public:
+  explicit Optimizer(canon::StmListList *blocks) : cfg_(blocks) {}
+
+  canon::StmListList *Run() {
+    LoadStaticLinks();
+    BuildSsa();
+    PropagateConstants();
+    PropagateCopies();
+    NumberValues();
+    PropagateCopies();
+    OptimizeLoops();
+    NumberValues();
+    PropagateCopies();
+    EliminateDeadCode();
+    LeaveSsa();
+    return cfg_.ToStmLists();
+  }
+
+private:
+  // Where a temp is defined: a statement, or phi "phi" of block "block"
+  struct Def {
+    int block;
+    tree::Stm *stm;
+    int phi;
+  };
+
+  // A natural loop: the blocks on the cycles through "header" that it
+  // dominates
+  struct Loop {
+    int header;
+    std::unordered_set<int> blocks;
+  };
+
+  Cfg cfg_;
+  // Temps LoadStaticLinks loads static links into, and their versions
+  std::unordered_set<temp::Temp *> links_;
+  std::unordered_map<temp::Temp *, Def> defs_;
+  // Temps that may hold an address into the heap: pointers, loaded words,
+  // which may be raw addresses like the allocator's, and values derived
+  // from either
+  std::unordered_set<temp::Temp *> tainted_;
+  // Temps holding addresses in frames: the frame pointer, static links
+  // and values derived from them
+  std::unordered_set<temp::Temp *> frame_;
+
+  void FindDefs();
+  void FindTainted();
+  // Call "f" on every slot holding a TEMP that a live block reads
+  void VisitAllUses(const std::function<void(tree::Exp *&)> &f);
+
+  void LoadStaticLinks();
+  void BuildSsa();
+  void PropagateConstants();
+  void PropagateCopies();
+  void NumberValues();
+  void OptimizeLoops();
+  std::vector<Loop> FindLoops();
+  int Entry(const Loop &loop);
+  // Whether "exp" computes a frame address, from frame_
+  bool AddressesFrame(tree::Exp *exp) const;
+  std::vector<tree::Stm *> HoistInvariants(const Loop &loop);
+  std::vector<tree::Stm *> ReduceStrength(const Loop &loop, int entry);
+  void EliminateDeadCode();
+  void LeaveSsa();
+  bool BeforeBranch(int pred, int succ,
+                    const std::unordered_set<temp::Temp *> &dsts);
+};
+
+void Optimizer::FindDefs() {
+  defs_.clear();
+  for (int b : cfg_.Order()) {
+    Block &block = cfg_.blocks_[b];
+    for (int i = 0; i < static_cast<int>(block.phis.size()); i++)
+      defs_[block.phis[i].dst] = {b, nullptr, i};
+    for (tree::Stm *stm : block.stms) {
+      temp::Temp *t = DefOf(stm);
+      if (t && !IsRegister(t))
+        defs_[t] = {b, stm, -1};
+    }
+  }
+}
+
+void Optimizer::VisitAllUses(const std::function<void(tree::Exp *&)> &f) {
+  for (int b : cfg_.Order()) {
+    Block &block = cfg_.blocks_[b];
+    for (Phi &phi : block.phis)
+      for (tree::Exp *&arg : phi.args)
+        VisitTemps(arg, f);
+    for (tree::Stm *stm : block.stms)
+      VisitUses(stm, f);
+  }
+}
+
+void Optimizer::FindTainted() {
+  tainted_.clear();
+  for (bool changed = true; changed;) {
+    changed = false;
+    auto derived = [&](tree::Exp *&exp) {
+      bool derived = false;
+      VisitTemps(exp, [&](tree::Exp *&use) {
+        temp::Temp *t = TempOf(use);
+        derived |= t->IsPointer() || tainted_.count(t);
+      });
+      return derived;
+    };
+    auto taint = [&](temp::Temp *t) {
+      if (tainted_.insert(t).second)
+        changed = true;
+    };
+    for (int b : cfg_.Order()) {
+      Block &block = cfg_.blocks_[b];
+      for (Phi &phi : block.phis) {
+        bool from_pointer = phi.dst->IsPointer();
+        for (tree::Exp *&arg : phi.args)
+          from_pointer |= derived(arg);
+        if (from_pointer)
+          taint(phi.dst);
+      }
+      for (tree::Stm *stm : block.stms) {
+        temp::Temp *t = DefOf(stm);
+        if (!t || IsRegister(t))
+          continue;
+        tree::Exp *&src = static_cast<tree::MoveStm *>(stm)->src_;
+        if (t->IsPointer() || derived(src) || (!links_.count(t) && Loads(src)))
+          taint(t);
+      }
+    }
+  }
+}
+
+/**
+ * Load each static link a statement reads into a temp of its own, just
+ * before the statement, so that value numbering can share the loads along
+ * a chain of them
+ */
+void Optimizer::LoadStaticLinks() {
+  Rename same = [](temp::Temp *t) { return t; };
+  for (int b : cfg_.Order()) {
+    Block &block = cfg_.blocks_[b];
+    std::vector<tree::Stm *> stms;
+    // Innermost loads first, since the outer ones read them
+    std::function<void(tree::Exp *&)> load = [&](tree::Exp *&exp) {
+      switch (exp->kind_) {
+      case tree::Exp::BINOP: {
+        auto binop = static_cast<tree::BinopExp *>(exp);
+        load(binop->left_);
+        load(binop->right_);
+        return;
+      }
+      case tree::Exp::CALL: {
+        auto call = static_cast<tree::CallExp *>(exp);
+        for (auto &arg : call->args_->GetNonConstList())
+          load(arg);
+        return;
+      }
+      case tree::Exp::MEM: {
+        load(static_cast<tree::MemExp *>(exp)->exp_);
+        tree::Exp *base = StaticLinkBase(exp);
+        temp::Temp *t = base ? TempOf(base) : nullptr;
+        if (t != reg_manager->FramePointer() && !links_.count(t))
+          return;
+        temp::Temp *link = temp::TempFactory::NewTemp();
+        links_.insert(link);
+        stms.push_back(new tree::MoveStm(new tree::TempExp(link), exp));
+        exp = new tree::TempExp(link);
+        return;
+      }
+      default:
+        return;
+      }
+    };
+    for (tree::Stm *stm : block.stms) {
+      stm = Copy(stm, same, same);
+      switch (stm->kind_) {
+      case tree::Stm::MOVE: {
+        auto move = static_cast<tree::MoveStm *>(stm);
+        if (move->dst_->kind_ == tree::Exp::MEM)
+          load(static_cast<tree::MemExp *>(move->dst_)->exp_);
+        load(move->src_);
+        break;
+      }
+      case tree::Stm::EXP:
+        load(static_cast<tree::ExpStm *>(stm)->exp_);
+        break;
+      case tree::Stm::CJUMP:
+        load(static_cast<tree::CjumpStm *>(stm)->left_);
+        load(static_cast<tree::CjumpStm *>(stm)->right_);
+        break;
+      default:
+        break;
+      }
+      stms.push_back(stm);
+    }
+    block.stms = std::move(stms);
+  }
+}
+
+/**
+ * Semi-pruned SSA: phis go on the iterated dominance frontiers of the
+ * definitions of each temp some block reads before writing, then a walk
+ * of the dominator tree gives every definition a fresh temp. A read no
+ * definition reaches keeps the old temp.
+ */
+void Optimizer::BuildSsa() {
+  std::unordered_map<temp::Temp *, std::vector<int>> def_blocks;
+  std::unordered_set<temp::Temp *> globals;
+  for (int b : cfg_.Order()) {
+    std::unordered_set<temp::Temp *> killed;
+    for (tree::Stm *stm : cfg_.blocks_[b].stms) {
+      VisitUses(stm, [&](tree::Exp *&exp) {
+        temp::Temp *t = TempOf(exp);
+        if (!IsRegister(t) && !killed.count(t))
+          globals.insert(t);
+      });
+      temp::Temp *t = DefOf(stm);
+      if (t && !IsRegister(t) && killed.insert(t).second)
+        def_blocks[t].push_back(b);
+    }
+  }
+
+  for (auto &[var, blocks] : def_blocks) {
+    if (!globals.count(var))
+      continue;
+    std::vector<int> work = blocks;
+    std::unordered_set<int> defined(blocks.begin(), blocks.end());
+    std::unordered_set<int> has_phi;
+    while (!work.empty()) {
+      int b = work.back();
+      work.pop_back();
+      for (int d : cfg_.blocks_[b].frontier) {
+        if (!has_phi.insert(d).second)
+          continue;
+        Block &block = cfg_.blocks_[d];
+        block.phis.push_back(
+            {var, var, std::vector<tree::Exp *>(block.preds.size(), nullptr)});
+        if (defined.insert(d).second)
+          work.push_back(d);
+      }
+    }
+  }
+
+  std::unordered_map<temp::Temp *, std::vector<temp::Temp *>> stacks;
+  Rename current = [&](temp::Temp *t) {
+    auto it = stacks.find(t);
+    return it == stacks.end() || it->second.empty() ? t : it->second.back();
+  };
+  std::function<void(int)> rename = [&](int b) {
+    Block &block = cfg_.blocks_[b];
+    std::vector<temp::Temp *> pushed;
+    Rename define = [&](temp::Temp *t) {
+      if (IsRegister(t))
+        return t;
+      temp::Temp *v = temp::TempFactory::NewTemp();
+      if (t->IsPointer())
+        v->SetPointer();
+      if (links_.count(t))
+        links_.insert(v);
+      stacks[t].push_back(v);
+      pushed.push_back(t);
+      return v;
+    };
+    for (Phi &phi : block.phis)
+      phi.dst = define(phi.var);
+    for (tree::Stm *&stm : block.stms)
+      stm = Copy(stm, current, define);
+    for (int s : block.succs) {
+      Block &succ = cfg_.blocks_[s];
+      int k = succ.PredIndex(b);
+      for (Phi &phi : succ.phis)
+        phi.args[k] = new tree::TempExp(current(phi.var));
+    }
+    for (int c : block.children)
+      rename(c);
+    for (temp::Temp *t : pushed)
+      stacks[t].pop_back();
+  };
+  rename(0);
+}
+
+/**
+ * Sparse conditional constant propagation: assume every temp constant and
+ * every block unreachable until shown otherwise, then replace the temps
+ * found constant by their values and the branches found decided by jumps
+ */
+void Optimizer::PropagateConstants() {
+  FindDefs();
+  std::unordered_map<temp::Label *, int> index;
+  for (int b : cfg_.Order())
+    index[cfg_.blocks_[b].label] = b;
+
+  std::unordered_map<temp::Temp *, Value> values;
+  auto value_of = [&](temp::Temp *t) -> Value {
+    if (!defs_.count(t))
+      return {Value::BOTTOM};
+    auto it = values.find(t);
+    return it == values.end() ? Value() : it->second;
+  };
+  std::function<Value(tree::Exp *)> evaluate = [&](tree::Exp *exp) -> Value {
+    switch (exp->kind_) {
+    case tree::Exp::CONST:
+      return {Value::CONST, static_cast<tree::ConstExp *>(exp)->consti_};
+    case tree::Exp::TEMP:
+      return value_of(TempOf(exp));
+    case tree::Exp::BINOP: {
+      auto binop = static_cast<tree::BinopExp *>(exp);
+      Value left = evaluate(binop->left_);
+      Value right = evaluate(binop->right_);
+      if (left.kind == Value::BOTTOM || right.kind == Value::BOTTOM)
+        return {Value::BOTTOM};
+      if (left.kind == Value::TOP || right.kind == Value::TOP)
+        return {};
+      Value result{Value::CONST};
+      if (!opt::Evaluate(binop->op_, left.value, right.value, &result.value))
+        return {Value::BOTTOM};
+      return result;
+    }
+    default:
+      // Memory and calls
+      return {Value::BOTTOM};
+    }
+  };
+
+  std::vector<bool> executable(cfg_.blocks_.size(), false);
+  std::set<std::pair<int, int>> edges;
+  executable[0] = true;
+  for (bool changed = true; changed;) {
+    changed = false;
+    auto update = [&](temp::Temp *t, Value value) {
+      value = Meet(value_of(t), value);
+      if (value != value_of(t)) {
+        values[t] = value;
+        changed = true;
+      }
+    };
+    auto reach = [&](int b, temp::Label *label) {
+      auto it = index.find(label);
+      if (it == index.end() || !edges.emplace(b, it->second).second)
+        return;
+      executable[it->second] = true;
+      changed = true;
+    };
+    for (int b : cfg_.Order()) {
+      if (!executable[b])
+        continue;
+      Block &block = cfg_.blocks_[b];
+      for (Phi &phi : block.phis) {
+        Value value;
+        for (int k = 0; k < static_cast<int>(block.preds.size()); k++)
+          if (edges.count({block.preds[k], b}))
+            value = Meet(value, evaluate(phi.args[k]));
+        update(phi.dst, value);
+      }
+      for (tree::Stm *stm : block.stms) {
+        temp::Temp *t = DefOf(stm);
+        if (t && !IsRegister(t))
+          update(t, evaluate(static_cast<tree::MoveStm *>(stm)->src_));
+      }
+      tree::Stm *jump = block.Jump();
+      if (jump->kind_ == tree::Stm::JUMP) {
+        for (temp::Label *label : *static_cast<tree::JumpStm *>(jump)->jumps_)
+          reach(b, label);
+        continue;
+      }
+      auto cjump = static_cast<tree::CjumpStm *>(jump);
+      Value left = evaluate(cjump->left_);
+      Value right = evaluate(cjump->right_);
+      if (left.kind == Value::CONST && right.kind == Value::CONST) {
+        reach(b, opt::Compare(cjump->op_, left.value, right.value)
+                     ? cjump->true_label_
+                     : cjump->false_label_);
+      } else if (left.kind == Value::BOTTOM || right.kind == Value::BOTTOM) {
+        reach(b, cjump->true_label_);
+        reach(b, cjump->false_label_);
+      }
+    }
+  }
+
+  for (int b : cfg_.Order()) {
+    tree::Stm *&jump = cfg_.blocks_[b].stms.back();
+    if (jump->kind_ != tree::Stm::CJUMP)
+      continue;
+    auto cjump = static_cast<tree::CjumpStm *>(jump);
+    Value left = evaluate(cjump->left_);
+    Value right = evaluate(cjump->right_);
+    if (left.kind == Value::CONST && right.kind == Value::CONST)
+      jump = JumpTo(opt::Compare(cjump->op_, left.value, right.value)
+                        ? cjump->true_label_
+                        : cjump->false_label_);
+  }
+  VisitAllUses([&](tree::Exp *&exp) {
+    Value value = value_of(TempOf(exp));
+    if (value.kind == Value::CONST && FitsConst(value.value))
+      exp = new tree::ConstExp(static_cast<int>(value.value));
+  });
+  for (int b : cfg_.Order()) {
+    std::vector<tree::Stm *> stms;
+    for (tree::Stm *stm : cfg_.blocks_[b].stms) {
+      stm = opt::Simplify(stm);
+      if (!stm->IsNop())
+        stms.push_back(stm);
+    }
+    cfg_.blocks_[b].stms = std::move(stms);
+  }
+  cfg_.Analyze();
+}
+
+/**
+ * Replace the temps defined as copies of others, by a move or by a phi all
+ * of whose arguments are the same, with the temps they copy. A temp that
+ * may hold a pointer is only replaced by another such, for the collector
+ * to find it at calls.
+ */
+void Optimizer::PropagateCopies() {
+  std::unordered_map<temp::Temp *, temp::Temp *> copies;
+  auto copy = [&](temp::Temp *dst, temp::Temp *src) {
+    if (src && src != dst && !IsRegister(src) &&
+        (!dst->IsPointer() || src->IsPointer()))
+      copies[dst] = src;
+  };
+  for (int b : cfg_.Order()) {
+    Block &block = cfg_.blocks_[b];
+    for (Phi &phi : block.phis) {
+      temp::Temp *src = nullptr;
+      bool same = true;
+      for (tree::Exp *arg : phi.args) {
+        temp::Temp *t = TempOf(arg);
+        if (t == phi.dst)
+          continue;
+        same &= t && (!src || t == src);
+        src = t;
+      }
+      if (same)
+        copy(phi.dst, src);
+    }
+    for (tree::Stm *stm : block.stms) {
+      temp::Temp *t = DefOf(stm);
+      if (t && !IsRegister(t))
+        copy(t, TempOf(static_cast<tree::MoveStm *>(stm)->src_));
+    }
+  }
+  if (copies.empty())
+    return;
+
+  // Only phis copying each other round a cycle, in code that no definition
+  // reaches, could make a chain endless
+  auto resolve = [&](temp::Temp *t) {
+    for (size_t i = 0; i <= copies.size(); i++) {
+      auto it = copies.find(t);
+      if (it == copies.end())
+        break;
+      t = it->second;
+    }
+    return t;
+  };
+  VisitAllUses([&](tree::Exp *&exp) {
+    temp::Temp *t = resolve(TempOf(exp));
+    if (t != TempOf(exp))
+      exp = new tree::TempExp(t);
+  });
+  for (int b : cfg_.Order()) {
+    Block &block = cfg_.blocks_[b];
+    std::vector<Phi> phis;
+    for (Phi &phi : block.phis)
+      if (!copies.count(phi.dst))
+        phis.push_back(std::move(phi));
+    block.phis = std::move(phis);
+    std::vector<tree::Stm *> stms;
+    for (tree::Stm *stm : block.stms) {
+      temp::Temp *t = DefOf(stm);
+      if (!t || !copies.count(t))
+        stms.push_back(stm);
+    }
+    block.stms = std::move(stms);
+  }
+}
+
+/**
+ * Dominator-based value numbering: a temp computing the same operator of
+ * the same temps as one defined before it in its block or in a dominating
+ * one becomes a copy of it. Memory may be written in between, so loads
+ * are left alone, but for the static links.
+ *
+ * So are values derived from a pointer or a loaded word, which may be a
+ * raw heap address: sharing one would keep it in a temp across the calls
+ * in between, where the collector cannot update it.
+ */
+void Optimizer::NumberValues() {
+  FindTainted();
+  std::function<std::string(tree::Exp *)> key =
+      [&](tree::Exp *exp) -> std::string {
+    switch (exp->kind_) {
+    case tree::Exp::CONST:
+      return std::to_string(static_cast<tree::ConstExp *>(exp)->consti_);
+    case tree::Exp::NAME:
+      return "@" + static_cast<tree::NameExp *>(exp)->name_->Name();
+    case tree::Exp::TEMP: {
+      temp::Temp *t = TempOf(exp);
+      if ((IsRegister(t) && t != reg_manager->FramePointer()) ||
+          t->IsPointer() || tainted_.count(t))
+        return "";
+      return "t" + std::to_string(t->Int());
+    }
+    case tree::Exp::BINOP: {
+      auto binop = static_cast<tree::BinopExp *>(exp);
+      std::string left = key(binop->left_);
+      std::string right = key(binop->right_);
+      if (left.empty() || right.empty())
+        return "";
+      if ((binop->op_ == tree::PLUS_OP || binop->op_ == tree::MUL_OP ||
+           binop->op_ == tree::AND_OP || binop->op_ == tree::OR_OP ||
+           binop->op_ == tree::XOR_OP) &&
+          right < left)
+        std::swap(left, right);
+      return "(" + std::to_string(binop->op_) + " " + left + " " + right + ")";
+    }
+    default:
+      return "";
+    }
+  };
+
+  std::unordered_map<std::string, temp::Temp *> leaders;
+  std::function<void(int)> number = [&](int b) {
+    std::vector<std::string> scope;
+    for (tree::Stm *&stm : cfg_.blocks_[b].stms) {
+      temp::Temp *t = DefOf(stm);
+      if (!t || IsRegister(t) || tainted_.count(t))
+        continue;
+      tree::Exp *src = static_cast<tree::MoveStm *>(stm)->src_;
+      std::string value;
+      if (!links_.count(t))
+        value = key(src);
+      else if (tree::Exp *base = StaticLinkBase(src))
+        value = key(base).empty() ? "" : "[" + key(base) + "]";
+      if (value.empty())
+        continue;
+      auto [leader, first] = leaders.emplace(value, t);
+      if (first)
+        scope.push_back(value);
+      else
+        stm = new tree::MoveStm(new tree::TempExp(t),
+                                new tree::TempExp(leader->second));
+    }
+    for (int c : cfg_.blocks_[b].children)
+      number(c);
+    for (const std::string &value : scope)
+      leaders.erase(value);
+  };
+  number(0);
+}
+
+/**
+ * The natural loops, inner ones first so that what they hoist may leave
+ * the outer ones too. Loops sharing a header are one.
+ */
+std::vector<Optimizer::Loop> Optimizer::FindLoops() {
+  std::vector<Loop> loops;
+  std::unordered_map<int, int> of_header;
+  for (int b : cfg_.Order()) {
+    for (int h : cfg_.blocks_[b].succs) {
+      if (!cfg_.Dominates(h, b))
+        continue;
+      auto [it, first] = of_header.emplace(h, static_cast<int>(loops.size()));
+      if (first)
+        loops.push_back({h, {h}});
+      Loop &loop = loops[it->second];
+      // The blocks reaching the back edge without passing the header
+      std::vector<int> work{b};
+      while (!work.empty()) {
+        int x = work.back();
+        work.pop_back();
+        if (loop.blocks.insert(x).second)
+          for (int p : cfg_.blocks_[x].preds)
+            work.push_back(p);
+      }
+    }
+  }
+  std::stable_sort(loops.begin(), loops.end(),
+                   [](const Loop &a, const Loop &b) {
+                     return a.blocks.size() < b.blocks.size();
+                   });
+  return loops;
+}
+
+// The one block entering "loop", or -1
+int Optimizer::Entry(const Loop &loop) {
+  int entry = -1;
+  for (int p : cfg_.blocks_[loop.header].preds) {
+    if (loop.blocks.count(p))
+      continue;
+    if (entry != -1)
+      return -1;
+    entry = p;
+  }
+  return entry;
+}
+
+bool Optimizer::AddressesFrame(tree::Exp *exp) const {
+  switch (exp->kind_) {
+  case tree::Exp::TEMP:
+    return frame_.count(TempOf(exp)) > 0;
+  case tree::Exp::BINOP:
+    return AddressesFrame(static_cast<tree::BinopExp *>(exp)->left_) ||
+           AddressesFrame(static_cast<tree::BinopExp *>(exp)->right_);
+  default:
+    return false;
+  }
+}
+
+/**
+ * Hoist invariant code out of each loop entered by a single edge and
+ * reduce the strength of multiplications by its induction variables. What
+ * leaves a loop goes to the end of a preheader, a block that only jumps to
+ * its header: the block entering it, or a new one on the entering edge.
+ */
+void Optimizer::OptimizeLoops() {
+  FindTainted();
+  frame_ = links_;
+  frame_.insert(reg_manager->FramePointer());
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (int b : cfg_.Order()) {
+      Block &block = cfg_.blocks_[b];
+      for (Phi &phi : block.phis)
+        for (tree::Exp *arg : phi.args)
+          if (AddressesFrame(arg))
+            changed |= frame_.insert(phi.dst).second;
+      for (tree::Stm *stm : block.stms) {
+        temp::Temp *t = DefOf(stm);
+        if (t && !IsRegister(t) &&
+            AddressesFrame(static_cast<tree::MoveStm *>(stm)->src_))
+          changed |= frame_.insert(t).second;
+      }
+    }
+  }
+
+  std::vector<Loop> loops = FindLoops();
+  // The preheaders put on the edges into loops, with the edge
+  std::vector<std::tuple<int, int, int>> splits;
+  for (Loop &loop : loops) {
+    int entry = Entry(loop);
+    if (entry == -1)
+      continue;
+    std::vector<tree::Stm *> hoisted = HoistInvariants(loop);
+    std::vector<tree::Stm *> starts = ReduceStrength(loop, entry);
+    hoisted.insert(hoisted.end(), starts.begin(), starts.end());
+    if (hoisted.empty())
+      continue;
+
+    int preheader = entry;
+    if (cfg_.blocks_[entry].succs.size() > 1) {
+      preheader = cfg_.SplitEdge(entry, loop.header);
+      splits.emplace_back(entry, preheader, loop.header);
+      for (Loop &outer : loops)
+        if (outer.blocks.count(entry) && outer.blocks.count(loop.header))
+          outer.blocks.insert(preheader);
+      cfg_.Analyze();
+    }
+    std::vector<tree::Stm *> &stms = cfg_.blocks_[preheader].stms;
+    stms.insert(stms.end() - 1, hoisted.begin(), hoisted.end());
+  }
+
+  // An enclosing loop may have taken everything out of a preheader again,
+  // which would then cost a jump for nothing
+  bool emptied = false;
+  for (auto [entry, preheader, header] : splits) {
+    Block &block = cfg_.blocks_[preheader];
+    if (block.stms.size() > 1)
+      continue;
+    auto cjump = static_cast<tree::CjumpStm *>(cfg_.blocks_[entry].Jump());
+    if (cjump->true_label_ == block.label)
+      cjump->true_label_ = cfg_.blocks_[header].label;
+    if (cjump->false_label_ == block.label)
+      cjump->false_label_ = cfg_.blocks_[header].label;
+    auto &preds = cfg_.blocks_[header].preds;
+    std::replace(preds.begin(), preds.end(), preheader, entry);
+    block.dead = emptied = true;
+  }
+  if (emptied)
+    cfg_.Analyze();
+}
+
+/**
+ * Take what "loop" computes the same on every iteration out of it, and
+ * return it for the preheader: pure expressions of temps defined outside
+ * it, static links and, when the loop neither calls nor may store to them,
+ * frame slots, which are the variables of enclosing functions or escaping
+ * ones.
+ *
+ * A value that may be a heap address only leaves a loop without calls,
+ * where the collector cannot move what it points into.
+ */
+std::vector<tree::Stm *> Optimizer::HoistInvariants(const Loop &loop) {
+  temp::Temp *fp = reg_manager->FramePointer();
+  std::vector<int> blocks;
+  std::unordered_set<temp::Temp *> defined;
+  bool calls = false;
+  // Stores to frame slots, and whether some store may write a frame where
+  // it is not known
+  std::vector<std::pair<temp::Temp *, int64_t>> stores;
+  bool anywhere = false;
+  for (int b : cfg_.Order()) {
+    if (!loop.blocks.count(b))
+      continue;
+    blocks.push_back(b);
+    Block &block = cfg_.blocks_[b];
+    for (Phi &phi : block.phis)
+      defined.insert(phi.dst);
+    for (tree::Stm *stm : block.stms) {
+      calls |= Calls(stm);
+      temp::Temp *t = DefOf(stm);
+      if (t && !IsRegister(t))
+        defined.insert(t);
+      if (stm->kind_ != tree::Stm::MOVE)
+        continue;
+      tree::Exp *dst = static_cast<tree::MoveStm *>(stm)->dst_;
+      if (dst->kind_ != tree::Exp::MEM)
+        continue;
+      tree::Exp *addr = static_cast<tree::MemExp *>(dst)->exp_;
+      temp::Temp *base;
+      int64_t offset;
+      if (Slot(addr, &base, &offset) && frame_.count(base))
+        stores.emplace_back(base, offset);
+      else
+        anywhere |= AddressesFrame(addr);
+    }
+  }
+
+  auto invariant = [&](tree::Exp *&exp) {
+    bool invariant = true;
+    VisitTemps(exp, [&](tree::Exp *&use) {
+      temp::Temp *t = TempOf(use);
+      invariant &= !defined.count(t) && (t == fp || !IsRegister(t));
+    });
+    return invariant;
+  };
+  // Whether "exp" loads a frame slot the loop leaves alone
+  auto fixed = [&](tree::Exp *exp) {
+    temp::Temp *base;
+    int64_t offset;
+    if (calls || anywhere || exp->kind_ != tree::Exp::MEM ||
+        !Slot(static_cast<tree::MemExp *>(exp)->exp_, &base, &offset) ||
+        (base != fp && !links_.count(base)) || defined.count(base))
+      return false;
+    for (auto &[store_base, store_offset] : stores)
+      if (store_base != base || store_offset == offset)
+        return false;
+    return true;
+  };
+
+  std::vector<tree::Stm *> hoisted;
+  std::map<std::pair<temp::Temp *, int64_t>, temp::Temp *> slots;
+  bool changed = false;
+  // Load the fixed slots "exp" reads in the preheader instead
+  std::function<void(tree::Exp *&)> load = [&](tree::Exp *&exp) {
+    switch (exp->kind_) {
+    case tree::Exp::BINOP:
+      load(static_cast<tree::BinopExp *>(exp)->left_);
+      load(static_cast<tree::BinopExp *>(exp)->right_);
+      return;
+    case tree::Exp::MEM: {
+      load(static_cast<tree::MemExp *>(exp)->exp_);
+      if (!fixed(exp))
+        return;
+      temp::Temp *base;
+      int64_t offset;
+      Slot(static_cast<tree::MemExp *>(exp)->exp_, &base, &offset);
+      temp::Temp *&t = slots[{base, offset}];
+      if (!t) {
+        t = temp::TempFactory::NewTemp();
+        if (tree::HoldsPointer(exp))
+          t->SetPointer();
+        hoisted.push_back(new tree::MoveStm(new tree::TempExp(t), exp));
+      }
+      exp = new tree::TempExp(t);
+      changed = true;
+      return;
+    }
+    default:
+      return;
+    }
+  };
+
+  do {
+    changed = false;
+    for (int b : blocks) {
+      std::vector<tree::Stm *> stms;
+      for (tree::Stm *stm : cfg_.blocks_[b].stms) {
+        temp::Temp *t = DefOf(stm);
+        if (t && !IsRegister(t)) {
+          tree::Exp *&src = static_cast<tree::MoveStm *>(stm)->src_;
+          // Constants and copies cost no more in the loop than out of it
+          if (invariant(src) &&
+              ((src->kind_ == tree::Exp::BINOP && opt::Pure(src)) ||
+               (links_.count(t) && StaticLinkBase(src)) || fixed(src)) &&
+              !(calls && (t->IsPointer() || tainted_.count(t)))) {
+            hoisted.push_back(stm);
+            defined.erase(t);
+            changed = true;
+            continue;
+          }
+          // A load straight into a temp is left for the statement to go
+          if (src->kind_ == tree::Exp::MEM)
+            load(static_cast<tree::MemExp *>(src)->exp_);
+          else
+            load(src);
+        } else if (stm->kind_ == tree::Stm::MOVE) {
+          auto move = static_cast<tree::MoveStm *>(stm);
+          if (move->dst_->kind_ == tree::Exp::MEM)
+            load(static_cast<tree::MemExp *>(move->dst_)->exp_);
+          load(move->src_);
+        } else if (stm->kind_ == tree::Stm::EXP) {
+          load(static_cast<tree::ExpStm *>(stm)->exp_);
+        } else if (stm->kind_ == tree::Stm::CJUMP) {
+          load(static_cast<tree::CjumpStm *>(stm)->left_);
+          load(static_cast<tree::CjumpStm *>(stm)->right_);
+        }
+        stms.push_back(stm);
+      }
+      cfg_.blocks_[b].stms = std::move(stms);
+    }
+  } while (changed);
+  return hoisted;
+}
+
+/**
+ * Replace each i * x in "loop", with i a variable its header steps by a
+ * constant and x invariant, by a variable of its own stepping by that
+ * constant times x, where codegen would multiply with imulq. Indexing an
+ * array multiplies by the word size, which its addressing mode does for
+ * free, so those addresses stay as they are. Returns what starts the new
+ * variables, for the preheader of the loop entered from "entry".
+ */
+std::vector<tree::Stm *> Optimizer::ReduceStrength(const Loop &loop,
+                                                   int entry) {
+  std::vector<tree::Stm *> starts;
+  Block &header = cfg_.blocks_[loop.header];
+  if (header.preds.size() != 2)
+    return starts;
+  int outside = header.PredIndex(entry);
+  int back = 1 - outside;
+
+  FindDefs();
+  struct Induction {
+    tree::Exp *start;
+    int64_t step;
+    tree::Stm *next;
+  };
+  std::unordered_map<temp::Temp *, Induction> inductions;
+  for (Phi &phi : header.phis) {
+    temp::Temp *next = TempOf(phi.args[back]);
+    auto def = next ? defs_.find(next) : defs_.end();
+    if (def == defs_.end() || !def->second.stm || phi.dst->IsPointer())
+      continue;
+    tree::Exp *src = static_cast<tree::MoveStm *>(def->second.stm)->src_;
+    temp::Temp *base;
+    int64_t step;
+    if (src->kind_ == tree::Exp::BINOP && Slot(src, &base, &step) &&
+        base == phi.dst)
+      inductions[phi.dst] = {phi.args[outside], step, def->second.stm};
+  }
+  if (inductions.empty())
+    return starts;
+
+  std::unordered_set<temp::Temp *> defined;
+  for (int b : loop.blocks) {
+    for (Phi &phi : cfg_.blocks_[b].phis)
+      defined.insert(phi.dst);
+    for (tree::Stm *stm : cfg_.blocks_[b].stms)
+      if (temp::Temp *t = DefOf(stm))
+        defined.insert(t);
+  }
+
+  Rename same = [](temp::Temp *t) { return t; };
+  // The statements stepping the new variables, after those stepping theirs
+  std::unordered_map<tree::Stm *, std::vector<tree::Stm *>> steps;
+  std::map<std::pair<temp::Temp *, std::string>, temp::Temp *> reduced;
+  std::function<void(tree::Exp *&)> reduce = [&](tree::Exp *&exp) {
+    switch (exp->kind_) {
+    case tree::Exp::MEM:
+      reduce(static_cast<tree::MemExp *>(exp)->exp_);
+      return;
+    case tree::Exp::CALL:
+      for (auto &arg : static_cast<tree::CallExp *>(exp)->args_->GetNonConstList())
+        reduce(arg);
+      return;
+    case tree::Exp::BINOP:
+      break;
+    default:
+      return;
+    }
+    auto binop = static_cast<tree::BinopExp *>(exp);
+    reduce(binop->left_);
+    reduce(binop->right_);
+    if (binop->op_ != tree::MUL_OP)
+      return;
+    tree::Exp *i = binop->left_;
+    tree::Exp *x = binop->right_;
+    if (!inductions.count(TempOf(i)))
+      std::swap(i, x);
+    auto induction = inductions.find(TempOf(i));
+    if (induction == inductions.end())
+      return;
+
+    std::string key;
+    int64_t step;
+    if (x->kind_ == tree::Exp::CONST) {
+      int64_t c = static_cast<tree::ConstExp *>(x)->consti_;
+      if (ShiftsAndAdds(c) ||
+          !opt::Evaluate(tree::MUL_OP, c, induction->second.step, &step) ||
+          !FitsConst(step))
+        return;
+      key = std::to_string(c);
+    } else {
+      temp::Temp *t = TempOf(x);
+      if (!t || IsRegister(t) || defined.count(t) || t->IsPointer())
+        return;
+      key = "t" + std::to_string(t->Int());
+    }
+
+    temp::Temp *&k = reduced[{TempOf(i), key}];
+    if (!k) {
+      k = temp::TempFactory::NewTemp();
+      temp::Temp *start = temp::TempFactory::NewTemp();
+      temp::Temp *next = temp::TempFactory::NewTemp();
+      starts.push_back(opt::Simplify(new tree::MoveStm(
+          new tree::TempExp(start),
+          new tree::BinopExp(tree::MUL_OP,
+                             Copy(induction->second.start, same),
+                             Copy(x, same)))));
+      tree::Exp *by;
+      if (x->kind_ == tree::Exp::CONST) {
+        by = new tree::ConstExp(static_cast<int>(step));
+      } else {
+        temp::Temp *stride = temp::TempFactory::NewTemp();
+        starts.push_back(opt::Simplify(new tree::MoveStm(
+            new tree::TempExp(stride),
+            new tree::BinopExp(
+                tree::MUL_OP, Copy(x, same),
+                new tree::ConstExp(
+                    static_cast<int>(induction->second.step))))));
+        by = new tree::TempExp(stride);
+      }
+      steps[induction->second.next].push_back(new tree::MoveStm(
+          new tree::TempExp(next),
+          new tree::BinopExp(tree::PLUS_OP, new tree::TempExp(k), by)));
+      std::vector<tree::Exp *> args(2);
+      args[outside] = new tree::TempExp(start);
+      args[back] = new tree::TempExp(next);
+      header.phis.push_back({k, k, std::move(args)});
+    }
+    exp = new tree::TempExp(k);
+  };
+
+  for (int b : loop.blocks) {
+    for (tree::Stm *stm : cfg_.blocks_[b].stms) {
+      if (stm->kind_ == tree::Stm::MOVE) {
+        auto move = static_cast<tree::MoveStm *>(stm);
+        if (move->dst_->kind_ == tree::Exp::MEM)
+          reduce(static_cast<tree::MemExp *>(move->dst_)->exp_);
+        reduce(move->src_);
+      } else if (stm->kind_ == tree::Stm::EXP) {
+        reduce(static_cast<tree::ExpStm *>(stm)->exp_);
+      } else if (stm->kind_ == tree::Stm::CJUMP) {
+        reduce(static_cast<tree::CjumpStm *>(stm)->left_);
+        reduce(static_cast<tree::CjumpStm *>(stm)->right_);
+      }
+    }
+  }
+  if (starts.empty())
+    return starts;
+
+  for (int b : loop.blocks) {
+    std::vector<tree::Stm *> stms;
+    for (tree::Stm *stm : cfg_.blocks_[b].stms) {
+      stms.push_back(stm);
+      auto it = steps.find(stm);
+      if (it != steps.end())
+        stms.insert(stms.end(), it->second.begin(), it->second.end());
+    }
+    cfg_.blocks_[b].stms = std::move(stms);
+  }
+  return starts;
+}
+
+/**
+ * Remove the definitions of temps whose values never reach a store, a
+ * call, a branch or a machine register. Loads stay, as they may fault,
+ * and so do divisions by what may be zero.
+ */
+void Optimizer::EliminateDeadCode() {
+  FindDefs();
+  auto essential = [&](tree::Stm *stm) {
+    temp::Temp *t = DefOf(stm);
+    if (!t || IsRegister(t))
+      return true;
+    return !links_.count(t) &&
+           !opt::Pure(static_cast<tree::MoveStm *>(stm)->src_);
+  };
+
+  std::unordered_set<temp::Temp *> live;
+  std::vector<temp::Temp *> work;
+  auto use = [&](tree::Exp *&exp) {
+    temp::Temp *t = TempOf(exp);
+    if (!IsRegister(t) && live.insert(t).second)
+      work.push_back(t);
+  };
+  for (int b : cfg_.Order())
+    for (tree::Stm *stm : cfg_.blocks_[b].stms)
+      if (essential(stm))
+        VisitUses(stm, use);
+  while (!work.empty()) {
+    auto it = defs_.find(work.back());
+    work.pop_back();
+    if (it == defs_.end())
+      continue;
+    const Def &def = it->second;
+    if (def.stm) {
+      VisitUses(def.stm, use);
+      continue;
+    }
+    for (tree::Exp *&arg : cfg_.blocks_[def.block].phis[def.phi].args)
+      VisitTemps(arg, use);
+  }
+
+  for (int b : cfg_.Order()) {
+    Block &block = cfg_.blocks_[b];
+    std::vector<Phi> phis;
+    for (Phi &phi : block.phis)
+      if (live.count(phi.dst))
+        phis.push_back(std::move(phi));
+    block.phis = std::move(phis);
+    std::vector<tree::Stm *> stms;
+    for (tree::Stm *stm : block.stms)
+      if (essential(stm) || live.count(DefOf(stm)))
+        stms.push_back(stm);
+    block.stms = std::move(stms);
+  }
+}
+
+/**
+ * Turn each phi into moves at the end of its predecessors, splitting the
+ * edges from blocks that branch so that the moves run on that edge only.
+ * The moves of an edge happen at once: when one overwrites a temp another
+ * reads, they all go through fresh temps.
+ */
+void Optimizer::LeaveSsa() {
+  int n = static_cast<int>(cfg_.blocks_.size());
+  for (int b = 0; b < n; b++) {
+    if (cfg_.blocks_[b].dead || cfg_.blocks_[b].phis.empty())
+      continue;
+    std::vector<int> preds = cfg_.blocks_[b].preds;
+    for (int p : preds) {
+      int k = cfg_.blocks_[b].PredIndex(p);
+      std::vector<std::pair<temp::Temp *, tree::Exp *>> copies;
+      std::unordered_set<temp::Temp *> dsts;
+      for (Phi &phi : cfg_.blocks_[b].phis) {
+        if (TempOf(phi.args[k]) != phi.dst) {
+          copies.emplace_back(phi.dst, phi.args[k]);
+          dsts.insert(phi.dst);
+        }
+      }
+      if (copies.empty())
+        continue;
+      bool overlap = false;
+      for (auto &[dst, src] : copies)
+        overlap |= dsts.count(TempOf(src)) > 0;
+
+      std::vector<tree::Stm *> moves;
+      if (overlap) {
+        for (auto &[dst, src] : copies) {
+          temp::Temp *staged = temp::TempFactory::NewTemp();
+          if (dst->IsPointer())
+            staged->SetPointer();
+          moves.push_back(new tree::MoveStm(new tree::TempExp(staged), src));
+          src = new tree::TempExp(staged);
+        }
+      }
+      for (auto &[dst, src] : copies)
+        moves.push_back(new tree::MoveStm(new tree::TempExp(dst), src));
+
+      int at = p;
+      if (cfg_.blocks_[p].Jump()->kind_ == tree::Stm::CJUMP &&
+          !BeforeBranch(p, b, dsts))
+        at = cfg_.SplitEdge(p, b);
+      std::vector<tree::Stm *> &stms = cfg_.blocks_[at].stms;
+      stms.insert(stms.end() - 1, moves.begin(), moves.end());
+    }
+    cfg_.blocks_[b].phis.clear();
+  }
+}
+
+/**
+ * Whether the moves to "dsts" on the edge from "pred" to "succ" may go
+ * before the branch ending "pred", saving a block: the branch must not read
+ * them, nor the phis on its other edges. Each of "dsts" is defined by a phi
+ * of "succ", so no block "succ" does not dominate reads it before passing
+ * that phi again.
+ */
+bool Optimizer::BeforeBranch(int pred, int succ,
+                             const std::unordered_set<temp::Temp *> &dsts) {
+  bool reads = false;
+  auto read = [&](tree::Exp *&exp) { reads |= dsts.count(TempOf(exp)) > 0; };
+  VisitUses(cfg_.blocks_[pred].Jump(), read);
+  for (int s : cfg_.blocks_[pred].succs) {
+    if (s == succ)
+      continue;
+    if (cfg_.Dominates(succ, s))
+      return false;
+    Block &other = cfg_.blocks_[s];
+    int k = other.PredIndex(pred);
+    for (Phi &phi : other.phis)
+      VisitTemps(phi.args[k], read);
+  }
+  return !reads;
+}
+
+} // namespace
+
+namespace opt {
+
+canon::StmListList *Optimize(canon::StmListList *blocks) {
+  return Optimizer(blocks).Run();
+}
+
+} // namespace opt
@@ -8,7 +8,13 @@
 
 class Logger {
 public:
-  explicit Logger(FILE *out = stdout) : out_(out) {}
+  explicit Logger(FILE *out = Output()) : out_(out) {}
+
+  // Where loggers made on the calling thread write, stdout unless redirected
+  static FILE *&Output() {
+    thread_local FILE *out = stdout;
+    return out;
+  }
 
   inline void Log(std::string_view msg, ...) const {
     va_list ap;
@@ -44,7 +50,7 @@ public:
 #ifdef NDEBUG
 #define TigerLog NullLogger().Log
 #else
-#define TigerLog Logger(stdout).Log
+#define TigerLog Logger().Log
 #endif
 
 #endif // TIGER_COMPILER_LOGGER_H
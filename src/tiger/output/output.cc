@@ -1,21 +1,130 @@
 #include "tiger/output/output.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
 
+#include "tiger/optimize/optimize.h"
 #include "tiger/output/logger.h"
+#include "tiger/output/report.h"
+#include "tiger/runtime/gc/heap/heap.h"
+#include "tiger/runtime/gc/roots/roots.h"
+#include "tiger/util/arena.h"
 
 extern frame::RegManager *reg_manager;
 extern frame::Frags *frags;
 
+namespace {
+
+// Section holding the pointer maps, in the layout of gc::PointerMap
+constexpr char ROOTS_SECTION[] = ".section .data.gc_roots,\"aw\",@progbits";
+
+/**
+ * Label the return address of every call in "il" and return the pointer
+ * maps of the calls, to be appended to the roots section
+ */
+std::string PointerMaps(frame::Frame *frame, assem::InstrList *il,
+                        const std::vector<ra::CallSite> &sites) {
+  std::unordered_map<assem::Instr *, const ra::CallSite *> site_of;
+  for (auto &site : sites)
+    site_of[site.call] = &site;
+
+  std::string maps;
+  std::string frame_size = frame->label_->Name() + "_framesize";
+  const auto &list = il->GetList();
+  for (auto it = list.begin(); it != list.end(); ++it) {
+    auto site = site_of.find(*it);
+    if (site == site_of.end())
+      continue;
+    temp::Label *ret = temp::LabelFactory::NewLabel();
+    il->Insert(std::next(it), new assem::LabelInstr(ret->Name(), ret));
+
+    int registers = 0;
+    for (auto &reg : site->second->registers)
+      for (int i = 0; i < gc::CALLEE_SAVED_COUNT; i++)
+        if (reg == gc::CALLEE_SAVED[i])
+          registers |= 1 << i;
+    std::vector<int> slots = site->second->slots;
+    slots.insert(slots.end(), frame->pointer_slots_.begin(),
+                 frame->pointer_slots_.end());
+
+    maps += ".balign 8\n.quad " + ret->Name() + "\n";
+    maps += ".long " + frame_size + ", " +
+            std::to_string(site->second->stack_adjust) + ", " +
+            std::to_string(frame->callee_save_offset_) + "\n";
+    maps += ".short " + std::to_string(registers) + ", " +
+            std::to_string(slots.size()) + "\n";
+    for (int slot : slots)
+      maps += ".long " + std::to_string(slot) + "\n";
+  }
+  if (maps.empty())
+    return maps;
+  return std::string(ROOTS_SECTION) + "\n" + maps + ".text\n";
+}
+
+} // namespace
+
 namespace output {
 void AssemGen::GenAssem(bool need_ra) {
   frame::Frag::OutputPhase phase;
 
   // Output proc
   phase = frame::Frag::Proc;
+  // Every procedure appends the pointer maps of its calls to this table
+  fprintf(out_, "%s\n.globl %s\n.balign 8\n%s:\n", ROOTS_SECTION,
+          gc::GC_ROOTS.c_str(), gc::GC_ROOTS.c_str());
   fprintf(out_, ".text\n");
+  std::vector<frame::Frag *> procs;
   for (auto &&frag : frags->GetList())
-    frag->OutputAssem(out_, phase, need_ra);
+    if (frag->kind_ == frame::Frag::PROC)
+      procs.push_back(frag);
+
+  // Procedures are independent after translation; lower them concurrently.
+  // Each one's assembly and log are buffered and written out in order.
+  std::vector<std::string> buffers(procs.size());
+  std::vector<std::string> logs(procs.size());
+  std::atomic<std::size_t> next(0);
+  auto worker = [&]() {
+    // A fragment's IR and assembly are dead once it is printed
+    arena::Arena arena;
+    for (std::size_t i; (i = next++) < procs.size();) {
+      // Name backend labels after the fragment so that they do not depend
+      // on how fragments are scheduled across threads
+      temp::LabelFactory::Scope labels("L" + std::to_string(i) + "_");
+      char *data = nullptr, *log_data = nullptr;
+      std::size_t size = 0, log_size = 0;
+      FILE *buffer = open_memstream(&data, &size);
+      FILE *log = open_memstream(&log_data, &log_size);
+      Logger::Output() = log;
+      {
+        arena::Arena::Scope scope(&arena);
+        procs[i]->OutputAssem(buffer, phase, need_ra);
+      }
+      Logger::Output() = stdout;
+      arena.Release();
+      fclose(buffer);
+      fclose(log);
+      buffers[i].assign(data, size);
+      logs[i].assign(log_data, log_size);
+      free(data);
+      free(log_data);
+    }
+  };
+  std::vector<std::thread> threads;
+  int thread_count = std::min<std::size_t>(std::max(jobs_, 1), procs.size());
+  for (int i = 1; i < thread_count; i++)
+    threads.emplace_back(worker);
+  worker();
+  for (auto &thread : threads)
+    thread.join();
+  for (std::size_t i = 0; i < procs.size(); i++) {
+    fwrite(logs[i].data(), 1, logs[i].size(), stdout);
+    fwrite(buffers[i].data(), 1, buffers[i].size(), out_);
+  }
+  fprintf(out_, "%s\n.balign 8\n.quad %ld\n", ROOTS_SECTION, gc::END_MARK);
 
   // Output string
   phase = frame::Frag::String;
@@ -37,13 +146,24 @@ void ProcFrag::OutputAssem(FILE *out, OutputPhase phase, bool need_ra) const {
   if (phase != Proc)
     return;
 
+  report::FunctionTimer function_timer(frame_->label_->Name());
+
   TigerLog("-------====IR tree=====-----\n");
   TigerLog(body_);
 
+  tree::Stm *body = body_;
+  if (opt::Enabled()) {
+    report::StepTimer timer(report::OPTIMIZE);
+    TigerLog("-------====Simplify=====-----\n");
+    body = opt::Simplify(body);
+    TigerLog(body);
+  }
+
+  // Canonicalize
+  canon::Canon canon(body);
   {
-    // Canonicalize
+    report::StepTimer timer(report::CANON);
     TigerLog("-------====Canonicalize=====-----\n");
-    canon::Canon canon(body_);
 
     // Linearize to generate canonical trees
     TigerLog("-------====Linearlize=====-----\n");
@@ -54,7 +174,17 @@ void ProcFrag::OutputAssem(FILE *out, OutputPhase phase, bool need_ra) const {
     TigerLog("------====Basic block_=====-------\n");
     canon::StmListList *stm_lists = canon.BasicBlocks();
     TigerLog(stm_lists);
+  }
 
+  if (opt::Enabled()) {
+    report::StepTimer timer(report::OPTIMIZE);
+    TigerLog("-------====Optimize=====-----\n");
+    canon.block_.stm_lists_ = opt::Optimize(canon.block_.stm_lists_);
+    TigerLog(canon.block_.stm_lists_);
+  }
+
+  {
+    report::StepTimer timer(report::CANON);
     // Order basic blocks into traces_
     TigerLog("-------====Trace=====-----\n");
     tree::StmList *stm_traces = canon.TraceSchedule();
@@ -66,6 +196,7 @@ void ProcFrag::OutputAssem(FILE *out, OutputPhase phase, bool need_ra) const {
   temp::Map *color = temp::Map::LayerMap(reg_manager->temp_map_, temp::Map::Name());
   {
     // Lab 5: code generation
+    report::StepTimer timer(report::CODEGEN);
     TigerLog("-------====Code generate=====-----\n");
     cg::CodeGen code_gen(frame_, std::move(traces));
     code_gen.Codegen();
@@ -85,6 +216,11 @@ void ProcFrag::OutputAssem(FILE *out, OutputPhase phase, bool need_ra) const {
     color = temp::Map::LayerMap(reg_manager->temp_map_, allocation->coloring_);
   }
 
+  // Without register allocation there is nothing the collector can walk
+  std::string maps;
+  if (allocation)
+    maps = PointerMaps(frame_, il, allocation->call_sites_);
+
   TigerLog("-------====Output assembly for %s=====-----\n",
            frame_->label_->Name().data());
 
@@ -101,6 +237,21 @@ void ProcFrag::OutputAssem(FILE *out, OutputPhase phase, bool need_ra) const {
   // epilog_
   fprintf(out, "%s", proc->epilog_.data());
   fprintf(out, ".size %s, .-%s\n", proc_name.data(), proc_name.data());
+  fprintf(out, "%s", maps.data());
+}
+
+void DescriptorsFrag::OutputAssem(FILE *out, OutputPhase phase,
+                                  bool need_ra) const {
+  if (phase != String)
+    return;
+
+  fprintf(out, ".globl %s\n.balign 8\n%s:\n", gc::GC_DESCRIPTORS.c_str(),
+          gc::GC_DESCRIPTORS.c_str());
+  for (uint64_t word : words_)
+    fprintf(out, ".quad %lu\n", static_cast<unsigned long>(word));
+  // Leave the symbol something to point at in programs without records
+  if (words_.empty())
+    fprintf(out, ".quad 0\n");
 }
 
 void StringFrag::OutputAssem(FILE *out, OutputPhase phase, bool need_ra) const {
@@ -15,7 +15,11 @@ namespace output {
 class AssemGen {
 public:
   AssemGen() = delete;
-  explicit AssemGen(std::string_view infile) {
+  /**
+   * @param infile source file; assembly goes to infile.s
+   * @param jobs number of threads lowering procedures concurrently
+   */
+  explicit AssemGen(std::string_view infile, int jobs = 1) : jobs_(jobs) {
     std::string outfile = static_cast<std::string>(infile) + ".s";
     out_ = fopen(outfile.data(), "w");
   }
@@ -26,12 +30,14 @@ public:
   ~AssemGen() { fclose(out_); }
 
   /**
-   * Generate assembly
+   * Generate assembly. Procedures are lowered on up to jobs_ threads, each
+   * into its own buffer, and written out in fragment order.
    */
   void GenAssem(bool need_ra);
 
 private:
   FILE *out_; // Instream of source file
+  int jobs_;
 };
 
 } // namespace output
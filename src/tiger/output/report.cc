@@ -0,0 +1,320 @@
+#include "tiger/output/report.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <new>
+#include <sys/resource.h>
+#include <vector>
+
+#include "tiger/util/arena.h"
+
+namespace {
+
+std::atomic<bool> enabled(false);
+
+/* Allocations made through operator new or from arenas, counted only while
+ * enabled. The totals cover every thread; the thread-local counts let a
+ * procedure be charged just for its own allocations. */
+std::atomic<uint64_t> total_allocs(0);
+std::atomic<uint64_t> total_alloc_bytes(0);
+thread_local uint64_t thread_allocs = 0;
+thread_local uint64_t thread_alloc_bytes = 0;
+
+struct PhaseRecord {
+  std::string name;
+  report::Usage usage;
+  long peak_rss_kb;
+};
+
+struct FunctionRecord {
+  std::string name;
+  double start_ms;
+  report::Usage usage;
+  double steps_ms[report::STEP_COUNT];
+  int spill_rounds;
+};
+
+std::mutex records_mutex;
+std::vector<PhaseRecord> phases;
+std::vector<FunctionRecord> functions;
+
+const char *const STEP_NAMES[report::STEP_COUNT] = {
+    "optimize", "canon", "codegen", "liveness", "coloring", "spill"};
+
+double WallMs() {
+  auto now = std::chrono::steady_clock::now().time_since_epoch();
+  return std::chrono::duration<double, std::milli>(now).count();
+}
+
+double CpuMs(clockid_t clock) {
+  timespec ts{};
+  clock_gettime(clock, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+report::Usage ProcessUsage() {
+  report::Usage usage;
+  usage.wall_ms = WallMs();
+  usage.cpu_ms = CpuMs(CLOCK_PROCESS_CPUTIME_ID);
+  usage.allocs = total_allocs.load(std::memory_order_relaxed);
+  usage.alloc_bytes = total_alloc_bytes.load(std::memory_order_relaxed);
+  return usage;
+}
+
+report::Usage ThreadUsage() {
+  report::Usage usage;
+  usage.wall_ms = WallMs();
+  usage.cpu_ms = CpuMs(CLOCK_THREAD_CPUTIME_ID);
+  usage.allocs = thread_allocs;
+  usage.alloc_bytes = thread_alloc_bytes;
+  return usage;
+}
+
+report::Usage Since(const report::Usage &start, const report::Usage &end) {
+  report::Usage usage;
+  usage.wall_ms = end.wall_ms - start.wall_ms;
+  usage.cpu_ms = end.cpu_ms - start.cpu_ms;
+  usage.allocs = end.allocs - start.allocs;
+  usage.alloc_bytes = end.alloc_bytes - start.alloc_bytes;
+  return usage;
+}
+
+// Restart the kernel's peak RSS so that it covers only what follows
+void ResetPeakRss() {
+  if (FILE *f = fopen("/proc/self/clear_refs", "w")) {
+    fputs("5", f);
+    fclose(f);
+  }
+}
+
+// Peak RSS since the last reset, or since startup if resets are not allowed
+long PeakRssKb() {
+  long kb = -1;
+  if (FILE *f = fopen("/proc/self/status", "r")) {
+    char line[256];
+    while (fgets(line, sizeof(line), f))
+      if (sscanf(line, "VmHWM: %ld kB", &kb) == 1)
+        break;
+    fclose(f);
+  }
+  if (kb < 0) {
+    rusage ru{};
+    getrusage(RUSAGE_SELF, &ru);
+    kb = ru.ru_maxrss;
+  }
+  return kb;
+}
+
+void WriteString(FILE *out, std::string_view s) {
+  fputc('"', out);
+  for (char c : s) {
+    if (c == '"' || c == '\\')
+      fprintf(out, "\\%c", c);
+    else if (static_cast<unsigned char>(c) < 0x20)
+      fprintf(out, "\\u%04x", c);
+    else
+      fputc(c, out);
+  }
+  fputc('"', out);
+}
+
+void WriteUsage(FILE *out, const report::Usage &usage) {
+  fprintf(out,
+          "\"wall_ms\": %.3f, \"cpu_ms\": %.3f, \"allocs\": %llu, "
+          "\"alloc_bytes\": %llu",
+          usage.wall_ms, usage.cpu_ms,
+          static_cast<unsigned long long>(usage.allocs),
+          static_cast<unsigned long long>(usage.alloc_bytes));
+}
+
+void CountAlloc(std::size_t size) {
+  thread_allocs++;
+  thread_alloc_bytes += size;
+  total_allocs.fetch_add(1, std::memory_order_relaxed);
+  total_alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+// What every form of operator new below does, nullptr when out of memory
+void *Allocate(std::size_t size, std::size_t align) {
+  if (enabled.load(std::memory_order_relaxed))
+    CountAlloc(size);
+  size = size ? size : 1;
+  if (align <= alignof(std::max_align_t))
+    return std::malloc(size);
+  // aligned_alloc wants a multiple of the alignment
+  return std::aligned_alloc(align, (size + align - 1) / align * align);
+}
+
+void *AllocateOrThrow(std::size_t size, std::size_t align) {
+  if (void *p = Allocate(size, align))
+    return p;
+  throw std::bad_alloc();
+}
+
+} // namespace
+
+/* Every form of new and delete is replaced together, so that none of the
+ * library's is left to free memory it did not allocate */
+void *operator new(std::size_t size) {
+  return AllocateOrThrow(size, alignof(std::max_align_t));
+}
+void *operator new[](std::size_t size) {
+  return AllocateOrThrow(size, alignof(std::max_align_t));
+}
+void *operator new(std::size_t size, std::align_val_t align) {
+  return AllocateOrThrow(size, static_cast<std::size_t>(align));
+}
+void *operator new[](std::size_t size, std::align_val_t align) {
+  return AllocateOrThrow(size, static_cast<std::size_t>(align));
+}
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+  return Allocate(size, alignof(std::max_align_t));
+}
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+  return Allocate(size, alignof(std::max_align_t));
+}
+void *operator new(std::size_t size, std::align_val_t align,
+                   const std::nothrow_t &) noexcept {
+  return Allocate(size, static_cast<std::size_t>(align));
+}
+void *operator new[](std::size_t size, std::align_val_t align,
+                     const std::nothrow_t &) noexcept {
+  return Allocate(size, static_cast<std::size_t>(align));
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+void operator delete(void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept {
+  std::free(p);
+}
+void operator delete[](void *p, std::size_t, std::align_val_t) noexcept {
+  std::free(p);
+}
+void operator delete(void *p, const std::nothrow_t &) noexcept {
+  std::free(p);
+}
+void operator delete[](void *p, const std::nothrow_t &) noexcept {
+  std::free(p);
+}
+void operator delete(void *p, std::align_val_t,
+                     const std::nothrow_t &) noexcept {
+  std::free(p);
+}
+void operator delete[](void *p, std::align_val_t,
+                       const std::nothrow_t &) noexcept {
+  std::free(p);
+}
+
+namespace report {
+
+thread_local FunctionTimer *FunctionTimer::current_ = nullptr;
+
+void Enable() {
+  enabled = true;
+  arena::Arena::Observe(CountAlloc);
+}
+
+bool Enabled() { return enabled.load(std::memory_order_relaxed); }
+
+PhaseTimer::PhaseTimer(std::string name)
+    : name_(std::move(name)), enabled_(Enabled()) {
+  if (!enabled_)
+    return;
+  ResetPeakRss();
+  start_ = ProcessUsage();
+}
+
+PhaseTimer::~PhaseTimer() {
+  if (!enabled_)
+    return;
+  Usage usage = Since(start_, ProcessUsage());
+  long peak = PeakRssKb();
+  std::lock_guard<std::mutex> lock(records_mutex);
+  phases.push_back({std::move(name_), usage, peak});
+}
+
+FunctionTimer::FunctionTimer(std::string name)
+    : name_(std::move(name)), enabled_(Enabled()), outer_(current_) {
+  if (!enabled_)
+    return;
+  start_ = ThreadUsage();
+  current_ = this;
+}
+
+FunctionTimer::~FunctionTimer() {
+  if (!enabled_)
+    return;
+  current_ = outer_;
+  FunctionRecord record;
+  record.name = std::move(name_);
+  record.start_ms = start_.wall_ms;
+  record.usage = Since(start_, ThreadUsage());
+  std::copy(steps_ms_, steps_ms_ + STEP_COUNT, record.steps_ms);
+  record.spill_rounds = spill_rounds_;
+  std::lock_guard<std::mutex> lock(records_mutex);
+  functions.push_back(std::move(record));
+}
+
+void FunctionTimer::SpillRound() {
+  if (current_)
+    current_->spill_rounds_++;
+}
+
+StepTimer::StepTimer(Step step)
+    : step_(step), start_ms_(FunctionTimer::current_ ? WallMs() : 0) {}
+
+StepTimer::~StepTimer() {
+  if (FunctionTimer::current_)
+    FunctionTimer::current_->steps_ms_[step_] += WallMs() - start_ms_;
+}
+
+void Write(FILE *out, std::string_view file, int jobs) {
+  std::lock_guard<std::mutex> lock(records_mutex);
+  // Procedures finish out of order when lowered concurrently
+  std::stable_sort(functions.begin(), functions.end(),
+                   [](const FunctionRecord &a, const FunctionRecord &b) {
+                     return a.start_ms < b.start_ms;
+                   });
+
+  rusage ru{};
+  getrusage(RUSAGE_SELF, &ru);
+  fprintf(out, "{\n  \"file\": ");
+  WriteString(out, file);
+  fprintf(out, ",\n  \"jobs\": %d,\n  \"peak_rss_kb\": %ld,\n", jobs,
+          ru.ru_maxrss);
+
+  fprintf(out, "  \"phases\": [");
+  for (std::size_t i = 0; i < phases.size(); i++) {
+    fprintf(out, "%s\n    {\"name\": ", i ? "," : "");
+    WriteString(out, phases[i].name);
+    fprintf(out, ", ");
+    WriteUsage(out, phases[i].usage);
+    fprintf(out, ", \"peak_rss_kb\": %ld}", phases[i].peak_rss_kb);
+  }
+  fprintf(out, "\n  ],\n");
+
+  fprintf(out, "  \"functions\": [");
+  for (std::size_t i = 0; i < functions.size(); i++) {
+    const FunctionRecord &record = functions[i];
+    fprintf(out, "%s\n    {\"name\": ", i ? "," : "");
+    WriteString(out, record.name);
+    fprintf(out, ", ");
+    WriteUsage(out, record.usage);
+    for (int step = 0; step < STEP_COUNT; step++)
+      fprintf(out, ", \"%s_ms\": %.3f", STEP_NAMES[step],
+              record.steps_ms[step]);
+    fprintf(out, ", \"spill_rounds\": %d}", record.spill_rounds);
+  }
+  fprintf(out, "\n  ]\n}\n");
+}
+
+} // namespace report
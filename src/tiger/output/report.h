@@ -0,0 +1,98 @@
+#ifndef TIGER_COMPILER_REPORT_H
+#define TIGER_COMPILER_REPORT_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+/**
+ * Measurements behind --time-report. Until Enable is called every timer
+ * below does nothing but test a flag.
+ */
+namespace report {
+
+// Work inside one procedure fragment that is timed separately
+enum Step { OPTIMIZE, CANON, CODEGEN, LIVENESS, COLORING, SPILL, STEP_COUNT };
+
+// Resources used over some interval
+struct Usage {
+  double wall_ms = 0;
+  double cpu_ms = 0;
+  // Allocations from the heap and from arenas
+  uint64_t allocs = 0;
+  uint64_t alloc_bytes = 0;
+};
+
+void Enable();
+bool Enabled();
+
+/**
+ * Times one compiler phase, on every thread, from construction to
+ * destruction. Phases must not overlap.
+ */
+class PhaseTimer {
+public:
+  explicit PhaseTimer(std::string name);
+  ~PhaseTimer();
+  PhaseTimer(const PhaseTimer &) = delete;
+  PhaseTimer &operator=(const PhaseTimer &) = delete;
+
+private:
+  std::string name_;
+  bool enabled_;
+  Usage start_;
+};
+
+/**
+ * While alive, steps timed on this thread are charged to the procedure
+ * "name"
+ */
+class FunctionTimer {
+public:
+  explicit FunctionTimer(std::string name);
+  ~FunctionTimer();
+  FunctionTimer(const FunctionTimer &) = delete;
+  FunctionTimer &operator=(const FunctionTimer &) = delete;
+
+  // Count one more round of spilling in the current procedure
+  static void SpillRound();
+
+private:
+  friend class StepTimer;
+  std::string name_;
+  bool enabled_;
+  Usage start_;
+  double steps_ms_[STEP_COUNT] = {};
+  int spill_rounds_ = 0;
+  FunctionTimer *outer_;
+  static thread_local FunctionTimer *current_;
+};
+
+/**
+ * Charges the time from construction to destruction to "step" of the
+ * current procedure, if there is one
+ */
+class StepTimer {
+public:
+  explicit StepTimer(Step step);
+  ~StepTimer();
+  StepTimer(const StepTimer &) = delete;
+  StepTimer &operator=(const StepTimer &) = delete;
+
+private:
+  Step step_;
+  double start_ms_;
+};
+
+/**
+ * Write everything measured so far as one JSON object
+ * @param out where to write
+ * @param file the source file compiled
+ * @param jobs number of backend threads
+ */
+void Write(FILE *out, std::string_view file, int jobs);
+
+} // namespace report
+
+#endif // TIGER_COMPILER_REPORT_H
@@ -1,424 +1,299 @@
 #include "tiger/regalloc/color.h"
 
+#include <algorithm>
+#include <climits>
+
 extern frame::RegManager *reg_manager;
 
 namespace col {
 
 void Color::Paint() {
-  Init();
-  for (auto node : live_graph_.interf_graph->Nodes()->GetList()) {
-    adj_list_[node] = new live::INodeList();
-    degree_[node] = 0;
-  }
   Build();
   MakeWorkList();
-  do {
-    if (!simplify_work_list_->GetList().empty())
+  while (true) {
+    if (!nodes_.Empty(SIMPLIFY))
       Simplify();
-    if (!worklist_moves_->GetList().empty())
+    else if (!moves_.Empty(WORKLIST_MOVE))
       Coalesce();
-    if (!freeze_work_list_->GetList().empty())
+    else if (!nodes_.Empty(FREEZE))
       Freeze();
-    if (!spill_work_list_->GetList().empty())
+    else if (!nodes_.Empty(SPILL))
       SelectSpill();
-  } while (!simplify_work_list_->GetList().empty() || !worklist_moves_->GetList().empty()
-    || !freeze_work_list_->GetList().empty() || !spill_work_list_->GetList().empty());
+    else
+      break;
+  }
   AssignColor();
+
+  std::vector<std::string> colors = reg_manager->Colors();
   result_.coloring = temp::Map::Empty();
-  for (auto tmp : color_) {
-    result_.coloring->Enter(tmp.first, new std::string(tmp.second));
-  }
   result_.spills = new live::INodeList();
-  for (auto node : spilled_nodes_->GetList()) {
-    result_.spills->Fusion(node);
+  for (int n = 0; n < static_cast<int>(node_of_.size()); n++) {
+    temp::Temp *temp = node_of_[n]->NodeInfo();
+    if (StateOf(n) == PRECOLORED)
+      result_.coloring->Enter(
+          temp, new std::string(*reg_manager->temp_map_->Look(temp)));
+    else if (StateOf(n) == SPILLED)
+      result_.spills->Append(node_of_[n]);
+    else if (color_[n] >= 0)
+      result_.coloring->Enter(temp, new std::string(colors[color_[n]]));
   }
 }
 
-void Color::Init() {
-  K = reg_manager->Registers()->GetList().size();
-  precolored_ = new live::INodeList();
-  initial_ = new live::INodeList();
-  simplify_work_list_ = new live::INodeList();
-  freeze_work_list_ = new live::INodeList();
-  spill_work_list_ = new live::INodeList();
-  spilled_nodes_ = new live::INodeList();
-  coalesced_nodes_ = new live::INodeList();
-  colored_nodes_ = new live::INodeList();
-  select_stack_ = new live::INodeList();
-  coalesced_moves_ = new live::MoveList();
-  constrained_moves_ = new live::MoveList();
-  frozen_moves_ = new live::MoveList();
-  worklist_moves_ = new live::MoveList();
-  active_moves_ = new live::MoveList();
-}
-
 void Color::Build() {
-  for (auto ele : live_graph_.moves->GetList()) {
-    live::INodePtr src = ele.first;
-    live::INodePtr dst = ele.second;
-    if (move_list_.find(src) == move_list_.end()) move_list_[src] = new live::MoveList();
-      move_list_[src]->Append(src, dst);
-    if (move_list_.find(dst) == move_list_.end()) move_list_[dst] = new live::MoveList();
-      move_list_[dst]->Append(src, dst);
-  }
-  worklist_moves_ = live_graph_.moves;
-  for (auto node : live_graph_.interf_graph->Nodes()->GetList()) {
-    for (auto adj : node->Adj()->GetList()) {
-      AddEdge(node, adj);
-      degree_[node] = 0;
+  std::vector<std::string> colors = reg_manager->Colors();
+  K = colors.size();
+
+  const auto &nodes = live_graph_.interf_graph->Nodes()->GetList();
+  int node_count = nodes.size();
+  node_of_.assign(nodes.begin(), nodes.end());
+  nodes_.Init(node_count, NODE_STATE_COUNT);
+  select_stack_.clear();
+  select_stack_.reserve(node_count);
+  adj_set_.clear();
+  adj_list_.assign(node_count, {});
+  degree_.assign(node_count, 0);
+  move_list_.assign(node_count, {});
+  alias_.assign(node_count, -1);
+  color_.assign(node_count, -1);
+  mark_.assign(node_count, 0);
+  cost_.assign(node_count, 0);
+
+  for (int n = 0; n < node_count; n++) {
+    std::string *name = reg_manager->temp_map_->Look(node_of_[n]->NodeInfo());
+    if (name) {
+      SetState(n, PRECOLORED);
+      // Precolored nodes have infinite degree
+      degree_[n] = INT_MAX / 2;
+      auto it = std::find(colors.begin(), colors.end(), *name);
+      if (it != colors.end())
+        color_[n] = it - colors.begin();
+    } else {
+      SetState(n, INITIAL);
+      auto cost = spill_cost_.find(node_of_[n]->NodeInfo());
+      if (cost != spill_cost_.end())
+        cost_[n] = cost->second;
     }
   }
-  precolored_->Clear();
-  std::list<temp::Temp *> regs = reg_manager->Registers()->GetList();
-  for (auto node : live_graph_.interf_graph->Nodes()->GetList()) {
-    std::string* name = reg_manager->temp_map_->Look(node->NodeInfo());
-    if (name != NULL)
-      precolored_->Fusion(node);
-  }
-  for (auto node : live_graph_.interf_graph->Nodes()->GetList()) {
-    std::string* name = reg_manager->temp_map_->Look(node->NodeInfo());
-    if (name != NULL)
-      color_[node->NodeInfo()] = *name;
-    else
-      initial_->Fusion(node);
-  }
-}
 
-void Color::MakeWorkList() {
-  for (auto node : initial_->GetList()) {
-    if (degree_[node] >= K)
-      spill_work_list_->Fusion(node);
-    else if (MoveRelated(node))
-      freeze_work_list_->Fusion(node);
-    else
-      simplify_work_list_->Fusion(node);
+  std::size_t edge_count = 0;
+  for (auto node : nodes)
+    edge_count += node->Adj()->GetList().size();
+  adj_set_.reserve(edge_count);
+  for (int n = 0; n < node_count; n++)
+    for (auto adj : node_of_[n]->Adj()->GetList())
+      AddEdge(n, adj->Key());
+
+  const auto &moves = live_graph_.moves->GetList();
+  moves_.Init(moves.size(), MOVE_STATE_COUNT);
+  move_src_.clear();
+  move_dst_.clear();
+  for (auto &move : moves) {
+    int m = move_src_.size();
+    int src = move.first->Key();
+    int dst = move.second->Key();
+    move_src_.push_back(src);
+    move_dst_.push_back(dst);
+    move_list_[src].push_back(m);
+    if (dst != src)
+      move_list_[dst].push_back(m);
+    SetMoveState(m, WORKLIST_MOVE);
   }
-  initial_->Clear();
 }
 
-void Color::Simplify() {
-  if (!(simplify_work_list_->GetList().empty())) {
-    auto node = simplify_work_list_->GetList().front();
-    simplify_work_list_->DeleteNode(node);
-    select_stack_->Append(node);
-    for (auto tmp : Adjacent(node)->GetList()) 
-      DecrementDegree(tmp);
-  }
-}
-
-void Color::Coalesce() {
-  if (worklist_moves_->GetList().empty())
+void Color::AddEdge(int u, int v) {
+  if (u == v || HasEdge(u, v))
     return;
-  auto m = worklist_moves_->GetList().front();
-  live::INodePtr x = m.first;
-  live::INodePtr y = m.second;
-  x = GetAlias(x);
-  y = GetAlias(y);
-  live::INodePtr u = NULL;
-  live::INodePtr v = NULL;
-  if (precolored_->Contain(y)) {
-    u = y;
-    v = x;
-  }
-  else {
-    u = x;
-    v = y;
+  adj_set_.insert(EdgeKey(u, v));
+  adj_set_.insert(EdgeKey(v, u));
+  if (StateOf(u) != PRECOLORED) {
+    adj_list_[u].push_back(v);
+    degree_[u]++;
   }
-  worklist_moves_->Delete(m.first, m.second);
-  if (u == v) {
-    coalesced_moves_->Fusion(m.first, m.second);
-    AddWorkList(u);
-  }
-  else if (precolored_->Contain(v) || adj_set_.find(std::make_pair(u, v)) != adj_set_.end()) {
-    constrained_moves_->Fusion(m.first, m.second);
-    AddWorkList(u);
-    AddWorkList(v);
-  }
-  else {
-    bool flag = true;
-    for (auto t : Adjacent(v)->GetList()) {
-      if (!OK(t, u)) {
-        flag = false;
-        break;
-      }
-    }
-
-    if (precolored_->Contain(u) && flag
-      || !precolored_->Contain(u) && Conservertive(Union(Adjacent(u), Adjacent(v)))) {
-        coalesced_moves_->Fusion(m.first, m.second);
-        Combine(u, v);
-        AddWorkList(u);
-    }
-    else
-      active_moves_->Fusion(m.first, m.second);
+  if (StateOf(v) != PRECOLORED) {
+    adj_list_[v].push_back(u);
+    degree_[v]++;
   }
 }
 
-void Color::Freeze() {
-  if (freeze_work_list_->GetList().empty()) {
-    return;
+void Color::MakeWorkList() {
+  while (!nodes_.Empty(INITIAL)) {
+    int n = nodes_.Head(INITIAL);
+    if (degree_[n] >= K)
+      SetState(n, SPILL);
+    else if (MoveRelated(n))
+      SetState(n, FREEZE);
+    else
+      SetState(n, SIMPLIFY);
   }
-  auto u = freeze_work_list_->GetList().front();
-  freeze_work_list_->DeleteNode(u);
-  simplify_work_list_->Fusion(u);
-  FreezeMoves(u);
 }
 
-void Color::SelectSpill() {
-  live::INodePtr m = NULL;
-
-  for (auto tmp : spill_work_list_->GetList()) {
-    if (not_spill_.find(tmp->NodeInfo()) != not_spill_.end())
-      continue;
-    if (!spilled_nodes_->Contain(tmp) && !precolored_->Contain(tmp)) {
-      m = tmp;
-    }
-  }
-
-  if (!m) m = spill_work_list_->GetList().front();
-  spill_work_list_->DeleteNode(m);
-  simplify_work_list_->Fusion(m);
-  FreezeMoves(m);
+bool Color::MoveRelated(int n) const {
+  bool related = false;
+  ForEachNodeMove(n, [&](int) { related = true; });
+  return related;
 }
 
-void Color::AssignColor() {
-  auto nodes = select_stack_->GetList();
-  while (!nodes.empty()) {
-    auto currentNode = nodes.back();
-    nodes.pop_back();
-
-    std::vector<std::string> availableColors = reg_manager->Colors();
-
-    for (auto adjNode : adj_list_[currentNode]->GetList()) {
-      auto adjNodeAlias = GetAlias(adjNode);
-      if (Union(colored_nodes_, precolored_)->Contain(adjNodeAlias)) {
-        auto adjNodeColor = color_[adjNodeAlias->NodeInfo()];
-        availableColors.erase(
-          std::remove(availableColors.begin(), availableColors.end(), adjNodeColor),
-          availableColors.end()
-        );
-      }
-    }
-
-    if (availableColors.empty()) {
-      spilled_nodes_->Fusion(currentNode);
-    }
-    else {
-      colored_nodes_->Fusion(currentNode);
-      color_[currentNode->NodeInfo()] = availableColors.front();
-    }
-  }
-
-  select_stack_->Clear();
-
-  for (auto coalescedNode : coalesced_nodes_->GetList()) {
-    auto aliasNode = GetAlias(coalescedNode);
-    color_[coalescedNode->NodeInfo()] = color_[aliasNode->NodeInfo()];
-  }
+void Color::Simplify() {
+  int n = nodes_.Head(SIMPLIFY);
+  SetState(n, SELECT);
+  select_stack_.push_back(n);
+  ForEachAdjacent(n, [this](int m) { DecrementDegree(m); });
 }
 
-
-bool Color::Contain(live::INodePtr node, live::INodeListPtr list) {
-  for (auto ele : list->GetList()) {
-    if (ele->NodeInfo() == node->NodeInfo()) {
-      return true;
-    }
+void Color::DecrementDegree(int m) {
+  if (StateOf(m) == PRECOLORED)
+    return;
+  int d = degree_[m]--;
+  if (d == K && StateOf(m) == SPILL) {
+    EnableMoves(m);
+    ForEachAdjacent(m, [this](int t) { EnableMoves(t); });
+    SetState(m, MoveRelated(m) ? FREEZE : SIMPLIFY);
   }
-  return false;
 }
 
-live::INodeListPtr Color::Union(live::INodeListPtr left, live::INodeListPtr right) {
-  live::INodeListPtr result = new live::INodeList();
-  for (auto ele : left->GetList())
-    result->Fusion(ele);
-  for (auto ele : right->GetList())
-    result->Fusion(ele);
-  return result;
+void Color::EnableMoves(int n) {
+  ForEachNodeMove(n, [this](int m) {
+    if (MoveStateOf(m) == ACTIVE_MOVE)
+      SetMoveState(m, WORKLIST_MOVE);
+  });
 }
 
-live::INodeListPtr Color::Sub(live::INodeListPtr left, live::INodeListPtr right) {
-  live::INodeListPtr result = new live::INodeList();
-  for (auto ele : left->GetList()) {
-    if (!Contain(ele, right)) {
-      result->Append(ele);
-    }
+void Color::Coalesce() {
+  int m = moves_.Head(WORKLIST_MOVE);
+  int x = GetAlias(move_src_[m]);
+  int y = GetAlias(move_dst_[m]);
+  int u = x, v = y;
+  if (StateOf(y) == PRECOLORED) {
+    u = y;
+    v = x;
   }
-  return result;
-}
 
-live::INodeListPtr Color::Intersect(live::INodeListPtr left, live::INodeListPtr right) {
-  live::INodeListPtr result = new live::INodeList();
-  for (auto ele : left->GetList()) {
-    if (Contain(ele, right)) {
-      result->Append(ele);
+  if (u == v) {
+    SetMoveState(m, COALESCED_MOVE);
+    AddWorkList(u);
+  } else if (StateOf(v) == PRECOLORED || HasEdge(u, v)) {
+    SetMoveState(m, CONSTRAINED_MOVE);
+    AddWorkList(u);
+    AddWorkList(v);
+  } else {
+    bool can_combine;
+    if (StateOf(u) == PRECOLORED) {
+      // George: every neighbor of v is harmless to u
+      can_combine = true;
+      ForEachAdjacent(v, [&](int t) { can_combine &= OK(t, u); });
+    } else {
+      // Briggs: fewer than K significant neighbors after merging
+      can_combine = Conservative(u, v);
     }
-  }
-  return result;
-}
-
-bool Color::Contain(std::pair<live::INodePtr, live::INodePtr> node, live::MoveList* list) {
-  bool ret = false;
-  for (auto ele : list->GetList()) {
-    if (ele == node) {
-      ret = true;
-      break;
+    if (can_combine) {
+      SetMoveState(m, COALESCED_MOVE);
+      Combine(u, v);
+      AddWorkList(u);
+    } else {
+      SetMoveState(m, ACTIVE_MOVE);
     }
   }
-  return false;
 }
 
-live::MoveList* Color::Union(live::MoveList* left, live::MoveList* right) {
-  live::MoveList* result = new live::MoveList();
-  for (auto ele : left->GetList())
-    result->Fusion(ele.first, ele.second);
-  for (auto ele : right->GetList()) 
-    result->Fusion(ele.first, ele.second);
-  return result;
+void Color::AddWorkList(int u) {
+  if (StateOf(u) == FREEZE && !MoveRelated(u) && degree_[u] < K)
+    SetState(u, SIMPLIFY);
 }
 
-live::MoveList* Color::Intersect(live::MoveList* left, live::MoveList* right) {
-  live::MoveList* result = new live::MoveList();
-  for (auto ele : left->GetList()) {
-    if (Contain(ele, right)) {
-      result->Append(ele.first, ele.second);
-    }
-  }
-  return result;
+bool Color::OK(int t, int r) const {
+  return degree_[t] < K || StateOf(t) == PRECOLORED || HasEdge(t, r);
 }
 
-void Color::AddEdge(live::INodePtr u, live::INodePtr v) {
-  if (adj_set_.find(std::make_pair(u, v)) == adj_set_.end() && u != v) {
-    adj_set_.insert(std::make_pair(u, v));
-    adj_set_.insert(std::make_pair(v, u));
-    if (!precolored_->Contain(u)) {
-      adj_list_[u]->Fusion(v);
-      degree_[u]++;
-    }
-    if (!precolored_->Contain(v)) {
-      adj_list_[v]->Fusion(u);
-      degree_[v]++;
+bool Color::Conservative(int u, int v) {
+  stamp_++;
+  int k = 0;
+  for (int n : {u, v}) {
+    for (int t : adj_list_[n]) {
+      NodeState state = StateOf(t);
+      if (state == SELECT || state == COALESCED || mark_[t] == stamp_)
+        continue;
+      mark_[t] = stamp_;
+      // Stop as soon as the answer is known
+      if (degree_[t] >= K && ++k >= K)
+        return false;
     }
   }
+  return true;
 }
 
-live::INodeListPtr Color::Adjacent(live::INodePtr node) {
-  if (adj_list_.find(node) == adj_list_.end()) {
-    adj_list_[node] = new live::INodeList();
-    return new live::INodeList();
-  }
-  return adj_list_[node]->Diff(Union(select_stack_, coalesced_nodes_));
-}
-
-live::MoveList* Color::NodeMoves(live::INodePtr node) {
-  if (move_list_.find(node) == move_list_.end()) {
-    move_list_[node] = new live::MoveList();
-    return new live::MoveList();
-  }
-  return Intersect(move_list_[node], Union(active_moves_, worklist_moves_));
-}
-
-bool Color::MoveRelated(live::INodePtr node) {
-  bool ret = !(NodeMoves(node)->GetList().empty());
-  return ret;
+int Color::GetAlias(int n) const {
+  while (StateOf(n) == COALESCED)
+    n = alias_[n];
+  return n;
 }
 
-void Color::DecrementDegree(live::INodePtr m) {
-  int d = degree_[m];
-  degree_[m] = d - 1;
-  if (d == K) {
-    live::INodeListPtr list = Adjacent(m);
-    list->Fusion(m);
-    EnableMoves(list);
-    spill_work_list_->DeleteNode(m);
-    if (MoveRelated(m)) freeze_work_list_->Fusion(m);
-    else simplify_work_list_->Fusion(m);
-  }
+void Color::Combine(int u, int v) {
+  SetState(v, COALESCED);
+  alias_[v] = u;
+  move_list_[u].insert(move_list_[u].end(), move_list_[v].begin(),
+                       move_list_[v].end());
+  EnableMoves(v);
+  ForEachAdjacent(v, [&](int t) {
+    AddEdge(t, u);
+    DecrementDegree(t);
+  });
+  if (degree_[u] >= K && StateOf(u) == FREEZE)
+    SetState(u, SPILL);
 }
 
-void Color::EnableMoves(live::INodeListPtr nodes) {
-  for (auto n : nodes->GetList()) {
-    for (auto m : NodeMoves(n)->GetList()) {
-      if (active_moves_->Contain(m.first, m.second)) {
-        active_moves_->Delete(m.first, m.second);
-        worklist_moves_->Fusion(m.first, m.second);
-      }
-    }
-  }
+void Color::Freeze() {
+  int u = nodes_.Head(FREEZE);
+  SetState(u, SIMPLIFY);
+  FreezeMoves(u);
 }
 
-void Color::AddWorkList(live::INodePtr u) {
-  if (!precolored_->Contain(u) && !MoveRelated(u) && degree_[u] < K) {
-    freeze_work_list_->DeleteNode(u);
-    simplify_work_list_->Fusion(u);
-  }
+void Color::FreezeMoves(int u) {
+  ForEachNodeMove(u, [&](int m) {
+    int x = move_src_[m];
+    int y = move_dst_[m];
+    int v = GetAlias(y) == GetAlias(u) ? GetAlias(x) : GetAlias(y);
+    SetMoveState(m, FROZEN_MOVE);
+    if (StateOf(v) == FREEZE && !MoveRelated(v) && degree_[v] < K)
+      SetState(v, SIMPLIFY);
+  });
 }
 
-bool Color::OK(live::INodePtr t, live::INodePtr r) {
-  bool ret = degree_[t] < K || precolored_->Contain(t) || adj_set_.find(std::make_pair(t, r)) != adj_set_.end();
-  return ret;
+void Color::SelectSpill() {
+  // Spill the node whose cost per interference removed is the lowest
+  int m = nodes_.Head(SPILL);
+  for (int n = nodes_.Next(m); n >= 0; n = nodes_.Next(n)) {
+    if (cost_[n] * degree_[m] < cost_[m] * degree_[n] ||
+        (cost_[n] == cost_[m] && degree_[n] > degree_[m]))
+      m = n;
+  }
+  SetState(m, SIMPLIFY);
+  FreezeMoves(m);
 }
 
-bool Color::Conservertive(live::INodeListPtr nodes) {
-  int k = 0;
-  for (auto n : nodes->GetList()) {
-    if (degree_[n] >= K) {
-      k++;
+void Color::AssignColor() {
+  uint64_t all_colors = K >= 64 ? ~uint64_t(0) : (uint64_t(1) << K) - 1;
+  while (!select_stack_.empty()) {
+    int n = select_stack_.back();
+    select_stack_.pop_back();
+
+    uint64_t ok_colors = all_colors;
+    for (int w : adj_list_[n]) {
+      int a = GetAlias(w);
+      NodeState state = StateOf(a);
+      if ((state == COLORED || state == PRECOLORED) && color_[a] >= 0)
+        ok_colors &= ~(uint64_t(1) << color_[a]);
     }
-  }
-  return k < K;
-}
-
-live::INodePtr Color::GetAlias(live::INodePtr n) {
-  if (coalesced_nodes_->Contain(n))
-    return GetAlias(alias_[n]);
-  else
-    return n;
-}
 
-void Color::Combine(live::INodePtr u, live::INodePtr v) {
-  if (freeze_work_list_->Contain(v)) {
-    freeze_work_list_->DeleteNode(v);
-  }
-  else {
-    spill_work_list_->DeleteNode(v);
-  }
-
-  coalesced_nodes_->Fusion(v);
-  alias_[v] = u;
-  move_list_[u] = Union(move_list_[u], move_list_[v]);
-  
-  live::INodeListPtr v_list = new live::INodeList();
-  v_list->Append(v);
-  EnableMoves(v_list);
-
-  for (auto t : Adjacent(v)->GetList()) {
-    AddEdge(t, u);
-    DecrementDegree(t);
-  }
-  if (degree_[u] >= K && freeze_work_list_->Contain(u)) {
-    freeze_work_list_->DeleteNode(u);
-    spill_work_list_->Fusion(u);
-  }
-}
-
-void Color::FreezeMoves(live::INodePtr u) {
-  for (auto m : NodeMoves(u)->GetList()) {
-    live::INodePtr x = m.first;
-    live::INodePtr y = m.second;
-    live::INodePtr v = NULL;
-    if (GetAlias(y) == GetAlias(u)) {
-      v = GetAlias(x);
-    }
-    else {
-      v = GetAlias(y);
-    }
-    active_moves_->Delete(m.first, m.second);
-    frozen_moves_->Fusion(m.first, m.second);
-    if (NodeMoves(v)->GetList().empty() && degree_[v] < K) {
-      freeze_work_list_->DeleteNode(v);
-      simplify_work_list_->Fusion(v);
+    if (!ok_colors) {
+      SetState(n, SPILLED);
+    } else {
+      SetState(n, COLORED);
+      color_[n] = __builtin_ctzll(ok_colors);
     }
   }
+
+  for (int n = nodes_.Head(COALESCED); n >= 0; n = nodes_.Next(n))
+    color_[n] = color_[GetAlias(n)];
 }
 
 } // namespace col
@@ -5,8 +5,10 @@
 #include "tiger/frame/temp.h"
 #include "tiger/liveness/liveness.h"
 #include "tiger/util/graph.h"
-#include <set>
+#include <cstdint>
 #include <map>
+#include <unordered_set>
+#include <vector>
 
 namespace col {
 struct Result {
@@ -17,85 +19,167 @@ struct Result {
   live::INodeListPtr spills;
 };
 
-class Color {
+/**
+ * A family of doubly linked lists threaded through per-element prev/next
+ * arrays. Every element is on exactly one list, so moving an element between
+ * lists and testing its list are O(1) with no allocation.
+ */
+class WorkLists {
 public:
-  explicit Color(live::LiveGraph live_graph, std::set<temp::Temp*> not_spill)
-      : live_graph_(live_graph), not_spill_(not_spill) {}
-  ~Color() {
-    delete coalesced_moves_;
-    delete constrained_moves_;
-    delete frozen_moves_;
-    delete worklist_moves_;
-    delete active_moves_;
+  void Init(int elements, int lists) {
+    head_.assign(lists, -1);
+    prev_.assign(elements, -1);
+    next_.assign(elements, -1);
+    list_.assign(elements, -1);
   }
-  Result GetResult() {
-    return result_;
+
+  [[nodiscard]] int Head(int list) const { return head_[list]; }
+  [[nodiscard]] int Next(int e) const { return next_[e]; }
+  [[nodiscard]] bool Empty(int list) const { return head_[list] < 0; }
+  [[nodiscard]] int ListOf(int e) const { return list_[e]; }
+
+  // Unlink "e" from its current list (if any) and push it onto "list"
+  void Move(int e, int list) {
+    if (list_[e] >= 0) {
+      if (prev_[e] >= 0)
+        next_[prev_[e]] = next_[e];
+      else
+        head_[list_[e]] = next_[e];
+      if (next_[e] >= 0)
+        prev_[next_[e]] = prev_[e];
+    }
+    list_[e] = list;
+    prev_[e] = -1;
+    next_[e] = head_[list];
+    if (head_[list] >= 0)
+      prev_[head_[list]] = e;
+    head_[list] = e;
   }
 
+private:
+  std::vector<int> head_;
+  std::vector<int> prev_;
+  std::vector<int> next_;
+  std::vector<int> list_;
+};
+
+class Color {
+public:
+  /**
+   * @param live_graph interference graph and moves
+   * @param spill_cost estimated cost of spilling each temp; temps not in the
+   * map cost nothing
+   */
+  Color(live::LiveGraph live_graph, std::map<temp::Temp *, double> spill_cost)
+      : live_graph_(live_graph), spill_cost_(std::move(spill_cost)) {}
+  Result GetResult() { return result_; }
+
   void Paint();
-  void Init();
+
+private:
+  /* Every node carries exactly one of these tags, which is also the list it
+   * is threaded on */
+  enum NodeState {
+    PRECOLORED,
+    INITIAL,
+    SIMPLIFY,
+    FREEZE,
+    SPILL,
+    SPILLED,
+    COALESCED,
+    COLORED,
+    SELECT,
+    NODE_STATE_COUNT
+  };
+
+  enum MoveState {
+    COALESCED_MOVE,
+    CONSTRAINED_MOVE,
+    FROZEN_MOVE,
+    WORKLIST_MOVE,
+    ACTIVE_MOVE,
+    MOVE_STATE_COUNT
+  };
+
   void Build();
-  void Freeze();
-  
   void MakeWorkList();
   void Simplify();
   void Coalesce();
-  live::INodeListPtr Adjacent(live::INodePtr node);
-  live::MoveList* NodeMoves(live::INodePtr node);
-  bool MoveRelated(live::INodePtr node);
-  void AddEdge(live::INodePtr, live::INodePtr);
-  void DecrementDegree(live::INodePtr node);
-  void EnableMoves(live::INodeListPtr nodelist);
-  void AddWorkList(live::INodePtr u);
-  bool OK(live::INodePtr t, live::INodePtr r);
-  bool Conservertive(live::INodeListPtr nodes);
-  live::INodePtr GetAlias(live::INodePtr n);
-  void Combine(live::INodePtr u, live::INodePtr v);
-  
-  void FreezeMoves(live::INodePtr u);
+  void Freeze();
   void SelectSpill();
   void AssignColor();
 
-private:
+  void AddEdge(int u, int v);
+  bool HasEdge(int u, int v) const {
+    return adj_set_.count(EdgeKey(u, v)) != 0;
+  }
+  bool MoveRelated(int n) const;
+  void DecrementDegree(int m);
+  void EnableMoves(int n);
+  void AddWorkList(int u);
+  bool OK(int t, int r) const;
+  bool Conservative(int u, int v);
+  int GetAlias(int n) const;
+  void Combine(int u, int v);
+  void FreezeMoves(int u);
+
+  NodeState StateOf(int n) const {
+    return static_cast<NodeState>(nodes_.ListOf(n));
+  }
+  void SetState(int n, NodeState state) { nodes_.Move(n, state); }
+  MoveState MoveStateOf(int m) const {
+    return static_cast<MoveState>(moves_.ListOf(m));
+  }
+  void SetMoveState(int m, MoveState state) { moves_.Move(m, state); }
+
+  // Call f(t) for every t adjacent to "n" that is still in the graph
+  template <typename F> void ForEachAdjacent(int n, F f) const {
+    for (int t : adj_list_[n]) {
+      NodeState state = StateOf(t);
+      if (state != SELECT && state != COALESCED)
+        f(t);
+    }
+  }
+  // Call f(m) for every move of "n" that may still be coalesced
+  template <typename F> void ForEachNodeMove(int n, F f) const {
+    for (int m : move_list_[n]) {
+      MoveState state = MoveStateOf(m);
+      if (state == ACTIVE_MOVE || state == WORKLIST_MOVE)
+        f(m);
+    }
+  }
+
+  static uint64_t EdgeKey(int u, int v) {
+    return (static_cast<uint64_t>(u) << 32) | static_cast<uint32_t>(v);
+  }
+
   Result result_;
   live::LiveGraph live_graph_;
-  fg::FGraphPtr flow_graph_;
-
-  live::INodeListPtr precolored_;
-  live::INodeListPtr initial_;
-
-  live::INodeListPtr simplify_work_list_;
-  live::INodeListPtr freeze_work_list_;
-  live::INodeListPtr spill_work_list_;
-  live::INodeListPtr spilled_nodes_;
-  live::INodeListPtr coalesced_nodes_;
-  live::INodeListPtr colored_nodes_;
-  live::INodeListPtr select_stack_;
-
-  live::MoveList* coalesced_moves_;
-  live::MoveList* constrained_moves_;
-  live::MoveList* frozen_moves_;
-  live::MoveList* worklist_moves_;
-  live::MoveList* active_moves_;
-
-  std::set<std::pair<live::INodePtr, live::INodePtr>> adj_set_;
-  std::map<live::INodePtr, live::INodeListPtr> adj_list_;
-  std::map<live::INodePtr, int> degree_;
-  std::map<live::INodePtr, live::MoveList*> move_list_;
-  std::map<live::INodePtr, live::INodePtr> alias_;
-  std::map<temp::Temp*, std::string> color_;
-  std::set<temp::Temp*> not_spill_;
+  std::map<temp::Temp *, double> spill_cost_;
 
   int K;
+  // Interference graph nodes, indexed by key
+  std::vector<live::INodePtr> node_of_;
 
-private:
-  bool Contain(live::INodePtr node, live::INodeListPtr list);
-  live::INodeListPtr Union(live::INodeListPtr left, live::INodeListPtr right);
-  live::INodeListPtr Sub(live::INodeListPtr left, live::INodeListPtr right);
-  live::INodeListPtr Intersect(live::INodeListPtr left, live::INodeListPtr right);
-  bool Contain(std::pair<live::INodePtr, live::INodePtr> node, live::MoveList* list);
-  live::MoveList* Union(live::MoveList* left, live::MoveList* right);
-  live::MoveList* Intersect(live::MoveList* left, live::MoveList* right);
+  WorkLists nodes_;
+  WorkLists moves_;
+  std::vector<int> select_stack_;
+
+  std::unordered_set<uint64_t> adj_set_;
+  std::vector<std::vector<int>> adj_list_;
+  std::vector<int> degree_;
+  std::vector<std::vector<int>> move_list_;
+  std::vector<int> alias_;
+  // Index into RegManager::Colors(), or -1 if uncolored
+  std::vector<int> color_;
+  std::vector<int> move_src_;
+  std::vector<int> move_dst_;
+  // Spill cost of each node, from spill_cost_
+  std::vector<double> cost_;
+
+  // Scratch marks for Conservative, stamped to avoid clearing
+  std::vector<unsigned> mark_;
+  unsigned stamp_ = 0;
 };
 } // namespace col
 
@@ -1,6 +1,11 @@
 #include "tiger/regalloc/regalloc.h"
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
 #include "tiger/output/logger.h"
+#include "tiger/output/report.h"
 
 extern frame::RegManager *reg_manager;
 
@@ -8,59 +13,393 @@ namespace ra {
 
 void RegAllocator::RegAlloc() {
   spilled_nodes_ = new live::INodeList();
+  {
+    report::StepTimer timer(report::LIVENESS);
+    BuildLiveness();
+  }
   while (true) {
-    fg::FlowGraphFactory flow_graph_factory(assem_instr_.get()->GetInstrList());
-    flow_graph_factory.AssemFlowGraph();
-    flow_graph_ = flow_graph_factory.GetFlowGraph();
-
-    live::LiveGraphFactory live_graph_factory(flow_graph_);
-    live_graph_factory.Liveness();
-    live_graph_ = live_graph_factory.GetLiveGraph();
-
-    col::Color color(live_graph_, not_spill_);
-    color.Paint();
-    auto col_result = color.GetResult();
+    col::Result col_result;
+    {
+      report::StepTimer timer(report::COLORING);
+      FindRematerializable();
+      col::Color color(live_graph_, SpillCosts());
+      color.Paint();
+      col_result = color.GetResult();
+    }
 
     *spilled_nodes_ = *col_result.spills;
-    
+    delete col_result.spills;
+
     if (spilled_nodes_->GetList().empty()) {
       result_ = std::make_unique<ra::Result>(col_result.coloring, assem_instr_.get()->GetInstrList());
+      result_->call_sites_ = CallSites(col_result.coloring);
       break;
     }
     else {
       delete result_->il_;
       delete result_->coloring_;
-      RewriteProgram();
+      report::FunctionTimer::SpillRound();
+      {
+        report::StepTimer timer(report::SPILL);
+        RewriteProgram();
+      }
+      report::StepTimer timer(report::LIVENESS);
+      UpdateLiveness();
     }
   }
 }
 
-void RegAllocator::RewriteProgram() {
-  for (auto& it : spilled_nodes_->GetList()) {
-    auto instr_list = assem_instr_->GetInstrList();
-    auto iter = instr_list->GetList().begin();
+void RegAllocator::BuildLiveness() {
+  fg::FlowGraphFactory flow_graph_factory(assem_instr_.get()->GetInstrList());
+  flow_graph_factory.AssemFlowGraph();
+  flow_graph_ = flow_graph_factory.GetFlowGraph();
 
-    while (iter != instr_list->GetList().end()) {
-      auto instr = *iter;
+  live::LiveGraphFactory live_graph_factory(flow_graph_);
+  live_graph_factory.Liveness();
+  live_graph_ = live_graph_factory.GetLiveGraph();
 
-      if (instr->Use()->Contain(it->NodeInfo()) || instr->Def()->Contain(it->NodeInfo())) {
-        auto new_temp = temp::TempFactory::NewTemp();
-        not_spill_.insert(new_temp);
+  std::vector<int> depth = fg::LoopDepth(flow_graph_);
+  for (auto node : flow_graph_->Nodes()->GetList()) {
+    assem::Instr *instr = node->NodeInfo();
+    live_in_[instr] = live_graph_factory.LiveIn(node);
+    live_out_[instr] = live_graph_factory.LiveOut(node);
+    loop_depth_[instr] = depth[node->Key()];
+  }
+  for (auto node : live_graph_.interf_graph->Nodes()->GetList())
+    temp_node_[node->NodeInfo()] = node;
+}
+
+void RegAllocator::UpdateLiveness() {
+  auto graph = live_graph_.interf_graph;
+  for (auto node : spilled_nodes_->GetList()) {
+    dead_.insert(node->NodeInfo());
+    graph->Isolate(node);
+  }
 
-        instr->Def()->Replace(it->NodeInfo(), new_temp);
-        instr->Use()->Replace(it->NodeInfo(), new_temp);
+  auto moves = new live::MoveList();
+  for (auto &move : live_graph_.moves->GetList()) {
+    if (!dead_.count(move.first->NodeInfo()) &&
+        !dead_.count(move.second->NodeInfo()))
+      moves->Append(move.first, move.second);
+  }
+  delete live_graph_.moves;
+  live_graph_.moves = moves;
 
-        auto move_instr = new assem::OperInstr("movq `s0, (" + frame_->label_->Name() + "_framesize-" + std::to_string(-frame_->s_offset_) + ")(`d0)",
-          new temp::TempList(reg_manager->StackPointer()), new temp::TempList(new_temp), nullptr);
+  // Temps introduced by this rewrite; every edge they take part in is new
+  std::unordered_set<temp::Temp *> fresh;
+  auto node_of = [&](temp::Temp *temp) {
+    auto it = temp_node_.find(temp);
+    if (it != temp_node_.end())
+      return it->second;
+    fresh.insert(temp);
+    return temp_node_[temp] = graph->NewNode(temp);
+  };
+  auto interfere = [&](temp::Temp *a, temp::Temp *b) {
+    if (a == b || (!fresh.count(a) && !fresh.count(b)))
+      return;
+    graph->AddEdge(node_of(a), node_of(b));
+    graph->AddEdge(node_of(b), node_of(a));
+  };
 
-        instr_list->Insert(iter, move_instr);
-        ++iter;
-      } else {
-        ++iter;
-      }
+  auto contains = [](const std::vector<temp::Temp *> &set, temp::Temp *temp) {
+    return std::find(set.begin(), set.end(), temp) != set.end();
+  };
+  auto live = [&](temp::TempList *list) {
+    std::vector<temp::Temp *> set;
+    for (auto temp : list->GetList())
+      if (!dead_.count(temp))
+        set.push_back(temp);
+    return set;
+  };
+  auto publish = [](const std::vector<temp::Temp *> &set) {
+    auto list = new temp::TempList();
+    for (auto temp : set)
+      list->Append(temp);
+    return list;
+  };
+
+  for (auto &rewrite : rewrites_) {
+    for (auto load : rewrite.loads)
+      node_of(load->Def()->GetList().front());
+    for (auto temp : rewrite.instr->Use()->GetList())
+      node_of(temp);
+    for (auto temp : rewrite.instr->Def()->GetList())
+      node_of(temp);
+  }
+
+  for (auto &rewrite : rewrites_) {
+    assem::Instr *instr = rewrite.instr;
+    int depth = loop_depth_[instr];
+    auto &uses = instr->Use()->GetList();
+    auto &defs = instr->Def()->GetList();
+
+    /* Loaded temps are live into the instruction, stored ones out of it */
+    std::vector<temp::Temp *> in = live(live_in_[instr]);
+    std::vector<temp::Temp *> out = live(live_out_[instr]);
+    for (auto temp : uses)
+      if (!contains(in, temp))
+        in.push_back(temp);
+    for (auto temp : defs)
+      if (fresh.count(temp) && !contains(out, temp))
+        out.push_back(temp);
+    live_in_[instr] = publish(in);
+    live_out_[instr] = publish(out);
+
+    bool move = instr->kind_ == assem::Instr::MOVE && !uses.empty();
+    for (auto def : defs) {
+      for (auto temp : out)
+        if (!(move && std::count(uses.begin(), uses.end(), temp)))
+          interfere(def, temp);
+    }
+    if (move && !defs.empty()) {
+      for (auto def : defs)
+        for (auto use : uses)
+          if (fresh.count(def) || fresh.count(use))
+            live_graph_.moves->Append(node_of(use), node_of(def));
+    }
+
+    /* Walk the loads backwards from the instruction's live-in set */
+    std::vector<temp::Temp *> live_set = in;
+    for (auto it = rewrite.loads.rbegin(); it != rewrite.loads.rend(); ++it) {
+      assem::Instr *load = *it;
+      temp::Temp *def = load->Def()->GetList().front();
+      live_out_[load] = publish(live_set);
+      for (auto temp : live_set)
+        interfere(def, temp);
+      live_set.erase(std::remove(live_set.begin(), live_set.end(), def),
+                     live_set.end());
+      for (auto temp : load->Use()->GetList())
+        if (!contains(live_set, temp))
+          live_set.push_back(temp);
+      live_in_[load] = publish(live_set);
+      loop_depth_[load] = depth;
+    }
+
+    /* And the stores forwards from its live-out set */
+    live_set = out;
+    for (auto store : rewrite.stores) {
+      temp::Temp *stored = store->Use()->GetList().front();
+      live_in_[store] = publish(live_set);
+      live_set.erase(std::remove(live_set.begin(), live_set.end(), stored),
+                     live_set.end());
+      live_out_[store] = publish(live_set);
+      loop_depth_[store] = depth;
+    }
+  }
+  rewrites_.clear();
+}
+
+void RegAllocator::FindRematerializable() {
+  std::string frame_address =
+      "leaq " + frame_->label_->Name() + "_framesize(`s0), `d0";
+  std::vector<int> adjust = StackAdjustments();
+  std::map<temp::Temp *, int> defs;
+  remat_.clear();
+
+  int i = 0;
+  for (auto instr : assem_instr_->GetInstrList()->GetList()) {
+    for (auto temp : instr->Def()->GetList())
+      defs[temp]++;
+    if (instr->kind_ == assem::Instr::OPER) {
+      auto oper = static_cast<assem::OperInstr *>(instr);
+      auto &srcs = oper->Use()->GetList();
+      auto &dsts = oper->Def()->GetList();
+      // Constants, and the frame pointer computed where %rsp is unadjusted
+      bool constant = oper->assem_.rfind("movq $", 0) == 0 && srcs.empty();
+      bool frame = oper->assem_ == frame_address && adjust[i] == 0 &&
+                   srcs.size() == 1 &&
+                   srcs.front() == reg_manager->StackPointer();
+      if (dsts.size() == 1 && (constant || frame))
+        remat_[dsts.front()] = oper;
+    }
+    i++;
+  }
+
+  for (auto it = remat_.begin(); it != remat_.end();) {
+    if (defs[it->first] != 1)
+      it = remat_.erase(it);
+    else
+      ++it;
+  }
+}
+
+std::map<temp::Temp *, double> RegAllocator::SpillCosts() {
+  std::map<temp::Temp *, double> cost;
+  for (auto instr : assem_instr_->GetInstrList()->GetList()) {
+    double weight = std::pow(10.0, std::min(loop_depth_[instr], 8));
+    for (auto temp : instr->Use()->GetList())
+      cost[temp] += weight;
+    for (auto temp : instr->Def()->GetList())
+      cost[temp] += weight;
+  }
+
+  for (auto &it : remat_)
+    cost[it.first] /= 2;
+  for (auto temp : not_spill_)
+    cost[temp] = std::numeric_limits<double>::infinity();
+  return cost;
+}
+
+std::vector<int> RegAllocator::StackAdjustments() {
+  std::string push = "subq $" + std::to_string(frame::wordsize) + ", %rsp";
+  std::string pop = "addq $" + std::to_string(frame::wordsize) + ", %rsp";
+  std::vector<int> adjust;
+  int current = 0;
+  for (auto instr : assem_instr_->GetInstrList()->GetList()) {
+    adjust.push_back(current);
+    if (instr->kind_ != assem::Instr::OPER)
+      continue;
+    auto &assem = static_cast<assem::OperInstr *>(instr)->assem_;
+    if (assem == push)
+      current += frame::wordsize;
+    else if (assem == pop)
+      current -= frame::wordsize;
+  }
+  return adjust;
+}
+
+std::vector<CallSite> RegAllocator::CallSites(temp::Map *coloring) {
+  std::vector<CallSite> sites;
+  std::vector<int> adjust = StackAdjustments();
+  int i = 0;
+  for (auto instr : assem_instr_->GetInstrList()->GetList()) {
+    int sp_adjust = adjust[i++];
+    if (instr->kind_ != assem::Instr::OPER ||
+        static_cast<assem::OperInstr *>(instr)->assem_.rfind("callq ", 0) != 0)
+      continue;
+
+    /* Calls are never rewritten by spilling, so their live-out sets still
+     * name the spilled temps, whose slots now hold the values */
+    CallSite site{instr, sp_adjust, {}, {}};
+    for (auto temp : live_out_[instr]->GetList()) {
+      if (!temp->IsPointer())
+        continue;
+      auto slot = spill_slots_.find(temp);
+      if (slot != spill_slots_.end())
+        site.slots.push_back(slot->second);
+      else if (!dead_.count(temp))
+        site.registers.push_back(*coloring->Look(temp));
     }
+    sites.push_back(std::move(site));
   }
+  return sites;
 }
 
+std::string RegAllocator::FrameSlot(int offset, int adjust) {
+  std::string slot = frame_->label_->Name() + "_framesize";
+  int disp = offset + adjust;
+  if (disp > 0)
+    slot += "+" + std::to_string(disp);
+  else if (disp < 0)
+    slot += std::to_string(disp);
+  return slot;
+}
+
+void RegAllocator::RewriteProgram() {
+  temp::Temp *sp = reg_manager->StackPointer();
+  std::set<temp::Temp *> spilled;
+  std::map<temp::Temp *, int> slot;
+  for (auto node : spilled_nodes_->GetList()) {
+    temp::Temp *temp = node->NodeInfo();
+    spilled.insert(temp);
+    if (remat_.count(temp))
+      continue;
+    // The slot at s_offset_ already holds the last callee-saved register
+    frame_->s_offset_ -= frame::wordsize;
+    slot[temp] = frame_->s_offset_;
+    spill_slots_[temp] = frame_->s_offset_;
+  }
+
+  std::vector<int> adjust = StackAdjustments();
+  auto instr_list = new assem::InstrList();
+  int i = 0;
+  for (auto instr : assem_instr_->GetInstrList()->GetList()) {
+    int sp_adjust = adjust[i++];
+    auto uses = instr->Use();
+    auto defs = instr->Def();
+
+    bool touched = false;
+    bool remat_def = false;
+    for (auto temp : uses->GetList())
+      touched |= spilled.count(temp) != 0;
+    for (auto temp : defs->GetList()) {
+      touched |= spilled.count(temp) != 0;
+      remat_def |= spilled.count(temp) && remat_.count(temp) &&
+                   remat_[temp] == instr;
+    }
+    // The definition of a rematerialized temp is dropped
+    if (remat_def)
+      continue;
+    if (!touched) {
+      instr_list->Append(instr);
+      continue;
+    }
+
+    /* Give every spilled temp of this instruction a fresh short-lived temp,
+     * loaded before the instruction and stored after it */
+    std::map<temp::Temp *, temp::Temp *> renamed;
+    // Spilled temps in order of first appearance, which keeps the output
+    // independent of heap layout
+    std::vector<temp::Temp *> order;
+    auto rename = [&](temp::TempList *list) {
+      auto res = new temp::TempList();
+      for (auto temp : list->GetList()) {
+        if (!spilled.count(temp)) {
+          res->Append(temp);
+          continue;
+        }
+        if (!renamed.count(temp)) {
+          order.push_back(temp);
+          renamed[temp] = temp::TempFactory::NewTemp();
+          not_spill_.insert(renamed[temp]);
+        }
+        res->Append(renamed[temp]);
+      }
+      return res;
+    };
+
+    Rewrite rewrite{instr, {}, {}};
+    auto new_uses = rename(uses);
+    for (auto temp : order) {
+      auto dst = new temp::TempList(renamed[temp]);
+      assem::Instr *load;
+      if (!remat_.count(temp))
+        load = new assem::OperInstr(
+            "movq " + FrameSlot(slot[temp], sp_adjust) + "(`s0), `d0", dst,
+            new temp::TempList(sp), nullptr);
+      else if (remat_[temp]->Use()->GetList().empty())
+        load = new assem::OperInstr(remat_[temp]->assem_, dst, nullptr, nullptr);
+      else
+        load = new assem::OperInstr(
+            "leaq " + FrameSlot(0, sp_adjust) + "(`s0), `d0", dst,
+            new temp::TempList(sp), nullptr);
+      instr_list->Append(load);
+      rewrite.loads.push_back(load);
+    }
+
+    auto new_defs = rename(defs);
+    if (instr->kind_ == assem::Instr::OPER) {
+      static_cast<assem::OperInstr *>(instr)->src_ = new_uses;
+      static_cast<assem::OperInstr *>(instr)->dst_ = new_defs;
+    } else if (instr->kind_ == assem::Instr::MOVE) {
+      static_cast<assem::MoveInstr *>(instr)->src_ = new_uses;
+      static_cast<assem::MoveInstr *>(instr)->dst_ = new_defs;
+    }
+    instr_list->Append(instr);
+
+    for (auto temp : defs->GetList()) {
+      if (!slot.count(temp))
+        continue;
+      auto store = new assem::OperInstr(
+          "movq `s0, " + FrameSlot(slot[temp], sp_adjust) + "(`s1)", nullptr,
+          new temp::TempList({renamed[temp], sp}), nullptr);
+      instr_list->Append(store);
+      rewrite.stores.push_back(store);
+    }
+    rewrites_.push_back(std::move(rewrite));
+  }
+
+  assem_instr_ = std::make_unique<cg::AssemInstr>(instr_list);
+}
 
-} // namespace ra
\ No newline at end of file
+} // namespace ra
@@ -9,12 +9,32 @@
 #include "tiger/regalloc/color.h"
 #include "tiger/util/graph.h"
 
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
 namespace ra {
 
+/**
+ * The heap pointers live across one call, for the collector's pointer maps
+ */
+struct CallSite {
+  assem::Instr *call;
+  // Bytes pushed on the stack for the call
+  int stack_adjust;
+  // Registers holding the pointers, by name
+  std::vector<std::string> registers;
+  // Offsets of spill slots holding the pointers
+  std::vector<int> slots;
+};
+
 class Result {
 public:
   temp::Map *coloring_;
   assem::InstrList *il_;
+  std::vector<CallSite> call_sites_;
 
   Result() : coloring_(nullptr), il_(nullptr) {}
   Result(temp::Map *coloring, assem::InstrList *il)
@@ -30,6 +50,13 @@ class RegAllocator {
 public:
   RegAllocator(frame::Frame* frame, std::unique_ptr<cg::AssemInstr> assem_instr)
   : frame_(frame), assem_instr_(std::move(assem_instr)), result_(new Result()) {};
+  // The graphs are only needed while allocating
+  ~RegAllocator() {
+    delete flow_graph_;
+    delete live_graph_.interf_graph;
+    delete live_graph_.moves;
+    delete spilled_nodes_;
+  }
   
   std::unique_ptr<ra::Result> TransferResult() {
     return std::move(result_);
@@ -38,14 +65,59 @@ public:
   void RegAlloc();
   void RewriteProgram();
 private:
+  // Build the flowgraph, liveness and interference graph from scratch
+  void BuildLiveness();
+  /**
+   * Patch liveness and the interference graph after RewriteProgram. Spilling
+   * only removes the spilled temps and adds temps that live within one
+   * rewritten instruction and its loads and stores, so every other live set
+   * and edge is still valid.
+   */
+  void UpdateLiveness();
+  /**
+   * Estimate the cost of spilling each temp: every use and def is weighted
+   * by 10^(loop depth). Rematerializable temps cost half, and temps created
+   * by earlier spills are never worth spilling again.
+   */
+  std::map<temp::Temp *, double> SpillCosts();
+  // Find temps whose only definition can be recomputed anywhere cheaply
+  void FindRematerializable();
+  // Net amount %rsp has been lowered by at every instruction
+  std::vector<int> StackAdjustments();
+  // Address of the frame slot at "offset" when %rsp is lowered by "adjust"
+  std::string FrameSlot(int offset, int adjust);
+  // Where the pointer temps live across each call ended up
+  std::vector<CallSite> CallSites(temp::Map *coloring);
+
   frame::Frame* frame_;
   std::unique_ptr<ra::Result> result_;
   std::unique_ptr<cg::AssemInstr> assem_instr_;
   live::LiveGraph live_graph_;
-  fg::FGraphPtr flow_graph_;
+  fg::FGraphPtr flow_graph_ = nullptr;
 
-  live::INodeListPtr spilled_nodes_;
+  live::INodeListPtr spilled_nodes_ = nullptr;
   std::set<temp::Temp*> not_spill_;
+  // Frame offsets of the temps spilled so far
+  std::map<temp::Temp *, int> spill_slots_;
+  // Rematerializable temps, mapped to their defining instruction
+  std::map<temp::Temp *, assem::OperInstr *> remat_;
+
+  // An instruction touched by RewriteProgram, with the spill code around it
+  struct Rewrite {
+    assem::Instr *instr;
+    std::vector<assem::Instr *> loads;
+    std::vector<assem::Instr *> stores;
+  };
+  std::vector<Rewrite> rewrites_;
+
+  /* Liveness kept across spill rounds. Live sets are only patched where
+   * RewriteProgram touched the code, so they may still mention temps in
+   * dead_, which have been spilled and no longer appear anywhere */
+  std::unordered_map<assem::Instr *, temp::TempList *> live_in_;
+  std::unordered_map<assem::Instr *, temp::TempList *> live_out_;
+  std::unordered_map<assem::Instr *, int> loop_depth_;
+  std::unordered_map<temp::Temp *, live::INodePtr> temp_node_;
+  std::unordered_set<temp::Temp *> dead_;
 };
 
 } // namespace ra
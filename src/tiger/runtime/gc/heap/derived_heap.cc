@@ -1,9 +1,424 @@
 #include "derived_heap.h"
 #include <stdio.h>
 #include <stack>
+#include <algorithm>
+#include <cstdlib>
 #include <cstring>
+#include <sys/mman.h>
+#include <thread>
+
+GcCards GLOBAL_GC_CARDS;
+GcAlloc GLOBAL_GC_ALLOC;
 
 namespace gc {
-// TODO(lab7): You need to implement those interfaces inherited from TigerHeap correctly according to your design.
-} // namespace gc
 
+namespace {
+
+uint64_t RoundUp(uint64_t size, uint64_t unit = TigerHeap::WORD_SIZE) {
+  return (size + unit - 1) & ~(unit - 1);
+}
+
+// Reserve "bytes" of zeroed memory, committed page by page as it is touched
+void *Map(uint64_t bytes) {
+  void *p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (p == MAP_FAILED) {
+    fprintf(stderr, "Cannot reserve a Tiger heap of %lu bytes\n",
+            static_cast<unsigned long>(bytes));
+    exit(-1);
+  }
+  return p;
+}
+
+} // namespace
+
+DerivedHeap::~DerivedHeap() {
+  munmap(base_, reserved_);
+  munmap(starts_, starts_bytes_);
+  munmap(cards_, card_count_ * WORD_SIZE);
+  delete threads_;
+  delete[] workers_;
+}
+
+char *DerivedHeap::NurseryLimit() const {
+  return nursery_ + std::min(nursery_size_, space_size_ - OldUsed());
+}
+
+char *DerivedHeap::Allocate(uint64_t size) {
+  return Allocate(size, MakeHeader(UNTYPED, RoundUp(size)));
+}
+
+char *DerivedHeap::Allocate(uint64_t size, uint64_t header) {
+  // Nothing bigger fits even when grown, and its rounded size could wrap
+  if (size > policy_.max_size)
+    return nullptr;
+  uint64_t need = WORD_SIZE + RoundUp(size);
+  char *obj = TryAllocate(need);
+  // Grow rather than fail right after a full collection
+  if (!obj && may_grow_ && space_size_ < policy_.max_size) {
+    while (space_size_ < policy_.max_size && MaxFree() < need + nursery_size_)
+      space_size_ = std::min(space_size_ * 2, policy_.max_size);
+    PublishLimit();
+    obj = TryAllocate(need);
+  }
+  may_grow_ = false;
+  if (obj) {
+    *Header(obj) = header;
+    if (InOld(reinterpret_cast<uint64_t>(obj)))
+      SetStart(obj);
+  }
+  return obj;
+}
+
+char *DerivedHeap::TryAllocate(uint64_t need) {
+  char *obj;
+  if (need <= nursery_size_ / 4) {
+    if (need > static_cast<uint64_t>(NurseryLimit() - nursery_top_))
+      return nullptr;
+    obj = nursery_top_ + WORD_SIZE;
+    nursery_top_ += need;
+  } else {
+    // Large objects go straight to the old generation. Their cards start
+    // dirty, since they are filled in before the next young collection.
+    if (need > MaxFree())
+      return nullptr;
+    obj = old_top_ + WORD_SIZE;
+    old_top_ += need;
+    old_allocated_ += need;
+    DirtyCards(obj, old_top_);
+    PublishLimit();
+  }
+  return obj;
+}
+
+uint64_t DerivedHeap::Used() const { return OldUsed() + NurseryUsed(); }
+
+uint64_t DerivedHeap::MaxFree() const {
+  return space_size_ - OldUsed() - NurseryUsed();
+}
+
+void DerivedHeap::Initialize(uint64_t size) {
+  nursery_size_ = RoundUp(std::max(size / 8, CARD_SIZE), CARD_SIZE);
+  space_size_ = initial_size_ = RoundUp(size, CARD_SIZE);
+  policy_.max_size =
+      RoundUp(std::max(policy_.max_size, space_size_), CARD_SIZE);
+  reserved_ = nursery_size_ + 2 * policy_.max_size;
+  base_ = static_cast<char *>(Map(reserved_));
+  nursery_ = nursery_top_ = base_;
+  old_ = old_top_ = base_ + nursery_size_;
+  old_to_ = old_ + policy_.max_size;
+
+  starts_bytes_ = (reserved_ / WORD_SIZE / 64 + 1) * WORD_SIZE;
+  starts_ = static_cast<uint64_t *>(Map(starts_bytes_));
+  // The masked card numbers of a contiguous reservation never collide
+  card_count_ = 1;
+  while (card_count_ < reserved_ / CARD_SIZE)
+    card_count_ *= 2;
+  cards_ = static_cast<uint64_t *>(Map(card_count_ * WORD_SIZE));
+  GLOBAL_GC_CARDS.table = cards_;
+  GLOBAL_GC_CARDS.mask = card_count_ - 1;
+  PublishLimit();
+
+  if (policy_.threads > 1) {
+    threads_ = new GcThreads(policy_.threads);
+    workers_ = new Worker[policy_.threads];
+  }
+}
+
+void DerivedHeap::Resize() {
+  uint64_t size = space_size_;
+  while (size < policy_.max_size &&
+         OldUsed() * 100 > size * policy_.grow_percent)
+    size = std::min(size * 2, policy_.max_size);
+  while (size > initial_size_ &&
+         OldUsed() * 100 < size * policy_.shrink_percent)
+    size = std::max(RoundUp(size / 2, CARD_SIZE), initial_size_);
+
+  // Give the pages beyond a shrunk old generation back to the system
+  if (size < space_size_) {
+    madvise(old_ + size, space_size_ - size, MADV_DONTNEED);
+    madvise(old_to_ + size, space_size_ - size, MADV_DONTNEED);
+  }
+  space_size_ = size;
+}
+
+uint64_t &DerivedHeap::Card(char *p) {
+  return cards_[(reinterpret_cast<uintptr_t>(p) >> CARD_SHIFT) &
+                (card_count_ - 1)];
+}
+
+void DerivedHeap::ClearCards(char *begin, char *end) {
+  for (char *p = begin; p < end; p += CARD_SIZE)
+    Card(p) = 0;
+}
+
+void DerivedHeap::DirtyCards(char *begin, char *end) {
+  char *first = base_ + (begin - base_) / CARD_SIZE * CARD_SIZE;
+  for (char *p = first; p < end; p += CARD_SIZE)
+    Card(p) = 1;
+}
+
+bool DerivedHeap::IsObject(uint64_t word) const {
+  if (!InNursery(word) && (young_only_ || !InOld(word)))
+    return false;
+  if (word % WORD_SIZE)
+    return false;
+  uint64_t index = (word - reinterpret_cast<uint64_t>(base_)) / WORD_SIZE;
+  return starts_[index / 64] >> (index % 64) & 1;
+}
+
+void DerivedHeap::FindObjects(char *from, char *to) {
+  ClearStarts(from, to);
+  for (char *p = from; p < to; p += WORD_SIZE + SizeOf(*Header(p + WORD_SIZE)))
+    SetStart(p + WORD_SIZE);
+}
+
+void DerivedHeap::ClearStarts(char *from, char *to) {
+  // A card is a whole word of the bitmap
+  std::fill(starts_ + (from - base_) / CARD_SIZE,
+            starts_ + RoundUp(to - base_, CARD_SIZE) / CARD_SIZE, 0);
+}
+
+void DerivedHeap::SetStart(char *obj) {
+  uint64_t index = (obj - base_) / WORD_SIZE;
+  starts_[index / 64] |= uint64_t(1) << (index % 64);
+}
+
+char *DerivedHeap::ObjectAt(char *p) const {
+  uint64_t index = (p - base_) / WORD_SIZE;
+  uint64_t word = index / 64;
+  uint64_t bits = starts_[word] & (~uint64_t(0) >> (63 - index % 64));
+  uint64_t first = (old_ - base_) / CARD_SIZE;
+  while (!bits && word > first)
+    bits = starts_[--word];
+  if (!bits)
+    return old_ + WORD_SIZE;
+  return base_ + (word * 64 + 63 - __builtin_clzll(bits)) * WORD_SIZE;
+}
+
+uint64_t DerivedHeap::Forward(uint64_t word) {
+  if (!IsObject(word))
+    return word;
+  char *obj = reinterpret_cast<char *>(word);
+  uint64_t header = *Header(obj);
+  if (header & FORWARDED)
+    return header & ~FORWARDED;
+
+  uint64_t size = SizeOf(header);
+  char *copy = copy_top_ + WORD_SIZE;
+  memcpy(copy_top_, Header(obj), WORD_SIZE + size);
+  copy_top_ += WORD_SIZE + size;
+  SetStart(copy);
+  survivors_++;
+  if (InNursery(word))
+    promoted_ += WORD_SIZE + size;
+  *Header(obj) = reinterpret_cast<uint64_t>(copy) | FORWARDED;
+  return reinterpret_cast<uint64_t>(copy);
+}
+
+void DerivedHeap::Scan(char *scan) {
+  // Cheney scan: the space between "scan" and copy_top_ is the gray queue
+  while (scan < copy_top_) {
+    char *obj = scan + WORD_SIZE;
+    ForEachPointer(obj, [this](uint64_t *slot) { *slot = Forward(*slot); });
+    scan = obj + SizeOf(*Header(obj));
+  }
+}
+
+bool DerivedHeap::Parallel() const {
+  if (!threads_ || Used() < PARALLEL_MIN)
+    return false;
+  // Unlike a serial copy, a parallel one leaves gaps at the ends of the
+  // buffers, so it may outgrow space_size_ within the reserved to-space
+  uint64_t gaps = Used() / 32 + 2 * threads_->Count() * LAB_SIZE;
+  return Used() + gaps <= policy_.max_size;
+}
+
+void DerivedHeap::ParallelCopy() {
+  int count = threads_->Count();
+  for (int id = 0; id < count; id++) {
+    workers_[id].lab = workers_[id].lab_end = nullptr;
+    workers_[id].survivors = workers_[id].promoted = 0;
+  }
+  shared_top_ = copy_top_;
+  idle_ = 0;
+  roots_->ForEach(
+      [this](uint64_t *slot) { *slot = Forward(workers_[0], *slot); });
+  threads_->Run([this](int id) { Drain(id); });
+
+  for (int id = 0; id < count; id++) {
+    Retire(workers_[id]);
+    survivors_ += workers_[id].survivors;
+    promoted_ += workers_[id].promoted;
+  }
+  copy_top_ = shared_top_;
+}
+
+uint64_t DerivedHeap::Forward(Worker &worker, uint64_t word) {
+  if (!IsObject(word))
+    return word;
+  char *obj = reinterpret_cast<char *>(word);
+  uint64_t *header = Header(obj);
+  // Claim the object, or wait for the thread that did to copy it
+  uint64_t value = __atomic_load_n(header, __ATOMIC_ACQUIRE);
+  for (;;) {
+    if (value == BUSY)
+      value = __atomic_load_n(header, __ATOMIC_ACQUIRE);
+    else if (value & FORWARDED)
+      return value & ~FORWARDED;
+    else if (__atomic_compare_exchange_n(header, &value, BUSY, false,
+                                         __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+      break;
+  }
+
+  uint64_t size = SizeOf(value);
+  char *space = CopySpace(worker, WORD_SIZE + size);
+  *reinterpret_cast<uint64_t *>(space) = value;
+  memcpy(space + WORD_SIZE, obj, size);
+  char *copy = space + WORD_SIZE;
+  // Neighbouring copies share words of the bitmap
+  uint64_t index = (copy - base_) / WORD_SIZE;
+  __atomic_fetch_or(&starts_[index / 64], uint64_t(1) << (index % 64),
+                    __ATOMIC_RELAXED);
+  __atomic_store_n(header, reinterpret_cast<uint64_t>(copy) | FORWARDED,
+                   __ATOMIC_RELEASE);
+  worker.survivors++;
+  if (InNursery(word))
+    worker.promoted += WORD_SIZE + size;
+  worker.gray.Push(copy);
+  return reinterpret_cast<uint64_t>(copy);
+}
+
+char *DerivedHeap::CopySpace(Worker &worker, uint64_t bytes) {
+  uint64_t left = worker.lab_end - worker.lab;
+  if (bytes > left) {
+    // Big objects, and small ones that would waste a lot of the buffer,
+    // go straight to the shared top
+    if (bytes > LAB_SIZE / 4 || left >= LAB_WASTE)
+      return shared_top_.fetch_add(bytes);
+    Retire(worker);
+    worker.lab = shared_top_.fetch_add(LAB_SIZE);
+    worker.lab_end = worker.lab + LAB_SIZE;
+  }
+  char *space = worker.lab;
+  worker.lab += bytes;
+  return space;
+}
+
+void DerivedHeap::Retire(Worker &worker) {
+  // Keep to-space a sequence of objects for the card scan
+  if (worker.lab < worker.lab_end)
+    *reinterpret_cast<uint64_t *>(worker.lab) =
+        MakeHeader(BYTES, worker.lab_end - worker.lab - WORD_SIZE);
+  worker.lab = worker.lab_end;
+}
+
+void DerivedHeap::Drain(int id) {
+  Worker &worker = workers_[id];
+  char *obj;
+  do {
+    while (worker.gray.Pop(&obj) || Steal(id, &obj))
+      ForEachPointer(obj, [this, &worker](uint64_t *slot) {
+        *slot = Forward(worker, *slot);
+      });
+  } while (!Terminate());
+}
+
+bool DerivedHeap::Steal(int id, char **obj) {
+  int count = threads_->Count();
+  for (int i = 1; i < count; i++)
+    if (workers_[(id + i) % count].gray.Steal(obj))
+      return true;
+  return false;
+}
+
+bool DerivedHeap::Terminate() {
+  // A thread only goes idle with an empty deque and never pushes while
+  // idle, so once all of them are idle there is no work left anywhere
+  int count = threads_->Count();
+  idle_++;
+  for (;;) {
+    if (idle_ == count)
+      return true;
+    for (int id = 0; id < count; id++) {
+      if (!workers_[id].gray.Empty()) {
+        idle_--;
+        return false;
+      }
+    }
+    std::this_thread::yield();
+  }
+}
+
+void DerivedHeap::Record(bool young, double start, uint64_t allocated,
+                         uint64_t copied) {
+  stats_->Record({young, start, stats_->Now() - start, allocated, copied,
+                  survivors_, promoted_, Used(),
+                  nursery_size_ + 2 * space_size_});
+}
+
+void DerivedHeap::YoungGC() {
+  double start = stats_ ? stats_->Now() : 0;
+  uint64_t allocated = Allocated();
+  survivors_ = promoted_ = old_allocated_ = 0;
+  FindObjects(nursery_, nursery_top_);
+  young_only_ = true;
+  char *promoted = old_top_;
+  copy_top_ = old_top_;
+  roots_->ForEach([this](uint64_t *slot) { *slot = Forward(*slot); });
+
+  // Old objects written since the last collection may point into the
+  // nursery
+  for (char *card = old_; card < promoted; card += CARD_SIZE) {
+    if (!Card(card))
+      continue;
+    Card(card) = 0;
+    char *end = std::min(card + CARD_SIZE, promoted);
+    for (char *obj = ObjectAt(card); obj - WORD_SIZE < end;
+         obj += SizeOf(*Header(obj)) + WORD_SIZE)
+      ForEachPointer(obj, card, end,
+                     [this](uint64_t *slot) { *slot = Forward(*slot); });
+  }
+  Scan(promoted);
+
+  old_top_ = copy_top_;
+  nursery_top_ = nursery_;
+  young_only_ = false;
+  ClearCards(nursery_, nursery_ + nursery_size_);
+  PublishLimit();
+  if (stats_)
+    Record(true, start, allocated, old_top_ - promoted);
+
+  // Collect the old generation too once it cannot take a full nursery
+  if (space_size_ - OldUsed() < nursery_size_)
+    GC();
+}
+
+void DerivedHeap::GC() {
+  double start = stats_ ? stats_->Now() : 0;
+  uint64_t allocated = Allocated();
+  survivors_ = promoted_ = old_allocated_ = 0;
+  FindObjects(nursery_, nursery_top_);
+  copy_top_ = old_to_;
+  if (Parallel()) {
+    ParallelCopy();
+  } else {
+    roots_->ForEach([this](uint64_t *slot) { *slot = Forward(*slot); });
+    Scan(old_to_);
+  }
+
+  ClearCards(nursery_, nursery_ + nursery_size_);
+  ClearCards(old_, old_top_);
+  ClearStarts(old_, old_top_);
+  std::swap(old_, old_to_);
+  old_top_ = copy_top_;
+  nursery_top_ = nursery_;
+  space_size_ = std::max(space_size_, RoundUp(OldUsed(), CARD_SIZE));
+  Resize();
+  may_grow_ = true;
+  PublishLimit();
+  if (stats_)
+    Record(false, start, allocated, OldUsed());
+}
+
+} // namespace gc
@@ -1,13 +1,250 @@
 #pragma once
 
+#include <algorithm>
+
 #include "heap.h"
-#include <vector>
+#include "../roots/roots.h"
+#include "../parallel/parallel.h"
+#include "../stats/stats.h"
 
 namespace gc {
 
+/**
+ * How a DerivedHeap sizes its old generation. After a full collection the
+ * old generation doubles while it is fuller than grow_percent and halves,
+ * down to its initial size, while it is emptier than shrink_percent.
+ */
+struct HeapPolicy {
+  // Largest size the old generation may grow to, 0 for its initial size
+  uint64_t max_size = 0;
+  int grow_percent = 50;
+  int shrink_percent = 10;
+  // Threads copying in parallel during a full collection
+  int threads = 1;
+};
+
+/**
+ * Generational copying collector. Small objects are bump allocated in a
+ * nursery; a young collection copies the survivors into the old generation,
+ * finding them from the roots and from the dirty cards of the old
+ * generation, so its cost is proportional to the surviving young data. The
+ * old generation is a pair of semispaces, collected by a full Cheney copy of
+ * both generations when it runs low. With more than one thread, a full
+ * collection of a big heap copies in parallel: each thread copies into its
+ * own buffer in to-space, and keeps the copies it has yet to scan in a
+ * work-stealing deque, from which idle threads take work.
+ *
+ * Objects carry the typed headers of heap.h, so the collector only visits
+ * the words that hold pointers and skips pointer-free payloads. During a
+ * collection the header of a copied object holds the address of its copy
+ * instead, tagged with FORWARDED. A bitmap of object starts in the old
+ * generation lets a young collection find the objects on a dirty card.
+ *
+ * The heap is one mmap reservation laid out as nursery, old from-space, old
+ * to-space, each old space reserved at the maximum size, so the old
+ * generation grows and shrinks in place. The old generation always has room
+ * for the whole nursery, so that neither kind of collection can run out of
+ * space while copying.
+ */
 class DerivedHeap : public TigerHeap {
-  // TODO(lab7): You need to implement those interfaces inherited from TigerHeap correctly according to your design.
+public:
+  explicit DerivedHeap(Roots *roots, HeapPolicy policy = {})
+      : roots_(roots), policy_(policy) {}
+  ~DerivedHeap();
+
+  char *Allocate(uint64_t size) override;
+  char *Allocate(uint64_t size, uint64_t header) override;
+  uint64_t Used() const override;
+  uint64_t MaxFree() const override;
+  void Initialize(uint64_t size) override;
+  void GC() override;
+  void YoungGC() override;
+
+  // Use the record descriptors of the program, GLOBAL_GC_DESCRIPTORS
+  void SetDescriptors(const uint64_t *descriptors) {
+    descriptors_ = descriptors;
+  }
+  // Record every collection in "stats" from now on
+  void Observe(Stats *stats) { stats_ = stats; }
+  // Bytes allocated since the last collection
+  uint64_t Allocated() const { return NurseryUsed() + old_allocated_; }
+
+private:
+  static constexpr uint64_t FORWARDED = 1;
+  // Header of an object some thread is copying in a parallel collection,
+  // which no kind of header or forwarding address can be
+  static constexpr uint64_t BUSY = FORWARDED;
+  // Each thread copies into buffers of LAB_SIZE bytes, and gives up on one
+  // when less than LAB_WASTE bytes are left in it
+  static constexpr uint64_t LAB_SIZE = 32 << 10;
+  static constexpr uint64_t LAB_WASTE = 512;
+  // Smaller heaps are not worth waking the threads for
+  static constexpr uint64_t PARALLEL_MIN = 1 << 20;
+
+  // What each thread of a parallel collection owns
+  struct Worker {
+    // Copied objects it has yet to scan
+    WorkDeque<char *> gray;
+    // Its local allocation buffer in to-space
+    char *lab = nullptr;
+    char *lab_end = nullptr;
+    uint64_t survivors = 0;
+    uint64_t promoted = 0;
+  };
+
+  // Address of the header of the object whose payload starts at "obj"
+  static uint64_t *Header(char *obj) {
+    return reinterpret_cast<uint64_t *>(obj) - 1;
+  }
+  // Payload size in bytes of an object with the unforwarded "header"
+  uint64_t SizeOf(uint64_t header) const {
+    uint64_t value = header >> HEADER_SHIFT;
+    switch (header & HEADER_KIND_MASK) {
+    case RECORD:
+      return descriptors_[value] * WORD_SIZE;
+    case INT_ARRAY:
+    case POINTER_ARRAY:
+      return value * WORD_SIZE;
+    default:
+      return (value + WORD_SIZE - 1) & ~(WORD_SIZE - 1);
+    }
+  }
+
+  // Call "f" on each slot of the object "obj" that may hold a pointer and
+  // lies in [begin, end)
+  template <typename F>
+  void ForEachPointer(char *obj, char *begin, char *end, F f) const {
+    uint64_t header = *Header(obj);
+    if (end <= obj)
+      return;
+    auto slot = reinterpret_cast<uint64_t *>(obj);
+    uint64_t first = begin > obj ? (begin - obj) / WORD_SIZE : 0;
+    uint64_t last =
+        std::min<uint64_t>(SizeOf(header), end - obj) / WORD_SIZE;
+    switch (header & HEADER_KIND_MASK) {
+    case RECORD: {
+      const uint64_t *bitmap = descriptors_ + (header >> HEADER_SHIFT) + 1;
+      for (uint64_t i = first; i < last; i++)
+        if (bitmap[i / 64] >> (i % 64) & 1)
+          f(slot + i);
+      break;
+    }
+    case UNTYPED:
+    case POINTER_ARRAY:
+      for (uint64_t i = first; i < last; i++)
+        f(slot + i);
+      break;
+    default:
+      break;
+    }
+  }
+  template <typename F> void ForEachPointer(char *obj, F f) const {
+    ForEachPointer(obj, obj, obj + SizeOf(*Header(obj)), f);
+  }
+
+  bool InNursery(uint64_t word) const {
+    return word > reinterpret_cast<uint64_t>(nursery_) &&
+           word <= reinterpret_cast<uint64_t>(nursery_top_);
+  }
+  bool InOld(uint64_t word) const {
+    return word > reinterpret_cast<uint64_t>(old_) &&
+           word <= reinterpret_cast<uint64_t>(old_top_);
+  }
+  uint64_t OldUsed() const { return old_top_ - old_; }
+  uint64_t NurseryUsed() const { return nursery_top_ - nursery_; }
+  // Where nursery allocation has to stop for the nursery to fit in old
+  char *NurseryLimit() const;
+  // Let Tiger code allocate inline up to the current NurseryLimit
+  void PublishLimit() { GLOBAL_GC_ALLOC.limit = NurseryLimit(); }
+
+  char *TryAllocate(uint64_t need);
+  // Resize the old generation by the policy, after a full collection
+  void Resize();
+  // Report a collection that started at "start" to stats_
+  void Record(bool young, double start, uint64_t allocated, uint64_t copied);
+  bool IsObject(uint64_t word) const;
+  // Rebuild the object starts of the card-aligned "from" up to "to"
+  void FindObjects(char *from, char *to);
+  // Clear the object starts of the card-aligned "from" up to "to"
+  void ClearStarts(char *from, char *to);
+  void SetStart(char *obj);
+  // The last object of the old generation starting at or before "p", or
+  // the first one if there is none
+  char *ObjectAt(char *p) const;
+  uint64_t Forward(uint64_t word);
+  // Forward every word of the objects from "scan" up to copy_top_
+  void Scan(char *scan);
+
+  // Whether the next full collection should copy in parallel
+  bool Parallel() const;
+  // Copy everything reachable into to-space from copy_top_ on, in parallel
+  void ParallelCopy();
+  uint64_t Forward(Worker &worker, uint64_t word);
+  // Claim "bytes" of to-space for "worker"
+  char *CopySpace(Worker &worker, uint64_t bytes);
+  // Fill the rest of the buffer of "worker" with a dead object
+  void Retire(Worker &worker);
+  // Scan the gray objects of thread "id" and steal more until all run out
+  void Drain(int id);
+  bool Steal(int id, char **obj);
+  // Whether every thread has run out of gray objects
+  bool Terminate();
+  // The card of the address "p"
+  uint64_t &Card(char *p);
+  // Clear the cards of the card-aligned range [begin, end)
+  void ClearCards(char *begin, char *end);
+  // Mark the cards spanning [begin, end) dirty
+  void DirtyCards(char *begin, char *end);
+
+  Roots *roots_;
+  HeapPolicy policy_;
+  const uint64_t *descriptors_ = nullptr;
+  char *base_ = nullptr;
+  uint64_t reserved_ = 0;
+  uint64_t nursery_size_ = 0;
+  // Current and initial size of each old space, which is reserved at
+  // policy_.max_size
+  uint64_t space_size_ = 0;
+  uint64_t initial_size_ = 0;
+  // Set by a full collection until the next allocation, which may then grow
+  // the old generation instead of failing
+  bool may_grow_ = false;
+  char *nursery_ = nullptr;
+  // Shared with the inline allocation of Tiger code
+  char *&nursery_top_ = GLOBAL_GC_ALLOC.top;
+  char *old_ = nullptr;
+  char *old_top_ = nullptr;
+  char *old_to_ = nullptr;
+  // Next free byte of the space being copied into
+  char *copy_top_ = nullptr;
+  // Whether the collection in progress only moves nursery objects
+  bool young_only_ = false;
+
+  Stats *stats_ = nullptr;
+  // Allocated straight into the old generation since the last collection
+  uint64_t old_allocated_ = 0;
+  // Objects copied by the collection in progress, and bytes of them copied
+  // out of the nursery
+  uint64_t survivors_ = 0;
+  uint64_t promoted_ = 0;
+
+  // Null when collecting on the calling thread only
+  GcThreads *threads_ = nullptr;
+  Worker *workers_ = nullptr;
+  // Next free byte of to-space in a parallel collection
+  std::atomic<char *> shared_top_{nullptr};
+  // Threads that have run out of gray objects
+  std::atomic<int> idle_{0};
+  // One bit per word of the reservation, set where a payload starts. It is
+  // kept exact for the old generation and rebuilt for the nursery by every
+  // collection.
+  uint64_t *starts_ = nullptr;
+  // One word per card of the reservation, nonzero when the card is dirty,
+  // indexed by card number modulo its power-of-two size. Both tables are
+  // mapped lazily and only touched where the heap is in use.
+  uint64_t *cards_ = nullptr;
+  uint64_t card_count_ = 0;
+  uint64_t starts_bytes_ = 0;
 };
 
 } // namespace gc
-
@@ -15,9 +15,79 @@ extern uint64_t GLOBAL_GC_ROOTS;
   sp = ((uint64_t*)((*(uint64_t*)rbp) + sizeof(uint64_t))); \
 } while(0)
 
+/*
+ * Card table of the write barrier. After writing a heap pointer into a record
+ * or an array at address "a", Tiger code stores a nonzero word to
+ * GLOBAL_GC_CARDS.table[(a >> CARD_SHIFT) & GLOBAL_GC_CARDS.mask]. A heap
+ * without a barrier leaves the mask zero and points the table at one word.
+ */
+struct GcCards {
+  uint64_t *table;
+  uint64_t mask;
+};
+extern GcCards GLOBAL_GC_CARDS;
+
+/*
+ * Where Tiger code bump allocates inline: it claims [top, top + 8 + size)
+ * if that ends at or below limit, writing the payload size to the first
+ * word, and calls the runtime otherwise. A heap without a nursery leaves
+ * both null.
+ */
+struct GcAlloc {
+  char *top;
+  char *limit;
+};
+extern GcAlloc GLOBAL_GC_ALLOC;
+
+// Record descriptors of the program, see gc::RECORD
+extern uint64_t GLOBAL_GC_DESCRIPTORS;
+
 namespace gc {
 
 constexpr long END_MARK = 0;
+const std::string GC_CARDS = "GLOBAL_GC_CARDS";
+const std::string GC_ALLOC = "GLOBAL_GC_ALLOC";
+const std::string GC_DESCRIPTORS = "GLOBAL_GC_DESCRIPTORS";
+constexpr int CARD_SHIFT = 9;
+constexpr uint64_t CARD_SIZE = uint64_t(1) << CARD_SHIFT;
+
+/*
+ * Every heap object is preceded by a one-word header, (value << HEADER_SHIFT)
+ * | kind, telling the collector its size and which of its words are
+ * pointers. The kinds are even, leaving bit 0 to the collector. The value
+ * is:
+ * - UNTYPED: the payload size in bytes. Every word may be a pointer.
+ * - RECORD: the word index in GLOBAL_GC_DESCRIPTORS of the descriptor of
+ *   the record, which is its number of fields followed by a bitmap of its
+ *   pointer fields, one word per 64 fields.
+ * - INT_ARRAY and POINTER_ARRAY: the number of elements.
+ * - BYTES: the payload size in bytes, holding no pointers.
+ */
+constexpr int HEADER_SHIFT = 4;
+enum HeaderKind : uint64_t {
+  UNTYPED = 0,
+  RECORD = 2,
+  INT_ARRAY = 4,
+  POINTER_ARRAY = 6,
+  BYTES = 8,
+};
+constexpr uint64_t HEADER_KIND_MASK = (uint64_t(1) << HEADER_SHIFT) - 1;
+
+/*
+ * Every program's first descriptor is that of the rope nodes of runtime
+ * strings: a word holding the length, then two pointers
+ */
+constexpr int ROPE_DESCRIPTOR = 0;
+
+/*
+ * The most elements an array may have. The byte size and header of a
+ * longer one could overflow, and it would not fit in any heap anyway.
+ */
+constexpr int64_t MAX_ARRAY_LENGTH = INT32_MAX;
+
+constexpr uint64_t MakeHeader(HeaderKind kind, uint64_t value) {
+  return value << HEADER_SHIFT | kind;
+}
 
 class TigerHeap {
 public:
@@ -30,6 +100,14 @@ public:
    */
   virtual char *Allocate(uint64_t size) = 0;
 
+  /**
+   * Allocate an object described by "header", built by MakeHeader, whose
+   * payload is "size" bytes. A heap that keeps no types ignores it.
+   */
+  virtual char *Allocate(uint64_t size, uint64_t /*header*/) {
+    return Allocate(size);
+  }
+
   /**
    * Acquire the total allocated space from heap.
    * Hint: If you implement a contigous heap, you could simply calculate the distance between top and bottom,
@@ -64,6 +142,11 @@ public:
    */
   virtual void GC() = 0;
 
+  /**
+   * Collect the young generation only, in a generational heap.
+   */
+  virtual void YoungGC() { GC(); }
+
   static constexpr uint64_t WORD_SIZE = 8;
 };
 
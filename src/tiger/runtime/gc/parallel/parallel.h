@@ -0,0 +1,177 @@
+#ifndef TIGER_RUNTIME_GC_PARALLEL_H
+#define TIGER_RUNTIME_GC_PARALLEL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace gc {
+
+/**
+ * Chase-Lev work-stealing deque. Its owner pushes and pops at the bottom,
+ * and any other thread may steal from the top. The ring grows when full;
+ * outgrown rings are kept until the deque dies, since a thief may still be
+ * reading one.
+ */
+template <typename T> class WorkDeque {
+public:
+  WorkDeque() : ring_(new Ring(LOG_INITIAL)) { rings_.emplace_back(ring_); }
+
+  void Push(T item) {
+    int64_t bottom = bottom_.load(std::memory_order_relaxed);
+    int64_t top = top_.load(std::memory_order_acquire);
+    Ring *ring = ring_.load(std::memory_order_relaxed);
+    if (bottom - top >= ring->Size()) {
+      ring = ring->Grow(top, bottom);
+      rings_.emplace_back(ring);
+      ring_.store(ring, std::memory_order_release);
+    }
+    ring->Put(bottom, item);
+    bottom_.store(bottom + 1, std::memory_order_release);
+  }
+
+  bool Pop(T *item) {
+    int64_t bottom = bottom_.load(std::memory_order_relaxed) - 1;
+    Ring *ring = ring_.load(std::memory_order_relaxed);
+    bottom_.store(bottom, std::memory_order_seq_cst);
+    int64_t top = top_.load(std::memory_order_seq_cst);
+    if (top > bottom) {
+      bottom_.store(bottom + 1, std::memory_order_relaxed);
+      return false;
+    }
+    *item = ring->Get(bottom);
+    if (top < bottom)
+      return true;
+    // Last item: race the thieves for it
+    bool won = top_.compare_exchange_strong(top, top + 1,
+                                            std::memory_order_seq_cst);
+    bottom_.store(bottom + 1, std::memory_order_relaxed);
+    return won;
+  }
+
+  bool Steal(T *item) {
+    int64_t top = top_.load(std::memory_order_seq_cst);
+    int64_t bottom = bottom_.load(std::memory_order_seq_cst);
+    if (top >= bottom)
+      return false;
+    *item = ring_.load(std::memory_order_acquire)->Get(top);
+    return top_.compare_exchange_strong(top, top + 1,
+                                        std::memory_order_seq_cst);
+  }
+
+  bool Empty() const {
+    return top_.load(std::memory_order_acquire) >=
+           bottom_.load(std::memory_order_acquire);
+  }
+
+private:
+  static constexpr int LOG_INITIAL = 10;
+
+  class Ring {
+  public:
+    explicit Ring(int log) : mask_((int64_t(1) << log) - 1), log_(log),
+                             items_(new std::atomic<T>[mask_ + 1]) {}
+    int64_t Size() const { return mask_ + 1; }
+    T Get(int64_t i) const {
+      return items_[i & mask_].load(std::memory_order_relaxed);
+    }
+    void Put(int64_t i, T item) {
+      items_[i & mask_].store(item, std::memory_order_relaxed);
+    }
+    // A ring twice the size holding the items in [top, bottom)
+    Ring *Grow(int64_t top, int64_t bottom) const {
+      Ring *ring = new Ring(log_ + 1);
+      for (int64_t i = top; i < bottom; i++)
+        ring->Put(i, Get(i));
+      return ring;
+    }
+
+  private:
+    int64_t mask_;
+    int log_;
+    std::unique_ptr<std::atomic<T>[]> items_;
+  };
+
+  std::atomic<int64_t> top_{0};
+  std::atomic<int64_t> bottom_{0};
+  std::atomic<Ring *> ring_;
+  std::vector<std::unique_ptr<Ring>> rings_;
+};
+
+/**
+ * A fixed pool of collector threads, asleep between collections. Run hands
+ * a task to all of them, the calling thread included as number 0.
+ */
+class GcThreads {
+public:
+  explicit GcThreads(int count) : count_(count) {
+    for (int id = 1; id < count; id++)
+      threads_.emplace_back([this, id] { Serve(id); });
+  }
+
+  ~GcThreads() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto &thread : threads_)
+      thread.join();
+  }
+
+  int Count() const { return count_; }
+
+  // Run "task(id)" for every id in [0, Count()) and wait for all of them
+  void Run(const std::function<void(int)> &task) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      task_ = &task;
+      running_ = count_ - 1;
+      epoch_++;
+    }
+    wake_.notify_all();
+    task(0);
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this] { return running_ == 0; });
+    task_ = nullptr;
+  }
+
+private:
+  void Serve(int id) {
+    uint64_t seen = 0;
+    for (;;) {
+      const std::function<void(int)> *task;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        wake_.wait(lock, [&] { return stop_ || epoch_ != seen; });
+        if (stop_)
+          return;
+        seen = epoch_;
+        task = task_;
+      }
+      (*task)(id);
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (--running_ == 0)
+        done_.notify_one();
+    }
+  }
+
+  int count_;
+  std::vector<std::thread> threads_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+  const std::function<void(int)> *task_ = nullptr;
+  uint64_t epoch_ = 0;
+  int running_ = 0;
+  bool stop_ = false;
+};
+
+} // namespace gc
+
+#endif // TIGER_RUNTIME_GC_PARALLEL_H
@@ -1,17 +1,126 @@
 #ifndef TIGER_RUNTIME_GC_ROOTS_H
 #define TIGER_RUNTIME_GC_ROOTS_H
 
+#include <cstdint>
 #include <iostream>
+#include <unordered_map>
+#include <vector>
 
 namespace gc {
 
 const std::string GC_ROOTS = "GLOBAL_GC_ROOTS";
 
+/**
+ * Callee-saved registers, in the order the prologue saves them below the
+ * callee-save offset of a frame and the order of bits in a register mask
+ */
+const char *const CALLEE_SAVED[] = {"%r12", "%r13", "%r14",
+                                    "%r15", "%rbp", "%rbx"};
+constexpr int CALLEE_SAVED_COUNT = 6;
 
+/**
+ * Where the runtime entry stubs push each callee-saved register, in words
+ * above the stack pointer they record. The return address into Tiger code
+ * follows them.
+ */
+constexpr int STUB_SAVED[CALLEE_SAVED_COUNT] = {3, 2, 1, 0, 5, 4};
+constexpr int STUB_WORDS = CALLEE_SAVED_COUNT;
+
+/**
+ * The pointer map of one call site. The compiler emits one after the
+ * GC_ROOTS label for every call in Tiger code, each 8-byte aligned and
+ * followed by its slot offsets, and ends the table with a zero word.
+ * Offsets are from the frame pointer, the address of the frame's return
+ * address.
+ */
+struct PointerMap {
+  uint64_t return_address;
+  int32_t frame_size;
+  // Bytes pushed on the stack for the call
+  int32_t stack_adjust;
+  int32_t callee_save_offset;
+  // Callee-saved registers holding pointers, by index in CALLEE_SAVED
+  uint16_t registers;
+  // Frame slots holding pointers
+  uint16_t slot_count;
+
+  const int32_t *Slots() const {
+    return reinterpret_cast<const int32_t *>(this + 1);
+  }
+  const PointerMap *Next() const {
+    auto end = reinterpret_cast<uintptr_t>(Slots() + slot_count);
+    return reinterpret_cast<const PointerMap *>((end + 7) & ~uintptr_t(7));
+  }
+};
+
+/**
+ * Finds the heap pointers held by active Tiger frames. Starting from the
+ * innermost frame, each return address selects a pointer map, which tells
+ * where the frame is and which of its slots and callee-saved registers
+ * hold pointers at that call. A register is found where the next frame
+ * in, or the runtime stub, saved it. The walk ends at the first return
+ * address without a map, which is in the C code that called tigermain.
+ */
 class Roots {
-  // Todo(lab7): define some member and methods here to keep track of gc roots;
+public:
+  // Index the table of pointer maps starting at "table"
+  void Load(const uint64_t *table) {
+    auto map = reinterpret_cast<const PointerMap *>(table);
+    for (; map->return_address; map = map->Next())
+      maps_[map->return_address] = map;
+  }
+
+  // Stack pointer recorded by a runtime stub called from Tiger code
+  void SetTop(uint64_t *top) { top_ = top; }
+
+  /**
+   * Treat the word at "slot", in the runtime's own frame, as a root until
+   * the matching Release
+   */
+  void Hold(uint64_t *slot) { held_.push_back(slot); }
+  void Release() { held_.pop_back(); }
+
+  /**
+   * Call "visit" with the address of each word that holds a heap pointer.
+   * It may store a new value through the address.
+   */
+  template <typename Visit> void ForEach(Visit &&visit) const {
+    for (uint64_t *slot : held_)
+      visit(slot);
+
+    uint64_t *saved[CALLEE_SAVED_COUNT];
+    for (int i = 0; i < CALLEE_SAVED_COUNT; i++)
+      saved[i] = top_ + STUB_SAVED[i];
+
+    uint64_t *return_slot = top_ + STUB_WORDS;
+    for (;;) {
+      auto it = maps_.find(*return_slot);
+      if (it == maps_.end())
+        break;
+      const PointerMap *map = it->second;
+      char *fp = reinterpret_cast<char *>(return_slot + 1) +
+                 map->stack_adjust + map->frame_size;
+
+      for (int i = 0; i < map->slot_count; i++)
+        visit(reinterpret_cast<uint64_t *>(fp + map->Slots()[i]));
+      for (int i = 0; i < CALLEE_SAVED_COUNT; i++)
+        if (map->registers >> i & 1)
+          visit(saved[i]);
+
+      // This frame saved its caller's registers on entry
+      for (int i = 0; i < CALLEE_SAVED_COUNT; i++)
+        saved[i] = reinterpret_cast<uint64_t *>(fp + map->callee_save_offset) -
+                   (i + 1);
+      return_slot = reinterpret_cast<uint64_t *>(fp);
+    }
+  }
+
+private:
+  std::unordered_map<uint64_t, const PointerMap *> maps_;
+  uint64_t *top_ = nullptr;
+  std::vector<uint64_t *> held_;
 };
 
 }
 
-#endif // TIGER_RUNTIME_GC_ROOTS_H
\ No newline at end of file
+#endif // TIGER_RUNTIME_GC_ROOTS_H
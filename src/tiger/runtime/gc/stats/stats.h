@@ -0,0 +1,117 @@
+#ifndef TIGER_RUNTIME_GC_STATS_H
+#define TIGER_RUNTIME_GC_STATS_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+namespace gc {
+
+/**
+ * What one collection did. Sizes are in bytes.
+ */
+struct Collection {
+  bool young;
+  // Milliseconds since the heap started, and spent in the collection
+  double start_ms;
+  double pause_ms;
+  // Allocated since the previous collection
+  uint64_t allocated;
+  // Copied by the collection, and how many objects that was
+  uint64_t copied;
+  uint64_t survivors;
+  // Copied out of the nursery into the old generation
+  uint64_t promoted;
+  // In use after the collection, and the size of the heap
+  uint64_t used;
+  uint64_t heap_size;
+};
+
+/**
+ * Records every collection of a heap. It writes one JSON object per line
+ * for each collection to the trace, if there is one, and sums them up for
+ * Report.
+ */
+class Stats {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit Stats(FILE *trace = nullptr) : trace_(trace), start_(Clock::now()) {}
+
+  // Milliseconds since the heap started
+  double Now() const {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start_)
+        .count();
+  }
+
+  void Record(const Collection &gc) {
+    (gc.young ? young_ : full_)++;
+    pause_ms_ += gc.pause_ms;
+    max_pause_ms_ = std::max(max_pause_ms_, gc.pause_ms);
+    allocated_ += gc.allocated;
+    copied_ += gc.copied;
+    survivors_ += gc.survivors;
+    promoted_ += gc.promoted;
+    peak_heap_ = std::max(peak_heap_, gc.heap_size);
+    if (!trace_)
+      return;
+    fprintf(trace_,
+            "{\"gc\": %lu, \"kind\": \"%s\", \"start_ms\": %.3f, "
+            "\"pause_ms\": %.3f, \"allocated\": %lu, \"copied\": %lu, "
+            "\"survivors\": %lu, \"promoted\": %lu, \"used\": %lu, "
+            "\"heap_size\": %lu}\n",
+            static_cast<unsigned long>(young_ + full_),
+            gc.young ? "young" : "full", gc.start_ms, gc.pause_ms,
+            static_cast<unsigned long>(gc.allocated),
+            static_cast<unsigned long>(gc.copied),
+            static_cast<unsigned long>(gc.survivors),
+            static_cast<unsigned long>(gc.promoted),
+            static_cast<unsigned long>(gc.used),
+            static_cast<unsigned long>(gc.heap_size));
+  }
+
+  /**
+   * Print totals to "out", counting "allocated" bytes allocated since the
+   * last collection
+   */
+  void Report(FILE *out, uint64_t allocated) const {
+    double run_ms = Now();
+    double mutator_ms = run_ms - pause_ms_;
+    uint64_t total = allocated_ + allocated;
+    unsigned long count = young_ + full_;
+    fprintf(out, "Tiger GC: %lu collections (%lu young, %lu full)\n", count,
+            static_cast<unsigned long>(young_),
+            static_cast<unsigned long>(full_));
+    fprintf(out, "  pause: %.3f ms total, %.3f ms max, %.3f ms mean, "
+                 "%.1f%% of %.3f ms run time\n",
+            pause_ms_, max_pause_ms_, count ? pause_ms_ / count : 0.0,
+            run_ms > 0 ? 100 * pause_ms_ / run_ms : 0.0, run_ms);
+    fprintf(out, "  allocated: %lu bytes, %.1f MB/s of mutator time\n",
+            static_cast<unsigned long>(total),
+            mutator_ms > 0 ? total / 1e3 / mutator_ms : 0.0);
+    fprintf(out, "  copied: %lu bytes in %lu objects, %lu bytes promoted\n",
+            static_cast<unsigned long>(copied_),
+            static_cast<unsigned long>(survivors_),
+            static_cast<unsigned long>(promoted_));
+    fprintf(out, "  peak heap: %lu bytes\n",
+            static_cast<unsigned long>(peak_heap_));
+  }
+
+private:
+  FILE *trace_;
+  Clock::time_point start_;
+  uint64_t young_ = 0;
+  uint64_t full_ = 0;
+  double pause_ms_ = 0;
+  double max_pause_ms_ = 0;
+  uint64_t allocated_ = 0;
+  uint64_t copied_ = 0;
+  uint64_t survivors_ = 0;
+  uint64_t promoted_ = 0;
+  uint64_t peak_heap_ = 0;
+};
+
+} // namespace gc
+
+#endif // TIGER_RUNTIME_GC_STATS_H
@@ -4,14 +4,33 @@
 
 extern int tigermain();
 
+// Nothing is collected here, so every write barrier marks the same card
+unsigned long dummy_card;
+struct {
+  unsigned long *table;
+  unsigned long mask;
+} GLOBAL_GC_CARDS = {&dummy_card, 0};
+
+// An empty nursery sends every inline allocation here
+struct {
+  char *top;
+  char *limit;
+} GLOBAL_GC_ALLOC = {0, 0};
+
 // seven arguments testcase
 int sum_seven(int v1, int v2, int v3, int v4, int v5, int v6, int v7) {
   return v1 + v2 + v3 + v4 + v5 + v6 + v7;
 }
 
-long *init_array(int size, long init) {
-  int i;
-  long *a = (long *)malloc(size * sizeof(long));
+long *init_array(long size, long init) {
+  long i;
+  long *a;
+  if (size < 0 || size > 0x7fffffff) {
+    // Tiger calls leave the stack unaligned, which printf may not survive
+    fputs("Tiger array size out of range\n", stderr);
+    exit(-1);
+  }
+  a = (long *)malloc(size * sizeof(long));
   for (i = 0; i < size; i++) a[i] = init;
   return a;
 }
@@ -30,18 +49,13 @@ struct string {
 };
 
 int string_equal(struct string *s, struct string *t) {
-  int i;
   if (s == t) return 1;
   if (s->length != t->length) return 0;
-  for (i = 0; i < s->length; i++)
-    if (s->chars[i] != t->chars[i]) return 0;
-  return 1;
+  return memcmp(s->chars, t->chars, s->length) == 0;
 }
 
 void print(struct string *s) {
-  int i;
-  unsigned char *p = s->chars;
-  for (i = 0; i < s->length; i++, p++) putchar(*p);
+  fwrite(s->chars, 1, s->length, stdout);
 }
 
 void printi(int k) { printf("%d", k); }
@@ -85,9 +99,8 @@ struct string *substring(struct string *s, int first, int n) {
   if (n == 1) return consts + s->chars[first];
   {
     struct string *t = (struct string *)malloc(sizeof(int) + n);
-    int i;
     t->length = n;
-    for (i = 0; i < n; i++) t->chars[i] = s->chars[first + i];
+    memcpy(t->chars, s->chars + first, n);
     return t;
   }
 }
@@ -98,11 +111,11 @@ struct string *concat(struct string *a, struct string *b) {
   else if (b->length == 0)
     return a;
   else {
-    int i, n = a->length + b->length;
+    int n = a->length + b->length;
     struct string *t = (struct string *)malloc(sizeof(int) + n);
     t->length = n;
-    for (i = 0; i < a->length; i++) t->chars[i] = a->chars[i];
-    for (i = 0; i < b->length; i++) t->chars[i + a->length] = b->chars[i];
+    memcpy(t->chars, a->chars, a->length);
+    memcpy(t->chars + a->length, b->chars, b->length);
     return t;
   }
 }
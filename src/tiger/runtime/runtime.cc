@@ -1,17 +1,26 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-// Note: change to header file of your implemnted heap!
-#include "../runtime/gc/heap/heap.h"
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include "../runtime/gc/heap/derived_heap.h"
 
 #ifndef EXTERNC
 #define EXTERNC extern "C" 
 #endif
 
+// Defaults of the heap sizing knobs, see HeapPolicyFromEnv
 #define TIGER_HEAP_SIZE ( 1 << 20 )
+#define TIGER_HEAP_MAX ( 1UL << 30 )
+#define TIGER_GC_THREADS 8
+// Default shortest concatenation to build a rope for
+#define TIGER_ROPE_MIN 256
 
 EXTERNC int tigermain(int);
 gc::TigerHeap *tiger_heap = nullptr;
+gc::Roots tiger_roots;
+gc::Stats *tiger_stats = nullptr;
 
 #define CHECK_HEAP \
     do { \
@@ -41,48 +50,238 @@ EXTERNC uint64_t MaxFree() {
     return tiger_heap->MaxFree();
 }
 
-EXTERNC long *init_array(int size, long init) {
-  int i;
-  uint64_t allocate_size = size * sizeof(long);
-  long *a = (long *)tiger_heap->Allocate(allocate_size);
-  if(!a) {
+/*
+ * Tiger code reaches the allocators through these stubs. Heap pointers may
+ * live in callee-saved registers across the call, so the stubs push them
+ * where the collector can see and update them, pass the stack pointer on
+ * as the top of the Tiger stack, and pop the possibly moved values back.
+ * Tiger code keeps %rsp 8-byte aligned only, so they realign it for C.
+ */
+#define GC_ENTRY(name, impl, sp_reg) \
+  asm(".text\n" \
+      ".globl " #name "\n" \
+      #name ":\n" \
+      "  pushq %rbp\n" \
+      "  pushq %rbx\n" \
+      "  pushq %r12\n" \
+      "  pushq %r13\n" \
+      "  pushq %r14\n" \
+      "  pushq %r15\n" \
+      "  movq %rsp, " sp_reg "\n" \
+      "  movq %rsp, %rbx\n" \
+      "  andq $-16, %rsp\n" \
+      "  callq " #impl "\n" \
+      "  movq %rbx, %rsp\n" \
+      "  popq %r15\n" \
+      "  popq %r14\n" \
+      "  popq %r13\n" \
+      "  popq %r12\n" \
+      "  popq %rbx\n" \
+      "  popq %rbp\n" \
+      "  retq\n")
+
+/*
+ * Read a size in bytes, with an optional K, M or G suffix, from the
+ * environment variable "name"
+ */
+static uint64_t SizeFromEnv(const char *name, uint64_t fallback) {
+  const char *value = getenv(name);
+  if (!value || !*value)
+    return fallback;
+  char *suffix;
+  uint64_t size = strtoull(value, &suffix, 10);
+  switch (*suffix) {
+  case 'G': case 'g': size <<= 10; /* fall through */
+  case 'M': case 'm': size <<= 10; /* fall through */
+  case 'K': case 'k': size <<= 10; break;
+  }
+  return size ? size : fallback;
+}
+
+/*
+ * TIGER_HEAP_SIZE and TIGER_HEAP_MAX bound the old generation, which grows
+ * when a full collection leaves it more than TIGER_HEAP_GROW percent full
+ * and shrinks when it is less than TIGER_HEAP_SHRINK percent full
+ */
+static gc::HeapPolicy HeapPolicyFromEnv() {
+  gc::HeapPolicy policy;
+  policy.max_size = SizeFromEnv("TIGER_HEAP_MAX", TIGER_HEAP_MAX);
+  policy.grow_percent = SizeFromEnv("TIGER_HEAP_GROW", policy.grow_percent);
+  policy.shrink_percent =
+      SizeFromEnv("TIGER_HEAP_SHRINK", policy.shrink_percent);
+  // TIGER_GC_THREADS=1 collects on the Tiger thread only
+  int cores = std::thread::hardware_concurrency();
+  policy.threads = SizeFromEnv("TIGER_GC_THREADS",
+                               std::max(1, std::min(cores, TIGER_GC_THREADS)));
+  return policy;
+}
+
+/*
+ * TIGER_GC_STATS prints a summary of the collections at exit, and
+ * TIGER_GC_TRACE names a file to write one JSON line per collection to
+ */
+static gc::Stats *StatsFromEnv() {
+  const char *stats = getenv("TIGER_GC_STATS");
+  const char *trace = getenv("TIGER_GC_TRACE");
+  bool summary = stats && *stats && strcmp(stats, "0");
+  if (!summary && !(trace && *trace))
+    return nullptr;
+  FILE *out = nullptr;
+  if (trace && *trace && !(out = fopen(trace, "w")))
+    fprintf(stderr, "Cannot open GC trace %s\n", trace);
+  return new gc::Stats(out);
+}
+
+static void ReportStats() {
+  if (getenv("TIGER_GC_STATS") && strcmp(getenv("TIGER_GC_STATS"), "0"))
+    tiger_stats->Report(
+        stderr, static_cast<gc::DerivedHeap *>(tiger_heap)->Allocated());
+}
+
+// Allocate, collecting the young generation and then everything if full
+static char *AllocateOrCollect(uint64_t size, uint64_t header, uint64_t *sp) {
+  CHECK_HEAP;
+  char *p = tiger_heap->Allocate(size, header);
+  if (!p) {
+    tiger_roots.SetTop(sp);
+    tiger_heap->YoungGC();
+    p = tiger_heap->Allocate(size, header);
+  }
+  if (!p) {
     tiger_heap->GC();
-    a = (long*)tiger_heap->Allocate(allocate_size);
+    p = tiger_heap->Allocate(size, header);
+  }
+  if (!p) {
+    fprintf(stderr, "Tiger heap exhausted allocating %lu bytes\n",
+            (unsigned long)size);
+    exit(-1);
+  }
+  return p;
+}
+
+// "kind" tells whether the elements are pointers, gc::POINTER_ARRAY, or not
+GC_ENTRY(init_array, tiger_init_array, "%rcx");
+EXTERNC long *tiger_init_array(long size, long init, uint64_t kind,
+                               uint64_t *sp) {
+  long i;
+  if (size < 0 || size > gc::MAX_ARRAY_LENGTH) {
+    fprintf(stderr, "Tiger array size %ld out of range\n", size);
+    exit(-1);
   }
+  uint64_t allocate_size = size * sizeof(long);
+  // "init" may be a heap pointer the collector moves
+  tiger_roots.Hold((uint64_t *)&init);
+  long *a = (long *)AllocateOrCollect(
+      allocate_size, gc::MakeHeader(gc::HeaderKind(kind), size), sp);
+  tiger_roots.Release();
   for (i = 0; i < size; i++) a[i] = init;
   return a;
 }
 
+/*
+ * Strings live in the Tiger heap as pointer-free objects, except literals
+ * and the one-character strings of consts. A long concatenation builds a
+ * rope node instead of copying, marked by a negative length, and
+ * operations needing the characters flatten it once and keep the result.
+ */
 struct string {
   int length;
   unsigned char chars[1];
 };
 
-EXTERNC int *alloc_record(int size) {
+struct rope {
+  // Minus the length of the string
+  int length;
+  int unused;
+  struct string *left;
+  // Null once the rope is flattened into "left"
+  struct string *right;
+};
+
+// Concatenations at least this long build ropes, read from TIGER_ROPE_MIN
+static uint64_t rope_min = TIGER_ROPE_MIN;
+
+static int Length(struct string *s) {
+  return s->length < 0 ? -s->length : s->length;
+}
+
+// Store the heap pointer "value" into "slot" of a heap object
+static void StorePointer(struct string **slot, struct string *value) {
+  *slot = value;
+  GLOBAL_GC_CARDS.table[(reinterpret_cast<uintptr_t>(slot) >> gc::CARD_SHIFT) &
+                        GLOBAL_GC_CARDS.mask] = 1;
+}
+
+static struct string *AllocateString(int n, uint64_t *sp) {
+  uint64_t size = sizeof(int) + n;
+  auto s = (struct string *)AllocateOrCollect(
+      size, gc::MakeHeader(gc::BYTES, size), sp);
+  s->length = n;
+  return s;
+}
+
+// Copy the characters of "s" to "out"
+static void CopyChars(unsigned char *out, struct string *s) {
+  std::vector<struct string *> pending{s};
+  while (!pending.empty()) {
+    s = pending.back();
+    pending.pop_back();
+    if (s->length >= 0) {
+      memcpy(out, s->chars, s->length);
+      out += s->length;
+      continue;
+    }
+    auto r = (struct rope *)s;
+    if (r->right)
+      pending.push_back(r->right);
+    pending.push_back(r->left);
+  }
+}
+
+// "s" with its characters in place
+static struct string *Flatten(struct string *s, uint64_t *sp) {
+  if (s->length >= 0)
+    return s;
+  if (!((struct rope *)s)->right)
+    return ((struct rope *)s)->left;
+  tiger_roots.Hold((uint64_t *)&s);
+  struct string *t = AllocateString(-s->length, sp);
+  tiger_roots.Release();
+  CopyChars(t->chars, s);
+  auto r = (struct rope *)s;
+  StorePointer(&r->left, t);
+  r->right = nullptr;
+  return t;
+}
+
+// "header" holds the descriptor of the record, see gc::RECORD
+GC_ENTRY(alloc_record, tiger_alloc_record, "%rdx");
+EXTERNC int *tiger_alloc_record(int size, uint64_t header, uint64_t *sp) {
   int i;
   int *p, *a;
-  p = a = (int *)tiger_heap->Allocate(size);
-  if(!p) {
-    tiger_heap->GC();
-    p = a = (int *)tiger_heap->Allocate(size);
-  }
+  p = a = (int *)AllocateOrCollect(size, header, sp);
   for (i = 0; i < size; i += sizeof(int)) *p++ = 0;
   return a;
 }
 
-EXTERNC int string_equal(struct string *s, struct string *t) {
-  int i;
+GC_ENTRY(string_equal, tiger_string_equal, "%rdx");
+EXTERNC int tiger_string_equal(struct string *s, struct string *t,
+                               uint64_t *sp) {
   if (s == t) return 1;
-  if (s->length != t->length) return 0;
-  for (i = 0; i < s->length; i++)
-    if (s->chars[i] != t->chars[i]) return 0;
-  return 1;
+  if (Length(s) != Length(t)) return 0;
+  tiger_roots.Hold((uint64_t *)&t);
+  s = Flatten(s, sp);
+  tiger_roots.Release();
+  tiger_roots.Hold((uint64_t *)&s);
+  t = Flatten(t, sp);
+  tiger_roots.Release();
+  return memcmp(s->chars, t->chars, s->length) == 0;
 }
 
-EXTERNC void print(struct string *s) {
-  int i;
-  unsigned char *p = s->chars;
-  for (i = 0; i < s->length; i++, p++) putchar(*p);
+GC_ENTRY(print, tiger_print, "%rsi");
+EXTERNC void tiger_print(struct string *s, uint64_t *sp) {
+  s = Flatten(s, sp);
+  fwrite(s->chars, 1, s->length, stdout);
 }
 
 EXTERNC void printi(int k) { printf("%d", k); }
@@ -98,17 +297,25 @@ int main() {
     consts[i].length = 1;
     consts[i].chars[0] = i;
   }
-  // Change it to your own implementation after implement heap and delete the comment!
-  // tiger_heap = new gc::TigerHeap();
-  tiger_heap->Initialize(TIGER_HEAP_SIZE);
+  tiger_heap = new gc::DerivedHeap(&tiger_roots, HeapPolicyFromEnv());
+  tiger_heap->Initialize(SizeFromEnv("TIGER_HEAP_SIZE", TIGER_HEAP_SIZE));
+  static_cast<gc::DerivedHeap *>(tiger_heap)
+      ->SetDescriptors(&GLOBAL_GC_DESCRIPTORS);
+  if ((tiger_stats = StatsFromEnv())) {
+    static_cast<gc::DerivedHeap *>(tiger_heap)->Observe(tiger_stats);
+    atexit(ReportStats);
+  }
+  tiger_roots.Load(&GLOBAL_GC_ROOTS);
+  rope_min = SizeFromEnv("TIGER_ROPE_MIN", TIGER_ROPE_MIN);
   return tigermain(0 /* static link */);
 }
 
-EXTERNC int ord(struct string *s) {
+GC_ENTRY(ord, tiger_ord, "%rsi");
+EXTERNC int tiger_ord(struct string *s, uint64_t *sp) {
   if (s->length == 0)
     return -1;
   else
-    return s->chars[0];
+    return Flatten(s, sp)->chars[0];
 }
 
 EXTERNC struct string *chr(int i) {
@@ -119,36 +326,54 @@ EXTERNC struct string *chr(int i) {
   return consts + i;
 }
 
-EXTERNC int size(struct string *s) { return s->length; }
+EXTERNC int size(struct string *s) { return Length(s); }
 
-EXTERNC struct string *substring(struct string *s, int first, int n) {
-  if (first < 0 || first + n > s->length) {
-    printf("substring([%d],%d,%d) out of range\n", s->length, first, n);
+GC_ENTRY(substring, tiger_substring, "%rcx");
+EXTERNC struct string *tiger_substring(struct string *s, int first, int n,
+                                       uint64_t *sp) {
+  if (first < 0 || first + n > Length(s)) {
+    printf("substring([%d],%d,%d) out of range\n", Length(s), first, n);
     exit(1);
   }
+  if (first == 0 && n == Length(s)) return s;
+  s = Flatten(s, sp);
   if (n == 1) return consts + s->chars[first];
   {
-    struct string *t = (struct string *)malloc(sizeof(int) + n);
-    int i;
-    t->length = n;
-    for (i = 0; i < n; i++) t->chars[i] = s->chars[first + i];
+    tiger_roots.Hold((uint64_t *)&s);
+    struct string *t = AllocateString(n, sp);
+    tiger_roots.Release();
+    memcpy(t->chars, s->chars + first, n);
     return t;
   }
 }
 
-EXTERNC struct string *concat(struct string *a, struct string *b) {
-  if (a->length == 0)
+GC_ENTRY(concat, tiger_concat, "%rdx");
+EXTERNC struct string *tiger_concat(struct string *a, struct string *b,
+                                    uint64_t *sp) {
+  int m = Length(a), n = Length(b);
+  if (m == 0)
     return b;
-  else if (b->length == 0)
+  else if (n == 0)
     return a;
-  else {
-    int i, n = a->length + b->length;
-    struct string *t = (struct string *)malloc(sizeof(int) + n);
-    t->length = n;
-    for (i = 0; i < a->length; i++) t->chars[i] = a->chars[i];
-    for (i = 0; i < b->length; i++) t->chars[i + a->length] = b->chars[i];
-    return t;
+  tiger_roots.Hold((uint64_t *)&a);
+  tiger_roots.Hold((uint64_t *)&b);
+  struct string *t;
+  if (static_cast<uint64_t>(m) + n >= rope_min) {
+    auto r = (struct rope *)AllocateOrCollect(
+        sizeof(struct rope), gc::MakeHeader(gc::RECORD, gc::ROPE_DESCRIPTOR),
+        sp);
+    r->length = -(m + n);
+    r->left = a;
+    r->right = b;
+    t = (struct string *)r;
+  } else {
+    t = AllocateString(m + n, sp);
+    CopyChars(t->chars, a);
+    CopyChars(t->chars + m, b);
   }
+  tiger_roots.Release();
+  tiger_roots.Release();
+  return t;
 }
 
 //int not(int i) { return !i; }
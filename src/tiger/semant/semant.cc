@@ -7,7 +7,7 @@ namespace {
 
       T* ans = new T();
 
-      const std::list<absyn::Field *> * field_list = &fields->GetList();
+      const arena::List<absyn::Field *> * field_list = &fields->GetList();
       for (auto iter = field_list->begin(); iter != field_list->end(); iter++) {
         type::Ty* ty = tenv->Look((*iter)->typ_);
         
@@ -128,7 +128,7 @@ type::Ty *CallExp::SemAnalyze(env::VEnvPtr venv, env::TEnvPtr tenv,
 
   type::TyList *formals = ((env::FunEntry*) entry)->formals_;
   const std::list<type::Ty *>* formallist = &formals->GetList();
-  const std::list<Exp *>* arglist = &args_->GetList();
+  const arena::List<Exp *>* arglist = &args_->GetList();
   
   
   int formal_size = formallist->size();
@@ -220,7 +220,7 @@ type::Ty *AssignExp::SemAnalyze(env::VEnvPtr venv, env::TEnvPtr tenv,
       errormsg->Error(pos_, "loop variable can't be assigned");
     }
   }
-  if (typeid(*var_ty) != typeid(*exp_ty)) {
+  if (!var_ty->IsSameType(exp_ty)) {
     errormsg->Error(pos_, "unmatched assign exp");
   }
   return type::VoidTy::Instance();
@@ -1,14 +1,24 @@
 #include "tiger/symbol/symbol.h"
 
-namespace {
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
 
-constexpr unsigned int HASH_TABSIZE = 109;
-sym::Symbol *hashtable[HASH_TABSIZE];
+namespace {
 
 unsigned int Hash(std::string_view str) {
   unsigned int h = 0;
-  for (const char *s = str.data(); *s; s++)
-    h = h * 65599 + *s;
+  for (char c : str)
+    h = h * 65599 + c;
+  // Mix so that both the high bits (shard) and low bits (slot) are usable
+  h ^= h >> 15;
+  h *= 0x2c1b3c6d;
+  h ^= h >> 12;
   return h;
 }
 
@@ -16,15 +26,136 @@ unsigned int Hash(std::string_view str) {
 
 namespace sym {
 
-Symbol *Symbol::UniqueSymbol(std::string_view name) {
-  unsigned int index = Hash(name) % HASH_TABSIZE;
-  Symbol *syms = hashtable[index], *sym;
-  for (sym = syms; sym; sym = sym->next_)
-    if (sym->name_ == name)
-      return sym;
-  sym = new Symbol(static_cast<std::string>(name), syms);
-  hashtable[index] = sym;
+/**
+ * Every symbol, split into shards by hash. Each shard is an open-addressing
+ * table of symbol pointers. Finding an existing symbol takes no lock: slots
+ * are only ever filled, with a release store of a fully built symbol.
+ * Interning a new name takes the shard's lock. A full slot array is replaced
+ * by one twice the size rather than resized in place, and old arrays are kept
+ * alive for readers still probing them.
+ */
+class InternTable {
+public:
+  InternTable() {
+    for (auto &shard : shards_) {
+      shard.all.emplace_back(new Slots(INITIAL_SLOTS));
+      shard.slots.store(shard.all.back().get(), std::memory_order_relaxed);
+    }
+  }
+
+  Symbol *Intern(std::string_view name);
+
+private:
+  static constexpr unsigned int SHARD_BITS = 4;
+  static constexpr std::size_t INITIAL_SLOTS = 256;
+  static constexpr std::size_t CHUNK_SIZE = 64 * 1024;
+
+  struct Slots {
+    explicit Slots(std::size_t size)
+        : mask(size - 1), slot(new std::atomic<Symbol *>[size]) {
+      for (std::size_t i = 0; i < size; i++)
+        slot[i].store(nullptr, std::memory_order_relaxed);
+    }
+    std::size_t mask;
+    std::unique_ptr<std::atomic<Symbol *>[]> slot;
+  };
+
+  struct Shard {
+    std::atomic<Slots *> slots{nullptr};
+    std::mutex mutex;
+    std::size_t count = 0;
+    // The current slot array and every one it replaced
+    std::vector<std::unique_ptr<Slots>> all;
+    // Arena the symbols and their names are carved from
+    std::vector<std::unique_ptr<char[]>> chunks;
+    char *free = nullptr;
+    std::size_t left = 0;
+  };
+
+  // The symbol named "name", or the empty slot where it belongs
+  static std::size_t Probe(const Slots *slots, std::string_view name,
+                           unsigned int hash);
+  static void *Allocate(Shard &shard, std::size_t size, std::size_t align);
+  static void Grow(Shard &shard);
+
+  Shard shards_[1u << SHARD_BITS];
+};
+
+std::size_t InternTable::Probe(const Slots *slots, std::string_view name,
+                               unsigned int hash) {
+  for (std::size_t i = hash & slots->mask;; i = (i + 1) & slots->mask) {
+    Symbol *sym = slots->slot[i].load(std::memory_order_acquire);
+    if (!sym || (sym->hash_ == hash && sym->name_ == name))
+      return i;
+  }
+}
+
+Symbol *InternTable::Intern(std::string_view name) {
+  unsigned int hash = Hash(name);
+  Shard &shard = shards_[hash >> (32 - SHARD_BITS)];
+
+  Slots *slots = shard.slots.load(std::memory_order_acquire);
+  if (Symbol *sym = slots->slot[Probe(slots, name, hash)].load(
+          std::memory_order_acquire))
+    return sym;
+
+  // Not there; look again under the lock, as the table may have changed
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  slots = shard.slots.load(std::memory_order_relaxed);
+  std::size_t index = Probe(slots, name, hash);
+  if (Symbol *sym = slots->slot[index].load(std::memory_order_relaxed))
+    return sym;
+
+  auto chars = static_cast<char *>(Allocate(shard, name.size(), 1));
+  std::memcpy(chars, name.data(), name.size());
+  void *memory = Allocate(shard, sizeof(Symbol), alignof(Symbol));
+  auto sym = new (memory) Symbol(std::string_view(chars, name.size()), hash);
+  slots->slot[index].store(sym, std::memory_order_release);
+
+  // Keep the table at most half full so that probes stay short
+  if (++shard.count * 2 > slots->mask + 1)
+    Grow(shard);
   return sym;
 }
 
+void *InternTable::Allocate(Shard &shard, std::size_t size,
+                            std::size_t align) {
+  auto pad = [&shard, align]() {
+    return (align - reinterpret_cast<std::uintptr_t>(shard.free) % align) %
+           align;
+  };
+  if (pad() + size > shard.left) {
+    std::size_t chunk = std::max(CHUNK_SIZE, size + align);
+    shard.chunks.emplace_back(new char[chunk]);
+    shard.free = shard.chunks.back().get();
+    shard.left = chunk;
+  }
+  std::size_t skip = pad();
+  char *res = shard.free + skip;
+  shard.free = res + size;
+  shard.left -= skip + size;
+  return res;
+}
+
+void InternTable::Grow(Shard &shard) {
+  const Slots *old = shard.slots.load(std::memory_order_relaxed);
+  auto slots = new Slots((old->mask + 1) * 2);
+  for (std::size_t i = 0; i <= old->mask; i++) {
+    Symbol *sym = old->slot[i].load(std::memory_order_relaxed);
+    if (!sym)
+      continue;
+    std::size_t j = sym->hash_ & slots->mask;
+    while (slots->slot[j].load(std::memory_order_relaxed))
+      j = (j + 1) & slots->mask;
+    slots->slot[j].store(sym, std::memory_order_relaxed);
+  }
+  shard.all.emplace_back(slots);
+  shard.slots.store(slots, std::memory_order_release);
+}
+
+Symbol *Symbol::UniqueSymbol(std::string_view name) {
+  static InternTable *table = new InternTable();
+  return table->Intern(name);
+}
+
 } // namespace sym
@@ -2,6 +2,7 @@
 #define TIGER_SYMBOL_SYMBOL_H_
 
 #include <string>
+#include <string_view>
 
 #include "tiger/util/table.h"
 
@@ -16,19 +17,26 @@ class Ty;
 } // namespace type
 
 namespace sym {
+class InternTable;
+
 class Symbol {
   template <typename ValueType> friend class Table;
+  friend class InternTable;
 
 public:
+  /**
+   * Get the one symbol named "name", creating it on first use. Safe to call
+   * from several threads; symbols are never freed.
+   */
   static Symbol *UniqueSymbol(std::string_view);
-  [[nodiscard]] std::string Name() const { return name_; }
+  [[nodiscard]] std::string Name() const { return std::string(name_); }
 
 private:
-  Symbol(std::string name, Symbol *next)
-      : name_(std::move(name)), next_(next) {}
+  Symbol(std::string_view name, unsigned int hash) : name_(name), hash_(hash) {}
 
-  std::string name_;
-  Symbol *next_;
+  // Points into storage owned by the intern table
+  std::string_view name_;
+  unsigned int hash_;
 };
 
 template <typename ValueType>
@@ -42,7 +50,7 @@ public:
   bool inLoop();
 
 private:
-  Symbol marksym_ = {"<mark>", nullptr};
+  Symbol marksym_ = {"<mark>", 0};
   int in_loop_;
 };
 
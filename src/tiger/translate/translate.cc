@@ -9,14 +9,159 @@
 #include "tiger/frame/x64frame.h"
 #include "tiger/frame/temp.h"
 #include "tiger/frame/frame.h"
+#include "tiger/runtime/gc/heap/heap.h"
 
 extern frame::Frags *frags;
 extern frame::RegManager *reg_manager;
 
 namespace tr {
 
-Access *Access::AllocLocal(Level *level, bool escape) {
-  return new Access(level, ((frame::X64Frame *)(level->frame_))->AllocLocal(escape));
+// Record descriptors of the program being translated
+static frame::DescriptorsFrag *descriptors = nullptr;
+
+Access *Access::AllocLocal(Level *level, bool escape, bool pointer) {
+  return new Access(level, ((frame::X64Frame *)(level->frame_))->AllocLocal(escape, pointer));
+}
+
+// Whether values of type "ty" may point into the garbage-collected heap
+bool IsPointer(type::Ty *ty) {
+  switch (ty->ActualTy()->kind_) {
+  case type::Ty::RECORD:
+  case type::Ty::ARRAY:
+  case type::Ty::STRING:
+  case type::Ty::NIL:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// Header of the records of type "ty", built from their pointer fields
+int RecordHeader(type::RecordTy *ty) {
+  std::vector<bool> pointers;
+  for (type::Field *field : ty->fields_->GetList())
+    pointers.push_back(IsPointer(field->ty_));
+  return gc::MakeHeader(gc::RECORD, descriptors->Add(pointers));
+}
+
+// Mark the word loaded by "exp", a value of type "ty", as a heap pointer
+tree::Exp *MarkPointer(tree::Exp *exp, type::Ty *ty) {
+  if (exp->kind_ == tree::Exp::MEM)
+    static_cast<tree::MemExp *>(exp)->pointer_ = IsPointer(ty);
+  else if (exp->kind_ == tree::Exp::CALL)
+    static_cast<tree::CallExp *>(exp)->pointer_ = IsPointer(ty);
+  return exp;
+}
+
+/**
+ * Store the heap pointer "value" into "dst", a record field or an array
+ * element, and dirty the card of the address written. The object is held in
+ * a pointer temp while the value is evaluated, so that the derived address
+ * is only live between the store and the card mark, with no call between.
+ */
+tree::Stm *StorePointer(tree::MemExp *dst, tree::Exp *value) {
+  tree::Exp *base = dst->exp_;
+  tree::Exp *offset = new tree::ConstExp(0);
+  if (base->kind_ == tree::Exp::BINOP &&
+      static_cast<tree::BinopExp *>(base)->op_ == tree::PLUS_OP) {
+    offset = static_cast<tree::BinopExp *>(base)->right_;
+    base = static_cast<tree::BinopExp *>(base)->left_;
+  }
+
+  temp::Temp *obj = temp::TempFactory::NewTemp();
+  obj->SetPointer();
+  tree::Stm *stm = new tree::MoveStm(new tree::TempExp(obj), base);
+  if (offset->kind_ != tree::Exp::CONST) {
+    temp::Temp *off = temp::TempFactory::NewTemp();
+    stm = tree::Stm::Seq(stm, new tree::MoveStm(new tree::TempExp(off), offset));
+    offset = new tree::TempExp(off);
+  }
+  temp::Temp *val = temp::TempFactory::NewTemp();
+  val->SetPointer();
+  stm = tree::Stm::Seq(stm, new tree::MoveStm(new tree::TempExp(val), value));
+
+  temp::Temp *slot = temp::TempFactory::NewTemp();
+  stm = tree::Stm::Seq(
+      stm, new tree::MoveStm(new tree::TempExp(slot),
+                             new tree::BinopExp(tree::PLUS_OP,
+                                                new tree::TempExp(obj),
+                                                offset)));
+  stm = tree::Stm::Seq(stm, new tree::MoveStm(
+                                new tree::MemExp(new tree::TempExp(slot)),
+                                new tree::TempExp(val)));
+
+  // GLOBAL_GC_CARDS.table[(slot >> CARD_SHIFT) & GLOBAL_GC_CARDS.mask] = 1
+  temp::Label *cards_label = temp::LabelFactory::NamedLabel(gc::GC_CARDS);
+  tree::Exp *cards = new tree::MemExp(new tree::NameExp(cards_label));
+  tree::Exp *mask = tree::NewMemPlus_Const(new tree::NameExp(cards_label),
+                                           reg_manager->WordSize());
+  tree::Exp *card = new tree::BinopExp(
+      tree::LSHIFT_OP,
+      new tree::BinopExp(
+          tree::AND_OP,
+          new tree::BinopExp(tree::RSHIFT_OP, new tree::TempExp(slot),
+                             new tree::ConstExp(gc::CARD_SHIFT)),
+          mask),
+      new tree::ConstExp(3));
+  return tree::Stm::Seq(
+      stm, new tree::MoveStm(new tree::MemExp(new tree::BinopExp(
+                                 tree::PLUS_OP, cards, card)),
+                             new tree::ConstExp(1)));
+}
+
+// A fresh copy of "leaf", a CONST or a TEMP, to use once more in a tree
+tree::Exp *CopyLeaf(tree::Exp *leaf) {
+  if (leaf->kind_ == tree::Exp::CONST)
+    return new tree::ConstExp(static_cast<tree::ConstExp *>(leaf)->consti_);
+  return new tree::TempExp(static_cast<tree::TempExp *>(leaf)->temp_);
+}
+
+tree::Stm *Jump(temp::Label *label) {
+  return new tree::JumpStm(new tree::NameExp(label),
+                           new std::vector<temp::Label *>{label});
+}
+
+/**
+ * Allocate an object described by "header" with a payload of "bytes", both
+ * a CONST or a TEMP, into "obj" by bumping the nursery top the runtime
+ * exports. Falls through with the end of the object in "end", or jumps to
+ * "slow" when the nursery is full, where the caller has to call the runtime
+ * instead.
+ */
+tree::Stm *BumpAllocate(temp::Temp *obj, temp::Temp *end, tree::Exp *bytes,
+                        tree::Exp *header, temp::Label *slow) {
+  temp::Label *alloc = temp::LabelFactory::NamedLabel(gc::GC_ALLOC);
+  temp::Label *fast = temp::LabelFactory::NewLabel();
+  temp::Temp *top = temp::TempFactory::NewTemp();
+  int word = reg_manager->WordSize();
+
+  tree::Stm *stm = new tree::MoveStm(
+      new tree::TempExp(top), new tree::MemExp(new tree::NameExp(alloc)));
+  stm = tree::Stm::Seq(
+      stm, new tree::MoveStm(
+               new tree::TempExp(end),
+               new tree::BinopExp(
+                   tree::PLUS_OP,
+                   new tree::BinopExp(tree::PLUS_OP, new tree::TempExp(top),
+                                      new tree::ConstExp(word)),
+                   bytes)));
+  stm = tree::Stm::Seq(
+      stm, new tree::CjumpStm(
+               tree::GT_OP, new tree::TempExp(end),
+               tree::NewMemPlus_Const(new tree::NameExp(alloc), word), slow,
+               fast));
+  stm = tree::Stm::Seq(stm, new tree::LabelStm(fast));
+  stm = tree::Stm::Seq(
+      stm, new tree::MoveStm(new tree::MemExp(new tree::NameExp(alloc)),
+                             new tree::TempExp(end)));
+  stm = tree::Stm::Seq(
+      stm, new tree::MoveStm(new tree::MemExp(new tree::TempExp(top)),
+                             header));
+  return tree::Stm::Seq(
+      stm, new tree::MoveStm(new tree::TempExp(obj),
+                             new tree::BinopExp(tree::PLUS_OP,
+                                                new tree::TempExp(top),
+                                                new tree::ConstExp(word))));
 }
 
 class Cx {
@@ -125,6 +270,10 @@ void ProgTr::Translate() {
   main_level_.reset(new Level(main_frame_, nullptr));
   FillBaseTEnv();
   FillBaseVEnv();
+  descriptors = new frame::DescriptorsFrag();
+  frags->PushBack(descriptors);
+  // The first descriptor, gc::ROPE_DESCRIPTOR, is the runtime's rope node
+  descriptors->Add({false, true, true});
 
   absyn_tree_->Translate(venv_.get(), 
                         tenv_.get(), 
@@ -200,8 +349,8 @@ tr::ExpAndTy *FieldVar::Translate(env::VEnvPtr venv, env::TEnvPtr tenv,
         return new tr::ExpAndTy(nullptr, type::IntTy::Instance());
       }
       
-      tr::Exp* exp = new tr::ExExp(tree::NewMemPlus_Const(check_var->exp_->UnEx(), order * frame::wordsize));
       type::Ty* ty = ele->ty_->ActualTy();
+      tr::Exp* exp = new tr::ExExp(tr::MarkPointer(tree::NewMemPlus_Const(check_var->exp_->UnEx(), order * frame::wordsize), ty));
       return new tr::ExpAndTy(exp, ty);
     }
     order++;
@@ -229,8 +378,8 @@ tr::ExpAndTy *SubscriptVar::Translate(env::VEnvPtr venv, env::TEnvPtr tenv,
     return new tr::ExpAndTy(NULL, type::IntTy::Instance());
   }
   
-  tr::Exp* exp = new tr::ExExp(new tree::MemExp(new tree::BinopExp(tree::BinOp::PLUS_OP, check_var->exp_->UnEx(), new tree::BinopExp(tree::BinOp::MUL_OP, check_subscript->exp_->UnEx(), new tree::ConstExp(frame::wordsize)))));
   type::Ty* ty = ((type::ArrayTy *) check_var->ty_)->ty_->ActualTy();
+  tr::Exp* exp = new tr::ExExp(tr::MarkPointer(new tree::MemExp(new tree::BinopExp(tree::BinOp::PLUS_OP, check_var->exp_->UnEx(), new tree::BinopExp(tree::BinOp::MUL_OP, check_subscript->exp_->UnEx(), new tree::ConstExp(frame::wordsize)))), ty));
   return new tr::ExpAndTy(exp, ty);
 }
 
@@ -293,10 +442,10 @@ tr::ExpAndTy *CallExp::Translate(env::VEnvPtr venv, env::TEnvPtr tenv,
 
   tr::Exp *exp;
   if (fent->level_->parent_ == nullptr) {
-    exp = new tr::ExExp(frame::ExternalCall(temp::LabelFactory::LabelString(func_), exp_list));
+    exp = new tr::ExExp(tr::MarkPointer(frame::ExternalCall(temp::LabelFactory::LabelString(func_), exp_list), ty));
   }
   else {
-    exp = new tr::ExExp(new tree::CallExp(new tree::NameExp(func_), exp_list));
+    exp = new tr::ExExp(tr::MarkPointer(new tree::CallExp(new tree::NameExp(func_), exp_list), ty));
   }
   
   return new tr::ExpAndTy(exp, ty);
@@ -324,11 +473,12 @@ tr::ExpAndTy *OpExp::Translate(env::VEnvPtr venv, env::TEnvPtr tenv,
     case Oper::DIVIDE_OP:
       exp = new tr::ExExp(new tree::BinopExp(tree::BinOp::DIV_OP, lres->exp_->UnEx(), rres->exp_->UnEx()));
       break;
+    // Logical & and | are lowered to * and + on truth values
     case Oper::AND_OP:
-      exp = new tr::ExExp(new tree::BinopExp(tree::BinOp::AND_OP, lres->exp_->UnEx(), rres->exp_->UnEx()));
+      exp = new tr::ExExp(new tree::BinopExp(tree::BinOp::MUL_OP, lres->exp_->UnEx(), rres->exp_->UnEx()));
       break;
     case Oper::OR_OP:
-      exp = new tr::ExExp(new tree::BinopExp(tree::BinOp::OR_OP, lres->exp_->UnEx(), rres->exp_->UnEx()));
+      exp = new tr::ExExp(new tree::BinopExp(tree::BinOp::PLUS_OP, lres->exp_->UnEx(), rres->exp_->UnEx()));
       break;
     case Oper::LT_OP:
       stm = new tree::CjumpStm(tree::RelOp::LT_OP, lres->exp_->UnEx(), rres->exp_->UnEx(), nullptr, nullptr);
@@ -381,17 +531,46 @@ tr::ExpAndTy *RecordExp::Translate(env::VEnvPtr venv, env::TEnvPtr tenv,
   auto expList = new tree::ExpList();
   auto elist = fields_->GetList();
 
+  /* Evaluate the fields before allocating, so that nothing can run between
+   * the allocation and the initializing stores. The record is still young
+   * when they happen, and they need no write barrier. */
+  tree::Stm *fields = nullptr;
   for (auto &it : elist) {
     tr::ExpAndTy *res = it->exp_->Translate(venv, tenv, level, label, errormsg);
-    expList->Append(res->exp_->UnEx());
+    tree::Exp *field = res->exp_->UnEx();
+    if (field->kind_ != tree::Exp::CONST) {
+      auto value = temp::TempFactory::NewTemp();
+      if (tr::IsPointer(res->ty_))
+        value->SetPointer();
+      tree::Stm *move = new tree::MoveStm(new tree::TempExp(value), field);
+      fields = fields ? tree::Stm::Seq(fields, move) : move;
+      field = new tree::TempExp(value);
+    }
+    expList->Append(field);
   }
 
   auto reg = temp::TempFactory::NewTemp();
+  reg->SetPointer();
 
+  int size = elist.size() * reg_manager->WordSize();
+  int header = tr::RecordHeader(static_cast<type::RecordTy *>(ty->ActualTy()));
   auto arg = new tree::ExpList();
   arg->Append(new tree::TempExp(reg_manager->FramePointer()));
-  arg->Append(GetConstExp(elist.size() * reg_manager->WordSize()));
-  tree::Stm *stm = new tree::MoveStm(new tree::TempExp(reg), frame::ExternalCall("alloc_record", arg));
+  arg->Append(GetConstExp(size));
+  arg->Append(GetConstExp(header));
+
+  // Every field is stored below, so the fast path need not zero the record
+  temp::Label *slow = temp::LabelFactory::NewLabel();
+  temp::Label *done = temp::LabelFactory::NewLabel();
+  tree::Stm *stm = tr::BumpAllocate(reg, temp::TempFactory::NewTemp(),
+                                    GetConstExp(size), GetConstExp(header),
+                                    slow);
+  stm = tree::Stm::Seq(stm, tr::Jump(done));
+  stm = tree::Stm::Seq(stm, new tree::LabelStm(slow));
+  stm = tree::Stm::Seq(stm, new tree::MoveStm(new tree::TempExp(reg), frame::ExternalCall("alloc_record", arg)));
+  stm = tree::Stm::Seq(stm, new tree::LabelStm(done));
+  if (fields)
+    stm = tree::Stm::Seq(fields, stm);
   
   int i = 0;
   for (auto &it : expList->GetList()){
@@ -423,7 +602,14 @@ tr::ExpAndTy *AssignExp::Translate(env::VEnvPtr venv, env::TEnvPtr tenv,
   auto vres = var_->Translate(venv, tenv, level, label, errormsg);
   auto eres = exp_->Translate(venv, tenv, level, label, errormsg);
 
-  tr::Exp *exp = new tr::NxExp(new tree::MoveStm(vres->exp_->UnEx(), eres->exp_->UnEx()));
+  tree::Exp *dst = vres->exp_->UnEx();
+  tree::Stm *stm;
+  // Heap objects written with pointers need the generational write barrier
+  if (var_->kind_ != Var::SIMPLE && tr::IsPointer(eres->ty_))
+    stm = tr::StorePointer(static_cast<tree::MemExp *>(dst), eres->exp_->UnEx());
+  else
+    stm = new tree::MoveStm(dst, eres->exp_->UnEx());
+  tr::Exp *exp = new tr::NxExp(stm);
   return new tr::ExpAndTy(exp, type::VoidTy::Instance());
 }
 
@@ -439,6 +625,8 @@ tr::ExpAndTy *IfExp::Translate(env::VEnvPtr venv, env::TEnvPtr tenv,
     
     tr::Cx testc = test_res->exp_->UnCx(errormsg);
     temp::Temp *r = temp::TempFactory::NewTemp();
+    if (tr::IsPointer(then_res->ty_) || tr::IsPointer(else_res->ty_))
+      r->SetPointer();
     temp::Label *trues = temp::LabelFactory::NewLabel();
     temp::Label *falses = temp::LabelFactory::NewLabel();
     temp::Label *flag = temp::LabelFactory::NewLabel();
@@ -595,6 +783,7 @@ tr::ExpAndTy *LetExp::Translate(env::VEnvPtr venv, env::TEnvPtr tenv,
   stm = new tree::ExpStm(res);
 
   if (passBool) {
+    stm = level->frame_->ProcEntryExit1(stm);
     frags->PushBack(new frame::ProcFrag(stm, level->frame_));
   }
 
@@ -609,12 +798,59 @@ tr::ExpAndTy *ArrayExp::Translate(env::VEnvPtr venv, env::TEnvPtr tenv,
   auto sres = size_->Translate(venv, tenv, level, label, errormsg);
   auto ires = init_->Translate(venv, tenv, level, label, errormsg);
 
+  auto size = temp::TempFactory::NewTemp();
+  auto init = temp::TempFactory::NewTemp();
+  if (tr::IsPointer(ires->ty_))
+    init->SetPointer();
+  auto bytes = temp::TempFactory::NewTemp();
+  auto header = temp::TempFactory::NewTemp();
+  auto array = temp::TempFactory::NewTemp();
+  array->SetPointer();
+  auto end = temp::TempFactory::NewTemp();
+  auto slot = temp::TempFactory::NewTemp();
+
+  temp::Label *bump = temp::LabelFactory::NewLabel();
+  temp::Label *test = temp::LabelFactory::NewLabel();
+  temp::Label *fill = temp::LabelFactory::NewLabel();
+  temp::Label *filled = temp::LabelFactory::NewLabel();
+  temp::Label *slow = temp::LabelFactory::NewLabel();
+  temp::Label *done = temp::LabelFactory::NewLabel();
+
   auto expList = new tree::ExpList();
   expList->Append(new tree::TempExp(reg_manager->FramePointer()));
-  expList->Append(sres->exp_->UnEx());
-  expList->Append(ires->exp_->UnEx());
-
-  tr::Exp *exp = new tr::ExExp(frame::ExternalCall("init_array", expList));
+  expList->Append(new tree::TempExp(size));
+  expList->Append(new tree::TempExp(init));
+  gc::HeaderKind kind = tr::IsPointer(static_cast<type::ArrayTy *>(ty)->ty_)
+                            ? gc::POINTER_ARRAY
+                            : gc::INT_ARRAY;
+  expList->Append(GetConstExp(kind));
+
+  tree::Stm *stm = new tree::MoveStm(new tree::TempExp(size), sres->exp_->UnEx());
+  stm = tree::Stm::Seq(stm, new tree::MoveStm(new tree::TempExp(init), ires->exp_->UnEx()));
+  // Negative and oversized sizes, unsigned above the limit, go to the
+  // runtime to be reported
+  stm = tree::Stm::Seq(stm, new tree::CjumpStm(tree::UGT_OP, new tree::TempExp(size), GetConstExp(gc::MAX_ARRAY_LENGTH), slow, bump));
+  stm = tree::Stm::Seq(stm, new tree::LabelStm(bump));
+  stm = tree::Stm::Seq(stm, new tree::MoveStm(new tree::TempExp(bytes), new tree::BinopExp(tree::LSHIFT_OP, new tree::TempExp(size), GetConstExp(3))));
+  stm = tree::Stm::Seq(stm, new tree::MoveStm(new tree::TempExp(header), GetPlusExp(new tree::BinopExp(tree::LSHIFT_OP, new tree::TempExp(size), GetConstExp(gc::HEADER_SHIFT)), GetConstExp(kind))));
+  stm = tree::Stm::Seq(stm, tr::BumpAllocate(array, end, new tree::TempExp(bytes), new tree::TempExp(header), slow));
+
+  // for (slot = array; slot < end; slot++) *slot = init
+  stm = tree::Stm::Seq(stm, new tree::MoveStm(new tree::TempExp(slot), new tree::TempExp(array)));
+  stm = tree::Stm::Seq(stm, new tree::LabelStm(test));
+  stm = tree::Stm::Seq(stm, new tree::CjumpStm(tree::LT_OP, new tree::TempExp(slot), new tree::TempExp(end), fill, filled));
+  stm = tree::Stm::Seq(stm, new tree::LabelStm(fill));
+  stm = tree::Stm::Seq(stm, new tree::MoveStm(new tree::MemExp(new tree::TempExp(slot)), new tree::TempExp(init)));
+  stm = tree::Stm::Seq(stm, new tree::MoveStm(new tree::TempExp(slot), GetPlusExp(new tree::TempExp(slot), GetConstExp(reg_manager->WordSize()))));
+  stm = tree::Stm::Seq(stm, tr::Jump(test));
+  stm = tree::Stm::Seq(stm, new tree::LabelStm(filled));
+  stm = tree::Stm::Seq(stm, tr::Jump(done));
+
+  stm = tree::Stm::Seq(stm, new tree::LabelStm(slow));
+  stm = tree::Stm::Seq(stm, new tree::MoveStm(new tree::TempExp(array), tr::MarkPointer(frame::ExternalCall("init_array", expList), ty)));
+  stm = tree::Stm::Seq(stm, new tree::LabelStm(done));
+
+  tr::Exp *exp = new tr::ExExp(new tree::EseqExp(stm, new tree::TempExp(array)));
   return new tr::ExpAndTy(exp, ty);
 }
 
@@ -629,14 +865,16 @@ tr::Exp *FunctionDec::Translate(env::VEnvPtr venv, env::TEnvPtr tenv,
                                 err::ErrorMsg *errormsg) const {
   for (auto &it : functions_->GetList()) {
     std::list<bool> escapes;
+    std::list<bool> pointers;
     type::TyList *tyList = new type::TyList();
     for (auto &iter : it->params_->GetList()) {
       escapes.push_back(iter->escape_);
       type::Ty *ty = tenv->Look(iter->typ_);
       tyList->Append(ty->ActualTy());
+      pointers.push_back(tr::IsPointer(ty));
     }
 
-    tr::Level *new_level = tr::Level::NewLevel(level, it->name_, escapes);
+    tr::Level *new_level = tr::Level::NewLevel(level, it->name_, escapes, pointers);
 
     type::Ty *result;
     if (it->result_) {
@@ -679,7 +917,7 @@ tr::Exp *VarDec::Translate(env::VEnvPtr venv, env::TEnvPtr tenv,
                            err::ErrorMsg *errormsg) const {
   auto ires = init_->Translate(venv, tenv, level, label, errormsg);
 
-  tr::Access *access = tr::Access::AllocLocal(level, escape_);
+  tr::Access *access = tr::Access::AllocLocal(level, escape_, tr::IsPointer(ires->ty_));
   venv->Enter(var_, new env::VarEntry(access, ires->ty_));
 
   return new tr::NxExp(new tree::MoveStm(access->access_->ToExp(new tree::TempExp(reg_manager->FramePointer())), ires->exp_->UnEx()));
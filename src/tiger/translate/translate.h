@@ -49,7 +49,7 @@ public:
 
   Access(Level *level, frame::Access *access)
       : level_(level), access_(access) {}
-  static Access *AllocLocal(Level *level, bool escape);
+  static Access *AllocLocal(Level *level, bool escape, bool pointer = false);
 };
 
 class AccessList {
@@ -72,8 +72,9 @@ public:
   Level(frame::Frame* frame, Level* parent): frame_(frame), parent_(parent) {};
   AccessList* Formals(Level* level) { return NULL; };
   
-  static Level* NewLevel(Level* parent, temp::Label* name, std::list<bool> formals) {
-    return new Level(new frame::X64Frame(name, formals), parent);
+  static Level* NewLevel(Level* parent, temp::Label* name, std::list<bool> formals,
+                         std::list<bool> pointers = {}) {
+    return new Level(new frame::X64Frame(name, formals, pointers), parent);
   }
 };
 
@@ -230,4 +230,27 @@ MemExp* NewMemPlus_Const(Exp* left, int right) {
   return new MemExp(new BinopExp(BinOp::PLUS_OP, left, new ConstExp(right)));
 }
 
+bool HoldsPointer(Exp *exp) {
+  switch (exp->kind_) {
+  case Exp::TEMP:
+    return static_cast<TempExp *>(exp)->temp_->IsPointer();
+  case Exp::MEM:
+    return static_cast<MemExp *>(exp)->pointer_;
+  case Exp::CALL:
+    return static_cast<CallExp *>(exp)->pointer_;
+  case Exp::ESEQ:
+    return HoldsPointer(static_cast<EseqExp *>(exp)->exp_);
+  default:
+    return false;
+  }
+}
+
+bool DerivesPointer(Exp *exp) {
+  if (exp->kind_ != Exp::BINOP)
+    return false;
+  auto binop = static_cast<BinopExp *>(exp);
+  return HoldsPointer(binop->left_) || HoldsPointer(binop->right_) ||
+         DerivesPointer(binop->left_) || DerivesPointer(binop->right_);
+}
+
 } // namespace tree
@@ -70,7 +70,7 @@ enum RelOp {
  * Statements
  */
 
-class Stm {
+class Stm : public arena::Object {
 public:
 
   enum Kind {SEQ, LABEL, JUMP, CJUMP, MOVE, EXP};
@@ -171,7 +171,7 @@ public:
  *Expressions
  */
 
-class Exp {
+class Exp : public arena::Object {
 public:
 
   enum Kind {BINOP, MEM, TEMP, ESEQ, NAME, CONST, CALL};
@@ -197,13 +197,19 @@ public:
   void Print(FILE *out, int d) const override;
   canon::StmAndExp Canon() override;
   temp::Temp *Munch(assem::InstrList &instr_list, std::string_view fs) override;
+
+private:
+  // "op src, dst" after copying the left operand to "dst", taking the right
+  // operand as an immediate or from memory when it is one
+  void MunchOperand(std::string_view op, temp::Temp *dst,
+                    assem::InstrList &instr_list, std::string_view fs);
 };
 
 class MemExp : public Exp {
 public:
   Exp *exp_;
-
-  // bool flag; /* used to detact whether is */
+  // Whether the word loaded is a heap pointer
+  bool pointer_ = false;
 
   explicit MemExp(Exp *exp) : Exp(MEM), exp_(exp) {}
   ~MemExp() override;
@@ -266,6 +272,8 @@ class CallExp : public Exp {
 public:
   Exp *fun_;
   ExpList *args_;
+  // Whether the call returns a heap pointer
+  bool pointer_ = false;
 
   CallExp(Exp *fun, ExpList *args) : Exp(CALL), fun_(fun), args_(args) {}
   ~CallExp() override;
@@ -275,7 +283,7 @@ public:
   temp::Temp *Munch(assem::InstrList &instr_list, std::string_view fs) override;
 };
 
-class ExpList {
+class ExpList : public arena::Object {
 public:
   ExpList() = default;
   ExpList(Exp* exp) : exp_list_({exp}) {} 
@@ -283,29 +291,29 @@ public:
 
   void Append(Exp *exp) { exp_list_.push_back(exp); }
   void Insert(Exp *exp) { exp_list_.push_front(exp); }
-  std::list<Exp *> &GetNonConstList() { return exp_list_; }
-  const std::list<Exp *> &GetList() { return exp_list_; }
+  arena::List<Exp *> &GetNonConstList() { return exp_list_; }
+  const arena::List<Exp *> &GetList() { return exp_list_; }
   temp::TempList *MunchArgs(assem::InstrList &instr_list, std::string_view fs);
   void ResetSP(assem::InstrList &instr_list, std::string_view fs);
   void PopStaticLink();
 private:
-  std::list<Exp *> exp_list_;
+  arena::List<Exp *> exp_list_;
 };
 
-class StmList {
+class StmList : public arena::Object {
   friend class canon::Canon;
 
 public:
   StmList() = default;
   StmList(Stm* stm) : stm_list_({stm}) {};
 
-  const std::list<Stm *> &GetList() { return stm_list_; }
+  const arena::List<Stm *> &GetList() { return stm_list_; }
   void Append(Stm* stm) { stm_list_.push_back(stm); };
   void Linear(Stm *stm);
   void Print(FILE *out) const;
 
 private:
-  std::list<Stm *> stm_list_;
+  arena::List<Stm *> stm_list_;
 };
 
 RelOp NotRel(RelOp);  // a op b == not(a NotRel(op) b)
@@ -313,6 +321,16 @@ RelOp Commute(RelOp); // a op b == b Commute(op) a
 
 MemExp* NewMemPlus_Const(Exp* left, int right);
 
+/**
+ * Whether the value of "exp" is a pointer to the start of a heap object, as
+ * far as its temps and the flags set during translation tell. Addresses
+ * computed from such a pointer are not.
+ */
+bool HoldsPointer(Exp *exp);
+
+// Whether "exp" is arithmetic on a heap pointer, i.e. an interior address
+bool DerivesPointer(Exp *exp);
+
 } // namespace tree
 
 #endif // TIGER_TRANSLATE_TREE_H_
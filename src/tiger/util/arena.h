@@ -0,0 +1,189 @@
+#ifndef TIGER_UTIL_ARENA_H_
+#define TIGER_UTIL_ARENA_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <list>
+#include <new>
+
+namespace arena {
+
+/**
+ * Bump allocator for compiler objects that die together. Memory is carved
+ * out of large chunks and is only given back all at once by Release, so
+ * objects in an arena must not be used after the phase that owns it ends.
+ *
+ * Destructors of arena objects still run when they are deleted, but nothing
+ * runs them on Release.
+ */
+class Arena {
+public:
+  Arena() = default;
+  ~Arena() { FreeChunks(nullptr); }
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+
+  void *Allocate(std::size_t size,
+                 std::size_t align = alignof(std::max_align_t)) {
+    if (observer_)
+      observer_(size);
+    char *p = AlignUp(ptr_, align);
+    if (!p || size > static_cast<std::size_t>(end_ - p)) {
+      NewChunk(size + align);
+      p = AlignUp(ptr_, align);
+    }
+    ptr_ = p + size;
+    return p;
+  }
+
+  /**
+   * Drop everything allocated so far. The oldest chunk is kept for reuse so
+   * that an arena released once per function does not go back to malloc
+   * every time.
+   */
+  void Release() {
+    Chunk *first = chunks_;
+    while (first && first->prev)
+      first = first->prev;
+    FreeChunks(first);
+    if (first) {
+      ptr_ = reinterpret_cast<char *>(first + 1);
+      end_ = ptr_ + first->size;
+    }
+  }
+
+  // Bytes of chunk memory currently held, used or not
+  [[nodiscard]] std::size_t Reserved() const { return reserved_; }
+
+  /**
+   * Have "observer" called with the size of every allocation from any
+   * arena. Set it before other threads start allocating.
+   */
+  static void Observe(void (*observer)(std::size_t)) { observer_ = observer; }
+
+  /**
+   * The arena that arena objects on this thread are allocated from. Outside
+   * of any Scope this is a per-thread arena that is never released.
+   */
+  static Arena *Current() {
+    if (current_)
+      return current_;
+    // Leaked on purpose: its objects may outlive the thread
+    static thread_local Arena *fallback = new Arena();
+    return fallback;
+  }
+
+  /**
+   * Makes "arena" current on this thread while alive
+   */
+  class Scope {
+  public:
+    explicit Scope(Arena *arena) : outer_(current_) { current_ = arena; }
+    ~Scope() { current_ = outer_; }
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+  private:
+    Arena *outer_;
+  };
+
+private:
+  static constexpr std::size_t CHUNK_SIZE = 64 * 1024;
+
+  struct alignas(std::max_align_t) Chunk {
+    Chunk *prev;
+    std::size_t size;
+  };
+
+  static char *AlignUp(char *p, std::size_t align) {
+    auto bits = reinterpret_cast<std::uintptr_t>(p);
+    return reinterpret_cast<char *>((bits + align - 1) & ~(align - 1));
+  }
+
+  void NewChunk(std::size_t min_size) {
+    std::size_t size = min_size > CHUNK_SIZE ? min_size : CHUNK_SIZE;
+    auto chunk = static_cast<Chunk *>(std::malloc(sizeof(Chunk) + size));
+    if (!chunk)
+      throw std::bad_alloc();
+    chunk->prev = chunks_;
+    chunk->size = size;
+    chunks_ = chunk;
+    reserved_ += size;
+    ptr_ = reinterpret_cast<char *>(chunk + 1);
+    end_ = ptr_ + size;
+  }
+
+  // Free every chunk newer than "keep"
+  void FreeChunks(Chunk *keep) {
+    while (chunks_ != keep) {
+      Chunk *prev = chunks_->prev;
+      reserved_ -= chunks_->size;
+      std::free(chunks_);
+      chunks_ = prev;
+    }
+    ptr_ = end_ = nullptr;
+  }
+
+  Chunk *chunks_ = nullptr;
+  char *ptr_ = nullptr;
+  char *end_ = nullptr;
+  std::size_t reserved_ = 0;
+
+  static inline thread_local Arena *current_ = nullptr;
+  static inline void (*observer_)(std::size_t) = nullptr;
+};
+
+/**
+ * Base of node types that are allocated from the current arena. Deleting
+ * one runs its destructor but leaves the memory to the arena.
+ */
+class Object {
+public:
+  static void *operator new(std::size_t size) {
+    return Arena::Current()->Allocate(size);
+  }
+  static void operator delete(void *) {}
+};
+
+/**
+ * Standard allocator over the arena that was current when the container
+ * using it was built, so that its elements live and die with the container
+ * whatever arena is current when they are added
+ */
+template <typename T> class Allocator {
+public:
+  using value_type = T;
+
+  Allocator() : arena_(Arena::Current()) {}
+  template <typename U>
+  Allocator(const Allocator<U> &other) : arena_(other.arena_) {}
+
+  T *allocate(std::size_t n) {
+    void *p = arena_->Allocate(n * sizeof(T), alignof(T));
+    return static_cast<T *>(p);
+  }
+  void deallocate(T *, std::size_t) {}
+
+  // A copy belongs to the arena it is made in, like any new container
+  Allocator select_on_container_copy_construction() const {
+    return Allocator();
+  }
+
+  template <typename U> bool operator==(const Allocator<U> &other) const {
+    return arena_ == other.arena_;
+  }
+  template <typename U> bool operator!=(const Allocator<U> &other) const {
+    return arena_ != other.arena_;
+  }
+
+private:
+  template <typename U> friend class Allocator;
+  Arena *arena_;
+};
+
+template <typename T> using List = std::list<T, Allocator<T>>;
+
+} // namespace arena
+
+#endif // TIGER_UTIL_ARENA_H_
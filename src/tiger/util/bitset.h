@@ -0,0 +1,90 @@
+#ifndef TIGER_UTIL_BITSET_H_
+#define TIGER_UTIL_BITSET_H_
+
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+namespace bits {
+
+/**
+ * Fixed-size dense set of small integers, packed 64 per word.
+ * Used by the dataflow passes where temps and nodes are renumbered to
+ * contiguous indices.
+ */
+class BitSet {
+public:
+  BitSet() = default;
+  explicit BitSet(int size) : size_(size), words_((size + 63) / 64, 0) {}
+
+  [[nodiscard]] int Size() const { return size_; }
+
+  [[nodiscard]] bool Test(int i) const {
+    assert(i >= 0 && i < size_);
+    return (words_[i >> 6] >> (i & 63)) & 1;
+  }
+  void Set(int i) {
+    assert(i >= 0 && i < size_);
+    words_[i >> 6] |= uint64_t(1) << (i & 63);
+  }
+  void Reset(int i) {
+    assert(i >= 0 && i < size_);
+    words_[i >> 6] &= ~(uint64_t(1) << (i & 63));
+  }
+  void Clear() {
+    for (auto &w : words_)
+      w = 0;
+  }
+
+  /**
+   * this |= other
+   * @return whether any bit is newly set
+   */
+  bool UnionWith(const BitSet &other) {
+    assert(other.words_.size() == words_.size());
+    uint64_t changed = 0;
+    for (std::size_t i = 0; i < words_.size(); i++) {
+      uint64_t w = words_[i] | other.words_[i];
+      changed |= w ^ words_[i];
+      words_[i] = w;
+    }
+    return changed != 0;
+  }
+
+  /**
+   * this = use | (out & ~def), the liveness transfer function
+   * @return whether this set changed
+   */
+  bool AssignTransfer(const BitSet &use, const BitSet &out, const BitSet &def) {
+    uint64_t changed = 0;
+    for (std::size_t i = 0; i < words_.size(); i++) {
+      uint64_t w = use.words_[i] | (out.words_[i] & ~def.words_[i]);
+      changed |= w ^ words_[i];
+      words_[i] = w;
+    }
+    return changed != 0;
+  }
+
+  // Call f(i) for every member i in increasing order
+  template <typename F> void ForEach(F f) const {
+    for (std::size_t i = 0; i < words_.size(); i++) {
+      uint64_t w = words_[i];
+      while (w) {
+        int bit = __builtin_ctzll(w);
+        f(static_cast<int>(i * 64 + bit));
+        w &= w - 1;
+      }
+    }
+  }
+
+  bool operator==(const BitSet &other) const { return words_ == other.words_; }
+  bool operator!=(const BitSet &other) const { return words_ != other.words_; }
+
+private:
+  int size_ = 0;
+  std::vector<uint64_t> words_;
+};
+
+} // namespace bits
+
+#endif // TIGER_UTIL_BITSET_H_
@@ -1,6 +1,10 @@
 #ifndef TIGER_UTIL_GRAPH_H_
 #define TIGER_UTIL_GRAPH_H_
 
+#include <cstdint>
+#include <unordered_set>
+#include <vector>
+
 #include "tiger/util/table.h"
 
 namespace graph {
@@ -16,6 +20,9 @@ public:
   // Get the list of nodes belonging to graph
   NodeList<T> *Nodes();
 
+  // Get the node whose key is "key"
+  Node<T> *GetNode(int key) { return my_nodes_->node_list_[key]; }
+
   // Make a new node in graph "g", with associated "info_"
   Node<T> *NewNode(T *info);
 
@@ -23,6 +30,14 @@ public:
   // to the same graph
   void AddEdge(Node<T> *from, Node<T> *to);
 
+  // Remove every edge into or out of "n", which stays in the graph unconnected
+  void Isolate(Node<T> *n);
+
+  // Tell if there is an edge from "from" to "to", in constant time
+  bool HasEdge(Node<T> *from, Node<T> *to) const {
+    return edges_.count(EdgeKey(from, to)) != 0;
+  }
+
   // Show all the nodes and edges in the graph, using the function "show_info"
   // to print the name of each node
   static void Show(FILE *out, NodeList<T> *p,
@@ -33,7 +48,15 @@ public:
   ~Graph();
 
 private:
+  // Nodes are indexed by their key
   NodeList<T> *my_nodes_;
+  // Edge set for O(1) membership tests, keyed by (from, to) node keys
+  std::unordered_set<uint64_t> edges_;
+
+  static uint64_t EdgeKey(Node<T> *from, Node<T> *to) {
+    return (static_cast<uint64_t>(from->my_key_) << 32) |
+           static_cast<uint32_t>(to->my_key_);
+  }
 };
 
 template <typename T> class Node {
@@ -52,7 +75,8 @@ public:
   // Return length of successor list for node n
   int OutDegree();
 
-  // Get all the successors and predecessors
+  // Get all the successors and predecessors, each listed once. The list is
+  // owned by the node and kept up to date by Graph::AddEdge
   NodeList<T> *Adj();
 
   // Get all the successors of node
@@ -74,6 +98,7 @@ public:
   ~Node<T>() {
     delete succs_;
     delete preds_;
+    delete adj_;
   }
 
 private:
@@ -81,10 +106,12 @@ private:
   int my_key_;
   NodeList<T> *succs_;
   NodeList<T> *preds_;
+  // Union of succs_ and preds_, maintained by Graph::AddEdge
+  NodeList<T> *adj_;
   T *info_;
   Node<T>()
       : my_graph_(nullptr), my_key_(0), succs_(nullptr), preds_(nullptr),
-        info_(nullptr) {}
+        adj_(nullptr), info_(nullptr) {}
 };
 
 template <typename T> class NodeList {
@@ -103,7 +130,7 @@ public:
   void CatList(NodeList<T> *nl);
   void DeleteNode(Node<T> *n);
   void Clear() { node_list_.clear(); }
-  void Prepend(Node<T> *n) { node_list_.push_front(n); }
+  void Prepend(Node<T> *n) { node_list_.insert(node_list_.begin(), n); }
   void Append(Node<T> *n) { node_list_.push_back(n); }
   void Fusion(Node<T> *n) {
     if (!Contain(n))
@@ -114,12 +141,12 @@ public:
   NodeList<T> *Union(NodeList<T> *nl);
   NodeList<T> *Diff(NodeList<T> *nl);
 
-  [[nodiscard]] const std::list<Node<T> *> &GetList() const {
+  [[nodiscard]] const std::vector<Node<T> *> &GetList() const {
     return node_list_;
   }
 
 private:
-  std::list<Node<T> *> node_list_{};
+  std::vector<Node<T> *> node_list_{};
 };
 
 // Generic creation of Node<tree>
@@ -132,17 +159,18 @@ template <typename T> Node<T> *Graph<T>::NewNode(T *info) {
 
   n->succs_ = new NodeList<T>();
   n->preds_ = new NodeList<T>();
+  n->adj_ = new NodeList<T>();
   n->info_ = info;
 
   return n;
 }
 
 template <typename T> bool Node<T>::GoesTo(Node<T> *n) {
-  return succs_->Contain(n);
+  return my_graph_->HasEdge(this, n);
 }
 
 template <typename T> bool Node<T>::Adj(Node<T> *n) {
-  return succs_->Contain(n) || preds_->Contain(n);
+  return my_graph_->HasEdge(this, n) || my_graph_->HasEdge(n, this);
 }
 
 template <typename T> void Graph<T>::AddEdge(Node<T> *from, Node<T> *to) {
@@ -150,12 +178,36 @@ template <typename T> void Graph<T>::AddEdge(Node<T> *from, Node<T> *to) {
   assert(to);
   assert(from->my_graph_ == this);
   assert(to->my_graph_ == this);
-  if (from->GoesTo(to))
+  // Checked first, since for a self-loop the reverse is the edge itself
+  bool reverse = HasEdge(to, from);
+  if (!edges_.insert(EdgeKey(from, to)).second)
     return;
+  if (!reverse) {
+    from->adj_->node_list_.push_back(to);
+    if (from != to)
+      to->adj_->node_list_.push_back(from);
+  }
   to->preds_->node_list_.push_back(from);
   from->succs_->node_list_.push_back(to);
 }
 
+template <typename T> void Graph<T>::Isolate(Node<T> *n) {
+  assert(n);
+  assert(n->my_graph_ == this);
+  for (auto m : n->adj_->node_list_) {
+    edges_.erase(EdgeKey(n, m));
+    edges_.erase(EdgeKey(m, n));
+    if (m == n)
+      continue;
+    m->succs_->DeleteNode(n);
+    m->preds_->DeleteNode(n);
+    m->adj_->DeleteNode(n);
+  }
+  n->succs_->Clear();
+  n->preds_->Clear();
+  n->adj_->Clear();
+}
+
 template <typename T> Graph<T>::~Graph() {
   for (auto node : my_nodes_->node_list_) {
     delete node;
@@ -173,12 +225,7 @@ template <typename T> int Node<T>::OutDegree() {
 
 template <typename T> int Node<T>::Degree() { return InDegree() + OutDegree(); }
 
-template <typename T> NodeList<T> *Node<T>::Adj() {
-  NodeList<T> *adj_list = new NodeList<T>();
-  adj_list->CatList(succs_);
-  adj_list->CatList(preds_);
-  return adj_list;
-}
+template <typename T> NodeList<T> *Node<T>::Adj() { return adj_; }
 
 template <typename T> NodeList<T> *Node<T>::Succ() { return succs_; }
 
@@ -219,20 +266,21 @@ template <typename T> void NodeList<T>::CatList(NodeList<T> *nl) {
 
 template <typename T> NodeList<T> *NodeList<T>::Union(NodeList<T> *nl) {
   NodeList<T> *res = new NodeList<T>();
-  for (auto node : node_list_) {
-    res->Append(node);
-  }
+  std::unordered_set<Node<T> *> seen(node_list_.begin(), node_list_.end());
+  res->node_list_ = node_list_;
   for (auto node : nl->GetList()) {
-    if (!res->Contain(node))
-      res->Append(node);
+    if (seen.insert(node).second)
+      res->node_list_.push_back(node);
   }
   return res;
 }
 
 template <typename T> NodeList<T> *NodeList<T>::Diff(NodeList<T> *nl) {
   NodeList<T> *res = new NodeList<T>();
+  std::unordered_set<Node<T> *> removed(nl->node_list_.begin(),
+                                        nl->node_list_.end());
   for (auto node : node_list_) {
-    if (!nl->Contain(node))
+    if (!removed.count(node))
       res->node_list_.push_back(node);
   }
   return res;
@@ -2,12 +2,23 @@
 #define TIGER_UTIL_TABLE_H_
 
 #include <cassert>
+#include <cstdint>
 #include <functional>
+#include <unordered_map>
+#include <vector>
 
 namespace tab {
+/**
+ * A map from keys, compared by address, to values. Entering a key that is
+ * already bound hides the old binding until Pop undoes that Enter.
+ *
+ * Bindings live in an open-addressing table that doubles when it is 3/4
+ * full. Pop is driven by an undo log of the keys entered and the values they
+ * hid, so no memory is allocated per binding.
+ */
 template <typename KeyType, typename ValueType> class Table {
 public:
-  Table() : top_(nullptr), table_() {}
+  Table() = default;
   void Enter(KeyType *key, ValueType *value);
   ValueType *Look(KeyType *key);
   void Set(KeyType *key, ValueType *value);
@@ -15,79 +26,117 @@ public:
   void Dump(std::function<void(KeyType *, ValueType *)> show);
 
 protected:
-  static const unsigned long TABSIZE = 127;
-  struct Binder {
-  public:
-    KeyType *key;
-    ValueType *value;
-    Binder *next;
-    KeyType *prevtop;
+  static constexpr std::size_t INITIAL_SLOTS = 16;
 
-    Binder(KeyType *key, ValueType *value, Binder *next, KeyType *prevtop)
-        : key(key), value(value), next(next), prevtop(prevtop) {}
+  struct Slot {
+    KeyType *key = nullptr;
+    ValueType *value = nullptr;
+    // Number of bindings of key, visible or hidden
+    unsigned int depth = 0;
+  };
+  struct Undo {
+    KeyType *key;
+    ValueType *hidden;
   };
 
-  Binder *table_[TABSIZE];
-  KeyType *top_;
+  // The slot holding "key", or the empty slot where it would go
+  Slot *Find(KeyType *key) const;
+  void Grow();
+
+  std::vector<Slot> slots_;
+  std::size_t used_ = 0;
+  int shift_ = 64;
+  std::vector<Undo> undo_;
 };
 
+template <typename KeyType, typename ValueType>
+typename Table<KeyType, ValueType>::Slot *
+Table<KeyType, ValueType>::Find(KeyType *key) const {
+  // Fibonacci hashing: the high bits of the product are well mixed
+  std::size_t mask = slots_.size() - 1;
+  std::size_t i =
+      (reinterpret_cast<std::uintptr_t>(key) * 0x9E3779B97F4A7C15ull) >>
+      shift_;
+  auto slots = const_cast<Slot *>(slots_.data());
+  while (slots[i].key && slots[i].key != key)
+    i = (i + 1) & mask;
+  return &slots[i];
+}
+
+template <typename KeyType, typename ValueType>
+void Table<KeyType, ValueType>::Grow() {
+  std::vector<Slot> old;
+  old.swap(slots_);
+  std::size_t size = old.empty() ? INITIAL_SLOTS : old.size() * 2;
+  slots_.resize(size);
+  shift_ = 64;
+  while (size > 1) {
+    size >>= 1;
+    shift_--;
+  }
+  for (auto &slot : old)
+    if (slot.key)
+      *Find(slot.key) = slot;
+}
+
 template <typename KeyType, typename ValueType>
 void Table<KeyType, ValueType>::Enter(KeyType *key, ValueType *value) {
-  unsigned long index = reinterpret_cast<unsigned long>(key) % TABSIZE;
-  table_[index] = new Binder(key, value, table_[index], top_);
-  top_ = key;
+  assert(key);
+  if ((used_ + 1) * 4 > slots_.size() * 3)
+    Grow();
+  Slot *slot = Find(key);
+  if (!slot->key) {
+    slot->key = key;
+    used_++;
+  }
+  undo_.push_back({key, slot->value});
+  slot->value = value;
+  slot->depth++;
 }
 
 template <typename KeyType, typename ValueType>
 ValueType *Table<KeyType, ValueType>::Look(KeyType *key) {
   assert(key);
-  unsigned long index = reinterpret_cast<unsigned long>(key) % TABSIZE;
-  Binder *b;
-  for (b = table_[index]; b; b = b->next)
-    if (b->key == key)
-      return b->value;
-  return nullptr;
+  if (slots_.empty())
+    return nullptr;
+  Slot *slot = Find(key);
+  return slot->depth ? slot->value : nullptr;
 }
 
 template <typename KeyType, typename ValueType>
 void Table<KeyType, ValueType>::Set(KeyType *key, ValueType *value) {
   assert(key);
-  unsigned long index = reinterpret_cast<unsigned long>(key) % TABSIZE;
-  Binder *b;
-  for (b = table_[index]; b; b = b->next)
-    if (b->key == key) {
-      b->value = value;
-      return;
-    }
+  if (slots_.empty())
+    return;
+  Slot *slot = Find(key);
+  if (slot->depth)
+    slot->value = value;
 }
 
 template <typename KeyType, typename ValueType>
 KeyType *Table<KeyType, ValueType>::Pop() {
-  KeyType *k = top_;
-  assert(k);
-  unsigned long index = reinterpret_cast<unsigned long>(k) % TABSIZE;
-  Binder *b = table_[index];
-  assert(b);
-  table_[index] = b->next;
-  top_ = b->prevtop;
-  return b->key;
+  assert(!undo_.empty());
+  Undo undo = undo_.back();
+  undo_.pop_back();
+  Slot *slot = Find(undo.key);
+  assert(slot->depth);
+  slot->value = undo.hidden;
+  slot->depth--;
+  return undo.key;
 }
 
 template <typename KeyType, typename ValueType>
 void Table<KeyType, ValueType>::Dump(
     std::function<void(KeyType *, ValueType *)> show) {
-  KeyType *k = top_;
-  unsigned long index = reinterpret_cast<unsigned long>(k) % TABSIZE;
-  Binder *b = table_[index];
-  if (b == nullptr)
-    return;
-  table_[index] = b->next;
-  top_ = b->prevtop;
-  show(b->key, b->value);
-  Dump(show);
-  assert(top_ == b->prevtop && table_[index] == b->next);
-  top_ = k;
-  table_[index] = b;
+  // Walk the bindings newest first, tracking what each Enter had hidden
+  std::unordered_map<KeyType *, ValueType *> visible;
+  for (auto it = undo_.rbegin(); it != undo_.rend(); ++it) {
+    auto seen = visible.find(it->key);
+    ValueType *value =
+        seen != visible.end() ? seen->second : Find(it->key)->value;
+    show(it->key, value);
+    visible[it->key] = it->hidden;
+  }
 }
 
 } // namespace tab